@@ -80,6 +80,21 @@ namespace fastbotx {
         return convert.to_bytes(result_wide);
     }
 
+    size_t estimate_tokens(const std::string& str) {
+        size_t ascii = 0;
+        size_t wide = 0;
+        for (unsigned char c: str) {
+            if (c < 0x80) {
+                ascii++;
+            }
+            else if ((c & 0xC0) != 0x80) {
+                // lead byte of a multi-byte character
+                wide++;
+            }
+        }
+        return (ascii + 3) / 4 + wide;
+    }
+
     /// According to the string of action type, convert it to the corresponding value of ActionType
     /// \param actionTypeString String of action type to be converted
     /// \return The converted value of ActionType
@@ -20,6 +20,7 @@
 #include <functional>
 #include <chrono>
 #include <cmath>
+#include <cstdint>
 
 #include "json.hpp"
 #include <jni.h>
@@ -120,6 +121,9 @@ namespace fastbotx {
 
     std::string safe_utf8_substr(const std::string& str, size_t start, size_t len);
 
+    /// rough count of model tokens in str: four ascii bytes or one multi-byte character each
+    size_t estimate_tokens(const std::string& str);
+
     class PriorityNode {
     public:
         PriorityNode();
@@ -361,18 +365,66 @@ namespace fastbotx {
         return false;
     }
 
-    inline int randomInt(int min, int max) {
-        // std::srand((unsigned int)std::time(nullptr));
-        int rand = std::rand();
-        return min + rand % (max - min);
-    }
+    /// xoshiro256** pseudo random generator, seeded through splitmix64.
+    /// Each agent owns one, so that a run started with the same seed makes the same picks.
+    class RandomGenerator {
+    public:
+        explicit RandomGenerator(uint64_t seed = 0) { this->seed(seed); }
+
+        void seed(uint64_t seed) {
+            this->_seed = seed;
+            uint64_t x = seed;
+            for (uint64_t &s: this->_state) {
+                // splitmix64
+                uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                s = z ^ (z >> 31);
+            }
+        }
 
+        uint64_t getSeed() const { return this->_seed; }
+
+        uint64_t next() {
+            const uint64_t result = rotl(this->_state[1] * 5, 7) * 9;
+            const uint64_t t = this->_state[1] << 17;
+            this->_state[2] ^= this->_state[0];
+            this->_state[3] ^= this->_state[1];
+            this->_state[1] ^= this->_state[2];
+            this->_state[0] ^= this->_state[3];
+            this->_state[2] ^= t;
+            this->_state[3] = rotl(this->_state[3], 45);
+            return result;
+        }
 
-    inline int randomInt(int min, int max, int seed) {
-        std::srand((unsigned int) std::time(nullptr) + seed * 2989);
-        int rand = std::rand();
-        return min + rand % (max - min);
-    }
+        /// \return a random int in [min, max), min if the range is empty
+        int nextInt(int min, int max) {
+            if (max <= min)
+                return min;
+            auto range = (uint64_t) ((int64_t) max - min);
+            return (int) (min + (int64_t) (next() % range));
+        }
+
+        /// \return a random long in [0, bound), 0 if bound is not positive
+        long nextLong(long bound) {
+            if (bound <= 0)
+                return 0;
+            return (long) (next() % (uint64_t) bound);
+        }
+
+        /// \return a random double in [0, 1)
+        double nextDouble() {
+            return (double) (next() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+    private:
+        static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+        uint64_t _seed{};
+        uint64_t _state[4]{};
+    };
+
+    typedef std::shared_ptr<RandomGenerator> RandomGeneratorPtr;
 
     inline void trimString(std::string &str) {
         str.erase(0, str.find_first_not_of(' '));
@@ -441,32 +493,6 @@ namespace fastbotx {
         return true;
     }
 
-#define AlphabetSeqLen 88
-#define AlphabetChSeqLen 64
-    static const char AlphabetSeq[AlphabetSeqLen] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz~!@#$%^&*()<>_-;',.?/\"|{}";// len 84
-    static const char AlphabetChSeq[AlphabetChSeqLen] = "你好中文字符串｜。，；（）【】？！测试啊哈"; // len 64
-
-    inline std::string getRandomChars() {
-        std::stringstream randomStringStream;
-        int len = randomInt(11, 1000);
-        auto seed = (unsigned int) std::time(nullptr);
-        while (len-- > 0) {
-            std::srand(len * 2 ^ 8 + seed);
-            int rand = std::rand();
-            int i = rand % (AlphabetSeqLen * 4 + AlphabetChSeqLen);
-            if (i < AlphabetSeqLen * 4) {
-                i /= 4;
-                randomStringStream << AlphabetSeq[i];
-            } else {
-                i -= (AlphabetSeqLen * 4);
-                i = i / 3 * 3;
-                randomStringStream << AlphabetChSeq[i] << AlphabetChSeq[i + 1]
-                                   << AlphabetChSeq[i + 2];
-                len -= 2;
-            }
-        }
-        return randomStringStream.str();
-    }
 
 }
 #endif //BASE_H_
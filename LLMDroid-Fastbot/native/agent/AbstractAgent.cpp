@@ -25,11 +25,17 @@ namespace fastbotx {
               _algorithmType(AlgorithmType::Random),
               _graph(model->getGraph()),
               _mergedStateGraph(std::make_shared<MergedStateGraph>(_graph)),
-              _gptAgent(GPTAgent(_mergedStateGraph, std::move(_promiseInt))),
+              _gptAgent(GPTAgent(_mergedStateGraph, std::move(_promiseGuide))),
               _useCodeCoverage(useCodeCoverage),
               _codeCoverageMonitor(_rateCapacity, _minGrowthRate)
     {
         this->_model = model;
+        uint64_t seed = model->getPreference() ? model->getPreference()->getRandomSeed() : 0;
+        if (0 == seed) {
+            seed = (uint64_t) std::chrono::high_resolution_clock::now().time_since_epoch().count();
+        }
+        _random.seed(seed);
+        callJavaLogger(MAIN_THREAD, "random seed: %llu, set max.randomSeed to replay", (unsigned long long) seed);
         _totalMergedState = 0;
         _lastGraphOverviewTime = currentStamp();
         _startTime = currentStamp();
@@ -171,6 +177,7 @@ namespace fastbotx {
         // update code coverage every step
         double currentCodeCoverage = getCodeCoverage();
         callJavaLogger(MAIN_THREAD, "[Check] currentCodeCoverage: %f", currentCodeCoverage);
+        _lastCodeCoverage = currentCodeCoverage;
         
         if (_currentMode == Mode::EXPLORE) {
             // update threshold
@@ -184,12 +191,34 @@ namespace fastbotx {
             callJavaLogger(MAIN_THREAD, "[Check] CV window size: %d, current threshold: %f", _growthRateWindow.size(), _currentThreshold);
 
             checkShouldWait();
+            // the model is unreachable, keep exploring on our own until the circuit closes again
+            if (_shouldWait && !_gptAgent.isAvailable()) {
+                callJavaLogger(MAIN_THREAD, "[Check] LLM unavailable, keep exploring");
+                return;
+            }
+            // the recent consultations gained less than exploring, put the next one off
+            if (_shouldWait && !_gptAgent.getScheduler()->shouldConsult(currentStamp())) {
+                callJavaLogger(MAIN_THREAD, "[Check] consultations don't pay off lately, keep exploring");
+                _nextStageTime = _runTime + currentStamp();
+                _growthRateWindow.clear();
+                _shouldWait = false;
+                return;
+            }
             if (_shouldWait) {
+                _gptAgent.getScheduler()->beginConsultation(currentStamp(), currentCodeCoverage, _totalMergedState);
                 prepareForNavigation();
                 return;
             }
         }
 
+        if (_currentMode == Mode::GUIDANCE) {
+            pollGuidance();
+            // already at the target when the answer landed, start testing right away
+            if (_currentMode != Mode::TEST_FUNCTION) {
+                return;
+            }
+        }
+
         if (_currentMode == Mode::NAVIGATE) {
             int status = guideCheck();
             if (status == 1) {
@@ -304,24 +333,82 @@ namespace fastbotx {
 
     void AbstractAgent::GPTFunctionAnalysis(QuestionPayload payload)
     {
+        // nobody waits for the answers of overviews and reanalysis, the other questions are answered
+        // by the worker right away while the circuit is open
+        bool awaited = payload.type == AskModel::GUIDE || payload.type == AskModel::TEST_FUNCTION;
+        if (!awaited && !_gptAgent.isAvailable()) {
+            callJavaLogger(MAIN_THREAD, "LLM unavailable, skip asking about MergedState%d", payload.from->getId());
+            return;
+        }
+        // overviews feed the guide and are only cut by the budget, reanalysis also when it rarely pays off
+        ConsultationSchedulerPtr scheduler = _gptAgent.getScheduler();
+        if ((payload.type == AskModel::STATE_OVERVIEW && !scheduler->hasBackgroundBudget()) ||
+            (payload.type == AskModel::REANALYSIS && !scheduler->allowOptional(static_cast<int>(payload.type)))) {
+            callJavaLogger(MAIN_THREAD, "Not worth asking about MergedState%d, skip", payload.from->getId());
+            return;
+        }
         _gptAgent.pushStateToQueue(payload);
         return;
     }
 
     void AbstractAgent::prepareForNavigation() {
-        _currentMode = Mode::NAVIGATE;
-        _gptAgent.waitUntilQueueEmpty();
-        debugMergedStates();
+        _currentMode = Mode::GUIDANCE;
+        _guideRequested = false;
+        _guidanceStartTime = currentStamp();
+        pollGuidance();
+    }
 
-        _guideTime++;
-        _totalGuideTime++;
+    void AbstractAgent::pollGuidance() {
+        double now = currentStamp();
+        if (!_guideRequested) {
+            // the overviews being asked are part of the state informations of the guide, wait for them
+            int drainTimeout = _gptAgent.getDrainTimeout();
+            if (!_gptAgent.isQueueEmpty() && (drainTimeout <= 0 || now - _guidanceStartTime < drainTimeout)) {
+                return;
+            }
+            debugMergedStates();
 
-        // create payload
-        resetFuture();
-        GPTFunctionAnalysis({AskModel::GUIDE, nullptr, {}, 0, nullptr, false});
+            _guideTime++;
+            _totalGuideTime++;
+
+            // create payload
+            resetFuture();
+            GPTFunctionAnalysis({AskModel::GUIDE, nullptr, {}, 0, nullptr, false});
+            _guideRequested = true;
+            _guideRequestedTime = now;
+            return;
+        }
 
-        _guideTarget = _futureInt.get();
+        if (_futureGuide.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            int guideTimeout = _gptAgent.getGuideTimeout();
+            if (guideTimeout > 0 && now - _guideRequestedTime > guideTimeout) {
+                callJavaLogger(MAIN_THREAD, "[MAIN] no guide answer after %d ms, give up", guideTimeout);
+                abandonGuidance();
+            }
+            return;
+        }
+        onGuideAnswered(_futureGuide.get());
+    }
+
+    void AbstractAgent::onGuideAnswered(const GuideAnswer& answer) {
+        _guideTarget = -1;
+        if (answer.mergedStateId != -1) {
+            _gptAgent.acceptGuide(answer);
+            // looked up now, the graph has kept growing while the question was asked
+            MergedStatePtr destination = _mergedStateGraph->findMergedStateById(answer.mergedStateId);
+            ReuseStatePtr targetState = destination ? destination->getTargetState(answer.function) : nullptr;
+            _guideTarget = targetState ? targetState->getIdi() : -1;
+        }
+        _currentMode = Mode::NAVIGATE;
         callJavaLogger(MAIN_THREAD, "[MAIN] get guide target state: %d", _guideTarget);
+
+        // the agent went on exploring while waiting, it may have reached the target already
+        if (_guideTarget != -1 && _mCurrentState && _mCurrentState->getIdi() == _guideTarget) {
+            callJavaLogger(MAIN_THREAD, "[MAIN] already at R%d, skip navigation", _guideTarget);
+            onNavigationOver(true);
+            return;
+        }
+
         //find path
         _paths = _graph->findPath(_guideTarget, true);
 
@@ -336,6 +423,19 @@ namespace fastbotx {
         }
     }
 
+    void AbstractAgent::abandonGuidance() {
+        // The late answer fulfills a promise nobody waits for anymore.
+        // Unlike prepareBackToExplore, the target function is left alone since it was never tested.
+        _currentMode = Mode::EXPLORE;
+        _guideRequested = false;
+        _guideTarget = -1;
+        _guideTime = 0;
+        _nextStageTime = _runTime + currentStamp();
+        _growthRateWindow.clear();
+        _shouldWait = false;
+        _gptAgent.getScheduler()->endConsultation(currentStamp(), _lastCodeCoverage, _totalMergedState, -1);
+    }
+
     void AbstractAgent::onNavigationFailed() {
         // _guideTime means: After detecting low growth rate,
         // we have already tried guide for _guideTime times
@@ -489,6 +589,8 @@ namespace fastbotx {
         _lastGraphOverviewTime = currentStamp();
         _growthRateWindow.clear();
         _shouldWait = false;
+        _gptAgent.getScheduler()->endConsultation(currentStamp(), _lastCodeCoverage, _totalMergedState,
+                                                  _gptAgent.getTargetMergedStateId());
 
         // consider the function is tested whether succeed or not
         // MergedStatePtr ms = state->getMergedState();
@@ -496,6 +598,10 @@ namespace fastbotx {
         _gptAgent.addTestedFunction();
 
         _executedSteps = 0;
+        if (_prefetchState) {
+            _gptAgent.dropTestSteps();
+            _prefetchState = nullptr;
+        }
         _gptAgent.clearExecutedEvents();
 
         // reanalyze mergedStates
@@ -539,26 +645,27 @@ namespace fastbotx {
         double totalPriority = 0;           
         for (const ActivityStateActionPtr &action: _newState->getActions()) {
             // click has priority of 4, other priority is 2, why?
+            // the priority is computed locally and set once, so that the state's sampler
+            // only refreshes the actions whose priority actually changed
             int basePriority = action->getPriorityByActionType();
-            action->setPriority(basePriority);
+            int priority = basePriority;
             if (!action->requireTarget()) {
                 if (!action->isVisited()) {
-                    int priority = action->getPriority();
                     priority += 5;
-                    action->setPriority(priority);
                 }
+                action->setPriority(priority);
                 continue;
             }
             if (!action->isValid()) {
+                action->setPriority(priority);
                 continue;
             }
-            int priority = action->getPriority();
             if (!action->isVisited()) {
                 priority += 20;         
             }
             if (!this->_newState->isSaturated(action))          
             {
-                priority += 5 * action->getPriorityByActionType();
+                priority += 5 * basePriority;
             }
 
             if (priority <= 0) {
@@ -566,7 +673,7 @@ namespace fastbotx {
             }
 
             action->setPriority(priority);          
-            totalPriority += (priority - action->getPriorityByActionType());
+            totalPriority += (priority - basePriority);
         }
         _newState->setPriority((int) totalPriority);
     }
@@ -618,7 +725,7 @@ namespace fastbotx {
     }
 
     ActivityStateActionPtr AbstractAgent::handleNullAction() const {
-        ActivityStateActionPtr action = this->_newState->randomPickAction(this->_validateFilter);
+        ActivityStateActionPtr action = this->_newState->randomPickAction(this->_validateFilter, this->_random);
         if (nullptr != action) {
             ActivityStateActionPtr resolved = this->_newState->resolveAt(action,
                                                                          this->_model.lock()->getGraph()->getTimestamp());
@@ -660,11 +767,28 @@ namespace fastbotx {
         if (_executedSteps < 5) {
             _executedSteps++;
 
-            resetFuture();
             ReuseStatePtr state = std::dynamic_pointer_cast<ReuseState>(_newState);          
-            GPTFunctionAnalysis({AskModel::TEST_FUNCTION, nullptr, {}, 0, state, false});
+            FutureTestStep future;
+            if (_prefetchState && _prefetchState == state) {
+                _prefetchHits++;
+                future = std::move(_prefetchFuture);
+            }
+            else {
+                if (_prefetchState) {
+                    // the question for the predicted state must not hold up the one for this state
+                    _prefetchMisses++;
+                    _gptAgent.dropTestSteps();
+                }
+                resetFuture();
+                GPTFunctionAnalysis({AskModel::TEST_FUNCTION, nullptr, {}, 0, state, false});
+                future = std::move(_futureTestStep);
+            }
+            _prefetchState = nullptr;
+            callJavaLogger(MAIN_THREAD, "[MAIN] test step prefetch hits: %d, misses: %d", _prefetchHits, _prefetchMisses);
 
-            _actionByGPT = _futureAction.get();           
+            TestStepAnswer answer = future.get();
+            _actionByGPT = _gptAgent.acceptTestStep(answer, state) ? answer.action : nullptr;
+            prefetchTestFunction(state);
         }
         else {
             _actionByGPT = nullptr;
@@ -673,13 +797,29 @@ namespace fastbotx {
         
     }
 
+    void AbstractAgent::prefetchTestFunction(const ReuseStatePtr& state)
+    {
+        if (!_actionByGPT || !state || _executedSteps >= 5) {
+            return;
+        }
+        ReuseStatePtr predicted = state->predictNextState(_actionByGPT);
+        if (!predicted) {
+            return;
+        }
+        callJavaLogger(MAIN_THREAD, "[MAIN] prefetch next test step for predicted R%d", predicted->getIdi());
+        resetFuture();
+        GPTFunctionAnalysis({AskModel::TEST_FUNCTION, nullptr, {}, 0, predicted, false});
+        _prefetchFuture = std::move(_futureTestStep);
+        _prefetchState = predicted;
+    }
+
     void AbstractAgent::resetFuture()
     {
-        PromiseIntPtr promInt = std::make_shared<std::promise<int>>();
-        _futureInt = promInt->get_future();
-        PromiseActionPtr promAction = std::make_shared<std::promise<ActivityStateActionPtr>>();
-        _futureAction = promAction->get_future();
-        _gptAgent.resetPromise(promInt, promAction);
+        PromiseGuidePtr promGuide = std::make_shared<std::promise<GuideAnswer>>();
+        _futureGuide = promGuide->get_future();
+        PromiseTestStepPtr promTestStep = std::make_shared<std::promise<TestStepAnswer>>();
+        _futureTestStep = promTestStep->get_future();
+        _gptAgent.resetPromise(promGuide, promTestStep);
     }
 
     double AbstractAgent::getCodeCoverage() {
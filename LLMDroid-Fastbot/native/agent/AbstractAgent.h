@@ -60,6 +60,9 @@ namespace fastbotx {
 
         void GPTFunctionAnalysis(QuestionPayload state);
 
+        /// connect to the model endpoints in the background, @see GPTAgent::warmUp
+        void warmUpModel() { _gptAgent.warmUp(); }
+
         // override
         void onAddNode(StatePtr node) override;
 
@@ -69,6 +72,9 @@ namespace fastbotx {
 
         virtual AlgorithmType getAlgorithmType() { return this->_algorithmType; }
 
+        /// the generator used by every random pick of this agent
+        RandomGenerator &getRandom() const { return this->_random; }
+
     protected:
 
         //AbstractAgent();
@@ -94,8 +100,23 @@ namespace fastbotx {
         
         void checkShouldWait();
 
+        /**
+         * @brief Enter GUIDANCE mode and ask for a guide target without blocking.
+         * The agent keeps exploring with its own policy until the answer lands, see pollGuidance.
+         */
         void prepareForNavigation();
 
+        /**
+         * @brief Called every step in GUIDANCE mode.
+         * Push the GUIDE question once the pending overviews are answered (or DrainTimeout passed),
+         * then switch to NAVIGATE when the answer is ready, or give up after GuideTimeout.
+         */
+        void pollGuidance();
+
+        void onGuideAnswered(const GuideAnswer& answer);
+
+        void abandonGuidance();
+
         void onNavigationFailed();
 
         void onNavigationOver(bool success);
@@ -106,8 +127,18 @@ namespace fastbotx {
 
         void debugMergedStates();
 
+        /**
+         * @brief Get the action for the new state in TEST_FUNCTION mode.
+         * Uses the answer asked ahead by prefetchTestFunction if the new state is the predicted one.
+         */
         void prepareTestFunction();
 
+        /**
+         * @brief Ask for the next step against the state the chosen action led to last time,
+         * while the action is being performed.
+         */
+        void prefetchTestFunction(const ReuseStatePtr& state);
+
         void resetFuture();
 
         /**
@@ -121,16 +152,17 @@ namespace fastbotx {
         const double _minGrowthRate = 0.05;
         std::vector<double> _growthRateWindow;
         double _currentThreshold = 0.05;
+        double _lastCodeCoverage = 0; // read at the last step, for the payoff of consultations
         bool _useCodeCoverage = false;
         CodeCoverageMonitor _codeCoverageMonitor;
 
         GraphPtr _graph;
         MergedStateGraphPtr _mergedStateGraph; //= std::make_shared<MergedStateGraph>();
         
-        PromiseIntPtr _promiseInt = std::make_shared<std::promise<int>>();
-        FutureInt _futureInt = _promiseInt->get_future();
-        PromiseActionPtr _promiseAction = std::make_shared<std::promise<ActivityStateActionPtr>>();
-        FutureAction _futureAction = _promiseAction->get_future();
+        PromiseGuidePtr _promiseGuide = std::make_shared<std::promise<GuideAnswer>>();
+        FutureGuide _futureGuide = _promiseGuide->get_future();
+        PromiseTestStepPtr _promiseTestStep = std::make_shared<std::promise<TestStepAnswer>>();
+        FutureTestStep _futureTestStep = _promiseTestStep->get_future();
 
         GPTAgent _gptAgent;
         
@@ -143,8 +175,15 @@ namespace fastbotx {
         Mode _currentMode = Mode::EXPLORE;
         bool _guideMode = false;
         bool _functionTestMode = false;
+        bool _guideRequested = false;
+        double _guidanceStartTime = 0; // when GUIDANCE mode was entered
+        double _guideRequestedTime = 0; // when the GUIDE question was pushed
         ActivityStateActionPtr _actionByGPT = nullptr;
         int _executedSteps = 0;
+        ReuseStatePtr _prefetchState = nullptr; // predicted state the prefetched answer is for
+        FutureTestStep _prefetchFuture;
+        int _prefetchHits = 0;
+        int _prefetchMisses = 0;
 
         const float _maxSimilarity = 0.6;
         float _currentSimilarityCheck = 0.6;
@@ -190,6 +229,9 @@ namespace fastbotx {
         int _currentStateBlockTimes;
 
         AlgorithmType _algorithmType;
+
+        // seeded from max.randomSeed if specified, so that the run can be replayed
+        mutable RandomGenerator _random;
     };
 
 
@@ -0,0 +1,76 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef ActionScoreTable_CPP_
+#define ActionScoreTable_CPP_
+
+#include "ActionScoreTable.h"
+
+namespace fastbotx {
+
+    void ActionScoreTable::clear() {
+        this->_actions.clear();
+        this->_flags.clear();
+        this->_newActivityProbability.clear();
+        this->_qValue.clear();
+        this->_priority.clear();
+    }
+
+    void ActionScoreTable::reserve(size_t size) {
+        this->_actions.reserve(size);
+        this->_flags.reserve(size);
+        this->_newActivityProbability.reserve(size);
+        this->_qValue.reserve(size);
+        this->_priority.reserve(size);
+    }
+
+    void ActionScoreTable::append(const ActivityStateActionPtr &action, bool inReuseModel,
+                                  float newActivityProbability) {
+        uint8_t flags = 0;
+        if (action->isVisited())
+            flags |= Visited;
+        if (inReuseModel)
+            flags |= InReuseModel;
+        if (action->getEnabled())
+            flags |= Enabled;
+        if (action->isValid())
+            flags |= Valid;
+        if (action->isModelAct())
+            flags |= ModelAct;
+        if (action->requireTarget())
+            flags |= RequireTarget;
+        if (action->isBack())
+            flags |= Back;
+        this->_actions.emplace_back(action);
+        this->_flags.emplace_back(flags);
+        this->_newActivityProbability.emplace_back(newActivityProbability);
+        this->_qValue.emplace_back(static_cast<float>(action->getQValue()));
+        this->_priority.emplace_back(action->getPriority());
+    }
+
+    int ActionScoreTable::totalPriority(uint8_t required, uint8_t excluded) const {
+        int total = 0;
+        for (size_t row = 0; row < this->_flags.size(); row++) {
+            if (matches(row, required, excluded))
+                total += this->_priority[row];
+        }
+        return total;
+    }
+
+    int ActionScoreTable::pickByPriority(uint8_t required, uint8_t excluded, int index) const {
+        for (size_t row = 0; row < this->_flags.size(); row++) {
+            if (!matches(row, required, excluded))
+                continue;
+            if (index < this->_priority[row])
+                return (int) row;
+            index -= this->_priority[row];
+        }
+        return -1;
+    }
+
+}
+
+#endif
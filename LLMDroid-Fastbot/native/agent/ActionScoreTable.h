@@ -0,0 +1,73 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef ActionScoreTable_H_
+#define ActionScoreTable_H_
+
+#include "Action.h"
+#include <vector>
+#include <cstdint>
+
+namespace fastbotx {
+
+    /// Per step snapshot of every action of the new state, stored column by column.
+    /// It is filled in one pass over the actions, so that every action selection strategy
+    /// can scan plain arrays instead of probing the reuse model and the action objects again.
+    class ActionScoreTable {
+    public:
+        enum Flag : uint8_t {
+            Visited = 1 << 0,
+            InReuseModel = 1 << 1,
+            Enabled = 1 << 2,
+            Valid = 1 << 3,
+            ModelAct = 1 << 4,
+            RequireTarget = 1 << 5,
+            Back = 1 << 6,
+        };
+
+        void clear();
+
+        void reserve(size_t size);
+
+        /// append a row for the given action, flags other than InReuseModel are read from the action
+        void append(const ActivityStateActionPtr &action, bool inReuseModel,
+                    float newActivityProbability);
+
+        size_t size() const { return this->_actions.size(); }
+
+        bool empty() const { return this->_actions.empty(); }
+
+        const ActivityStateActionPtr &action(size_t row) const { return this->_actions[row]; }
+
+        /// true if all bits of required are set and no bit of excluded is set in the row
+        bool matches(size_t row, uint8_t required, uint8_t excluded = 0) const {
+            uint8_t flags = this->_flags[row];
+            return (flags & required) == required && (flags & excluded) == 0;
+        }
+
+        float newActivityProbability(size_t row) const { return this->_newActivityProbability[row]; }
+
+        float qValue(size_t row) const { return this->_qValue[row]; }
+
+        int priority(size_t row) const { return this->_priority[row]; }
+
+        /// sum of priorities of the matched rows
+        int totalPriority(uint8_t required, uint8_t excluded = 0) const;
+
+        /// walk the matched rows and return the one covering index in the priority sum, or -1
+        int pickByPriority(uint8_t required, uint8_t excluded, int index) const;
+
+    private:
+        std::vector<ActivityStateActionPtr> _actions;
+        std::vector<uint8_t> _flags;
+        std::vector<float> _newActivityProbability;
+        std::vector<float> _qValue;
+        std::vector<int> _priority;
+    };
+
+}
+
+#endif /* ActionScoreTable_H_ */
@@ -0,0 +1,151 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef ChatStreamReader_CPP_
+#define ChatStreamReader_CPP_
+
+#include "ChatStreamReader.h"
+#include <utility>
+
+namespace fastbotx {
+
+    ChatStreamReader::ChatStreamReader(DecisivePredicate decisive)
+            : _decisive(std::move(decisive)) {
+    }
+
+    std::function<bool(std::string, intptr_t)> ChatStreamReader::callback() {
+        return [this](std::string chunk, intptr_t) { return this->feed(chunk); };
+    }
+
+    bool ChatStreamReader::feed(const std::string &chunk) {
+        this->_lineBuffer += chunk;
+        size_t start = 0;
+        size_t end;
+        while ((end = this->_lineBuffer.find('\n', start)) != std::string::npos) {
+            size_t length = end - start;
+            if (length > 0 && this->_lineBuffer[end - 1] == '\r')
+                length--;
+            onLine(this->_lineBuffer.substr(start, length));
+            start = end + 1;
+        }
+        this->_lineBuffer.erase(0, start);
+        return !this->_decided;
+    }
+
+    void ChatStreamReader::finish() {
+        if (this->_lineBuffer.empty())
+            return;
+        std::string line;
+        line.swap(this->_lineBuffer);
+        if (line.back() == '\r')
+            line.pop_back();
+        onLine(line);
+    }
+
+    std::string ChatStreamReader::errorMessage() const {
+        nlohmann::json body = nlohmann::json::parse(this->_unframedBody, nullptr, false);
+        if (!body.is_discarded() && body.is_object() && body.contains("error")) {
+            const auto &error = body["error"];
+            if (error.is_string())
+                return error.get<std::string>();
+            if (error.is_object() && error.contains("message") && error["message"].is_string())
+                return error["message"].get<std::string>();
+        }
+        size_t end = this->_unframedBody.find_last_not_of(" \r\n\t");
+        return end == std::string::npos ? std::string() : this->_unframedBody.substr(0, end + 1);
+    }
+
+    void ChatStreamReader::onLine(const std::string &line) {
+        if (line.empty() || line[0] == ':')
+            return; // event separator or comment
+        if (line.compare(0, 5, "data:") != 0) {
+            this->_unframedBody += line;
+            this->_unframedBody += '\n';
+            return;
+        }
+        size_t begin = line.find_first_not_of(' ', 5);
+        if (begin == std::string::npos)
+            return;
+        if (line.compare(begin, std::string::npos, "[DONE]") == 0) {
+            this->_done = true;
+            return;
+        }
+        nlohmann::json event = nlohmann::json::parse(line.begin() + begin, line.end(), nullptr, false);
+        if (event.is_discarded())
+            return;
+        if (event.contains("usage") && event["usage"].is_object())
+            this->_usage = event["usage"];
+        if (!event.contains("choices") || !event["choices"].is_array() || event["choices"].empty())
+            return;
+        const auto &choice = event["choices"][0];
+        if (choice.contains("delta") && choice["delta"].contains("content") && choice["delta"]["content"].is_string()) {
+            this->_text += choice["delta"]["content"].get<std::string>();
+            scan();
+        }
+    }
+
+    void ChatStreamReader::scan() {
+        for (; this->_scanned < this->_text.size() && !this->_complete; this->_scanned++) {
+            char c = this->_text[this->_scanned];
+            if (this->_inString) {
+                if (this->_escape)
+                    this->_escape = false;
+                else if (c == '\\')
+                    this->_escape = true;
+                else if (c == '"')
+                    this->_inString = false;
+                continue;
+            }
+            // prose before the object may hold quotes, only track strings inside it
+            if (this->_depth == 0) {
+                if (c == '{') {
+                    this->_depth = 1;
+                    this->_memberStart = this->_scanned + 1;
+                }
+                continue;
+            }
+            switch (c) {
+                case '"':
+                    this->_inString = true;
+                    break;
+                case '{':
+                case '[':
+                    this->_depth++;
+                    break;
+                case '}':
+                case ']':
+                    this->_depth--;
+                    if (this->_depth == 0) {
+                        closeMember(this->_scanned);
+                        this->_complete = true;
+                    }
+                    break;
+                case ',':
+                    if (this->_depth == 1) {
+                        closeMember(this->_scanned);
+                        this->_memberStart = this->_scanned + 1;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (!this->_decided && this->_decisive && this->_decisive(this->_fields, this->_complete))
+            this->_decided = true;
+    }
+
+    void ChatStreamReader::closeMember(size_t end) {
+        std::string member = "{" + this->_text.substr(this->_memberStart, end - this->_memberStart) + "}";
+        nlohmann::ordered_json parsed = nlohmann::ordered_json::parse(member, nullptr, false);
+        if (parsed.is_discarded() || !parsed.is_object())
+            return;
+        for (auto it = parsed.begin(); it != parsed.end(); ++it)
+            this->_fields[it.key()] = it.value();
+    }
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef ChatStreamReader_H_
+#define ChatStreamReader_H_
+
+#include "../thirdpart/json/json.hpp"
+#include <functional>
+#include <string>
+
+namespace fastbotx {
+
+    /// Reads the server-sent events of a streaming chat completion.
+    /// The content deltas are appended to text(), and the top level members of the first json object
+    /// in it are parsed as soon as each of them is closed, so the caller can act on an answer
+    /// before the model finishes writing the rest of its reply.
+    class ChatStreamReader {
+    public:
+        /// fields: the members parsed so far, complete: the closing brace of the object has arrived
+        typedef std::function<bool(const nlohmann::ordered_json &fields, bool complete)> DecisivePredicate;
+
+        explicit ChatStreamReader(DecisivePredicate decisive = nullptr);
+
+        /// feed raw bytes from the transport, return false to stop the transfer once the answer is decided
+        bool feed(const std::string &chunk);
+
+        /// read what is left after the last line break once the transfer is over, a plain json body may end without one
+        void finish();
+
+        /// callback for liboai::ChatCompletion::create, which turns on streaming when it is given
+        std::function<bool(std::string, intptr_t)> callback();
+
+        const std::string &text() const { return this->_text; }
+
+        const nlohmann::ordered_json &fields() const { return this->_fields; }
+
+        const nlohmann::json &usage() const { return this->_usage; }
+
+        /// the body when the server answered with plain json instead of events, e.g. an error
+        const std::string &unframedBody() const { return this->_unframedBody; }
+
+        /// the message of the error in unframedBody, or the whole of it when it is not an error object
+        std::string errorMessage() const;
+
+        bool isDecided() const { return this->_decided; }
+
+        bool isComplete() const { return this->_complete; }
+
+        bool isDone() const { return this->_done; }
+
+    private:
+        DecisivePredicate _decisive;
+
+        std::string _lineBuffer;
+        std::string _unframedBody;
+        std::string _text;
+        nlohmann::ordered_json _fields = nlohmann::ordered_json::object();
+        nlohmann::json _usage;
+        bool _done = false;
+        bool _decided = false;
+
+        // scanner state over _text
+        size_t _scanned = 0;
+        int _depth = 0;
+        bool _inString = false;
+        bool _escape = false;
+        size_t _memberStart = 0;
+        bool _complete = false;
+
+        void onLine(const std::string &line);
+
+        void scan();
+
+        void closeMember(size_t end);
+    };
+
+}
+
+#endif /* ChatStreamReader_H_ */
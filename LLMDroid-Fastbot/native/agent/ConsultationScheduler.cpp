@@ -0,0 +1,177 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef ConsultationScheduler_CPP_
+#define ConsultationScheduler_CPP_
+
+#include "ConsultationScheduler.h"
+#include "Base.h"
+#include "utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace fastbotx {
+
+    void ConsultationScheduler::Rate::update(double coverageRate, double stateRate) {
+        // recent segments count most, the app changes as it is explored
+        const double alpha = 0.5;
+        this->coverage = this->known ? alpha * coverageRate + (1 - alpha) * this->coverage : coverageRate;
+        this->states = this->known ? alpha * stateRate + (1 - alpha) * this->states : stateRate;
+        this->known = true;
+    }
+
+    ConsultationScheduler::ConsultationScheduler(const Options &options)
+            : _options(options) {
+    }
+
+    void ConsultationScheduler::recordCost(int type, double latencySec, long tokens) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        TypeRecord &record = this->_types[type];
+        record.requests++;
+        record.latencySec += latencySec;
+        record.tokens += tokens;
+        this->_tokensSpent += tokens;
+    }
+
+    void ConsultationScheduler::recordSubject(int type, int mergedStateId) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_types[type].subjects.insert(mergedStateId);
+    }
+
+    bool ConsultationScheduler::budgetLeft(double share) const {
+        return this->_options.tokenBudget <= 0 ||
+               static_cast<double>(this->_tokensSpent) < share * static_cast<double>(this->_options.tokenBudget);
+    }
+
+    bool ConsultationScheduler::shouldConsult(double nowMs) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if (!budgetLeft(1.0)) {
+            BLOG("consultation: token budget %ld spent", this->_options.tokenBudget);
+            return false;
+        }
+        if (this->_consultations < this->_options.warmup || this->_lowYieldStreak == 0) {
+            return true;
+        }
+        double backoffSec = std::min(this->_options.maxBackoffSec,
+                                     this->_options.baseBackoffSec * std::pow(2.0, this->_lowYieldStreak - 1));
+        return (nowMs - this->_lastEndMs) / 1000.0 >= backoffSec;
+    }
+
+    void ConsultationScheduler::beginConsultation(double nowMs, double coverage, int mergedStates) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if (this->_segmentStartMs >= 0 && nowMs > this->_segmentStartMs) {
+            double seconds = (nowMs - this->_segmentStartMs) / 1000.0;
+            this->_exploreRate.update((coverage - this->_segmentCoverage) / seconds,
+                                      (mergedStates - this->_segmentStates) / seconds);
+        }
+        this->_consulting = true;
+        this->_segmentStartMs = nowMs;
+        this->_segmentCoverage = coverage;
+        this->_segmentStates = mergedStates;
+        this->_atBegin = this->_types;
+    }
+
+    void ConsultationScheduler::endConsultation(double nowMs, double coverage, int mergedStates,
+                                                int targetMergedStateId) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if (!this->_consulting) {
+            return;
+        }
+        this->_consulting = false;
+        double coverageGain = coverage - this->_segmentCoverage;
+        double stateGain = mergedStates - this->_segmentStates;
+        double seconds = std::max(1.0, (nowMs - this->_segmentStartMs) / 1000.0);
+        this->_consultRate.update(coverageGain / seconds, stateGain / seconds);
+        this->_consultations++;
+
+        // credit the types asked during the consultation and those that analysed its target
+        for (auto &it: this->_types) {
+            TypeRecord &record = it.second;
+            auto before = this->_atBegin.find(it.first);
+            bool asked = before == this->_atBegin.end() ? record.requests > 0
+                                                        : record.requests > before->second.requests;
+            if (asked || record.subjects.count(targetMergedStateId) > 0) {
+                record.coverageGain += coverageGain;
+                record.stateGain += stateGain;
+            }
+            if (record.requests > 0) {
+                record.samples++;
+            }
+        }
+
+        double margin = this->_options.yieldMargin;
+        bool paid = (this->_consultRate.coverage > 0 && this->_consultRate.coverage >= margin * this->_exploreRate.coverage) ||
+                    (this->_consultRate.states > 0 && this->_consultRate.states >= margin * this->_exploreRate.states);
+        this->_lowYieldStreak = paid ? 0 : this->_lowYieldStreak + 1;
+        BLOG("consultation %d: +%f coverage, +%d MergedStates in %f s, %s (coverage/s %f vs %f exploring)",
+             this->_consultations, coverageGain, static_cast<int>(stateGain), seconds, paid ? "paid off" : "low yield",
+             this->_consultRate.coverage, this->_exploreRate.coverage);
+
+        this->_segmentStartMs = nowMs;
+        this->_segmentCoverage = coverage;
+        this->_segmentStates = mergedStates;
+        this->_lastEndMs = nowMs;
+    }
+
+    bool ConsultationScheduler::allowOptional(int type) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if (!budgetLeft(this->_options.backgroundShare)) {
+            return false;
+        }
+        auto found = this->_types.find(type);
+        if (found == this->_types.end() || found->second.samples < this->_options.minSamples ||
+            found->second.tokens <= 0) {
+            return true;
+        }
+        // coverage if it has moved at all in this run, new MergedStates otherwise
+        double coverageGain = 0;
+        double stateGain = 0;
+        long tokens = 0;
+        for (const auto &it: this->_types) {
+            coverageGain += it.second.coverageGain;
+            stateGain += it.second.stateGain;
+            tokens += it.second.tokens;
+        }
+        const TypeRecord &record = found->second;
+        bool byCoverage = coverageGain > 0;
+        double yield = (byCoverage ? record.coverageGain : record.stateGain) / static_cast<double>(record.tokens);
+        double average = (byCoverage ? coverageGain : stateGain) / static_cast<double>(std::max(1L, tokens));
+        return yield >= this->_options.lowYieldFraction * average;
+    }
+
+    bool ConsultationScheduler::hasBackgroundBudget() {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        return budgetLeft(this->_options.backgroundShare);
+    }
+
+    std::string ConsultationScheduler::statistics() {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        std::stringstream ss;
+        ss << "tokens " << this->_tokensSpent;
+        if (this->_options.tokenBudget > 0) {
+            ss << "/" << this->_options.tokenBudget;
+        }
+        ss << "; ";
+        for (const auto &it: this->_types) {
+            const TypeRecord &record = it.second;
+            ss << "[type " << it.first << "] " << record.requests << " requests, " << record.latencySec << " s, "
+               << record.tokens << " tokens, +" << record.coverageGain << " coverage, +" << record.stateGain
+               << " MergedStates";
+            if (record.latencySec > 0) {
+                ss << ", " << record.coverageGain / record.latencySec << " coverage/s";
+            }
+            if (record.tokens > 0) {
+                ss << ", " << 1000 * record.coverageGain / static_cast<double>(record.tokens) << " coverage/ktoken";
+            }
+            ss << "; ";
+        }
+        return ss.str();
+    }
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef ConsultationScheduler_H_
+#define ConsultationScheduler_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace fastbotx {
+
+    /**
+     * @brief Decides from what the model has paid off so far whether it is worth asking.
+     *
+     * A consultation runs from the low growth rate trigger until the agent explores again: guide, navigation and
+     * function test. Its coverage and new MergedStates per second are compared with those of exploring alone
+     * since the previous one. While consultations gain less, the next one is put off, twice as long after each.
+     * The gain of a consultation is also credited to the background questions (overview, reanalysis) asked about
+     * its target, so a question type that rarely leads anywhere can be throttled.
+     * Costs are the latency and tokens of every request, question types are ids chosen by the caller.
+     * Thread safe: costs come from the workers, the rest from the main thread.
+     */
+    class ConsultationScheduler {
+    public:
+        struct Options {
+            long tokenBudget = 0; // tokens for the whole run, <= 0: unlimited
+            double backgroundShare = 0.5; // background questions stop once they'd take more of tokenBudget
+            int warmup = 2; // consultations measured before any is put off
+            double yieldMargin = 1.0; // a consultation pays off if it gains this times as fast as exploring
+            double baseBackoffSec = 60;
+            double maxBackoffSec = 600;
+            double lowYieldFraction = 0.25; // throttle a type gaining less per token than this share of the average
+            int minSamples = 3; // consultations after which a type may be throttled
+        };
+
+        explicit ConsultationScheduler(const Options &options);
+
+        /// a request of type has been answered, or has failed, after latencySec
+        void recordCost(int type, double latencySec, long tokens);
+
+        /// type has been asked about mergedStateId, it shares the gain of consultations targeting it
+        void recordSubject(int type, int mergedStateId);
+
+        /// the trigger fired, is a consultation worth it now
+        bool shouldConsult(double nowMs);
+
+        void beginConsultation(double nowMs, double coverage, int mergedStates);
+
+        /// @param targetMergedStateId the MergedState whose function was tested, -1 if none
+        void endConsultation(double nowMs, double coverage, int mergedStates, int targetMergedStateId);
+
+        /// whether a background question of a type that can be skipped may be asked
+        bool allowOptional(int type);
+
+        /// whether any background question may be asked
+        bool hasBackgroundBudget();
+
+        std::string statistics();
+
+    private:
+        struct TypeRecord {
+            int requests = 0;
+            double latencySec = 0;
+            long tokens = 0;
+            double coverageGain = 0;
+            double stateGain = 0;
+            int samples = 0; // consultations ended since the first request
+            std::set<int> subjects;
+        };
+
+        struct Rate {
+            double coverage = 0; // per second
+            double states = 0;
+            bool known = false;
+
+            void update(double coverageRate, double stateRate);
+        };
+
+        Options _options;
+        std::mutex _mutex;
+        std::map<int, TypeRecord> _types;
+        long _tokensSpent = 0;
+
+        // main thread
+        bool _consulting = false;
+        double _segmentStartMs = -1; // when the current exploration or consultation began, -1 before the first step
+        double _segmentCoverage = 0;
+        int _segmentStates = 0;
+        std::map<int, TypeRecord> _atBegin; // costs when the consultation began
+        Rate _exploreRate;
+        Rate _consultRate;
+        int _consultations = 0;
+        int _lowYieldStreak = 0;
+        double _lastEndMs = 0;
+
+        bool budgetLeft(double share) const;
+    };
+
+    typedef std::shared_ptr<ConsultationScheduler> ConsultationSchedulerPtr;
+
+}
+
+#endif /* ConsultationScheduler_H_ */
@@ -9,18 +9,102 @@
 #include <unordered_map>
 #include <utility>
 #include <iomanip>
+#include <cctype>
 
 using json = nlohmann::json;
 
 namespace fastbotx {
 
-    GPTAgent::GPTAgent(MergedStateGraphPtr& graph, PromiseIntPtr prom):
+    namespace {
+
+        /// the fields a question's answer is acted on, the rest of the reply is not waited for
+        ChatStreamReader::DecisivePredicate decisiveFieldsOf(AskModel type)
+        {
+            switch (type) {
+                case AskModel::GUIDE:
+                    return [](const nlohmann::ordered_json& fields, bool) {
+                        return fields.contains("Target State") && fields["Target State"].is_string() &&
+                               fields.contains("Target Function") && fields["Target Function"].is_string();
+                    };
+                case AskModel::TEST_FUNCTION:
+                    return [](const nlohmann::ordered_json& fields, bool) {
+                        if (!fields.contains("Element Id") || !fields["Element Id"].is_number_integer() ||
+                            !fields.contains("Action Type") || !fields["Action Type"].is_number_integer()) {
+                            return false;
+                        }
+                        // input text (6) comes with the text to input
+                        return fields["Element Id"] == -1 || fields["Action Type"] != 6 ||
+                               (fields.contains("Input") && fields["Input"].is_string());
+                    };
+                default:
+                    // overviews and reanalysis use the whole object
+                    return [](const nlohmann::ordered_json& fields, bool complete) { return complete; };
+            }
+        }
+
+        /// AskModel of its name in config.json, e.g. "STATE_OVERVIEW", or of its id, -1 if unknown
+        int askModelFromName(const json& name)
+        {
+            static const std::vector<std::string> names = {"STATE_OVERVIEW", "GRAPH_OVERVIEW", "GUIDE",
+                                                           "TEST_FUNCTION", "GUIDE_FAILURE", "REANALYSIS"};
+            if (name.is_number_integer()) {
+                int id = name.get<int>();
+                return id >= 0 && id < static_cast<int>(names.size()) ? id : -1;
+            }
+            if (!name.is_string()) {
+                return -1;
+            }
+            auto found = std::find(names.begin(), names.end(), name.get<std::string>());
+            return found == names.end() ? -1 : static_cast<int>(found - names.begin());
+        }
+
+        bool isOverview(const nlohmann::ordered_json& answer)
+        {
+            return answer.is_object() && answer.contains("Overview") && answer["Overview"].is_string() &&
+                   answer.contains("Function List") && answer["Function List"].is_object();
+        }
+
+        /// a repaired answer that lost these to truncation can't be acted on
+        bool hasRequiredFields(AskModel type, const nlohmann::ordered_json& answer)
+        {
+            switch (type) {
+                case AskModel::STATE_OVERVIEW:
+                    // a batch is checked page by page, a page cut off is asked again alone
+                    return isOverview(answer) || (answer.contains("States") && answer["States"].is_object());
+                case AskModel::GUIDE:
+                    return answer.contains("Target State") && answer["Target State"].is_string() &&
+                           answer.contains("Target Function") && answer["Target Function"].is_string();
+                case AskModel::TEST_FUNCTION:
+                    return answer.contains("Element Id") && answer["Element Id"].is_number_integer() &&
+                           answer.contains("Action Type") && answer["Action Type"].is_number_integer() &&
+                           (!answer.contains("Input") || answer["Input"].is_string());
+                default:
+                    return true;
+            }
+        }
+
+        /// the id in a State name of the prompts, e.g. "State12", -1 if it isn't one
+        int mergedStateIdOf(const std::string& name)
+        {
+            static const std::string prefix = "State";
+            // up to 9 digits always fit an int
+            if (name.size() <= prefix.size() || name.size() > prefix.size() + 9 ||
+                name.compare(0, prefix.size(), prefix) != 0 ||
+                name.find_first_not_of("0123456789", prefix.size()) != std::string::npos) {
+                return -1;
+            }
+            return std::stoi(name.substr(prefix.size()));
+        }
+
+    }
+
+    GPTAgent::GPTAgent(MergedStateGraphPtr& graph, PromiseGuidePtr prom):
     _file("/sdcard/gpt.txt", std::ios::out | std::ios::trunc),
     _interactionFile("/sdcard/LLM-Interaction-Fastbot.txt", std::ios::out | std::ios::trunc),
     _questionRemained(0)
     {
         _mergedStateGraph = graph;
-        _promiseInt = std::move(prom);
+        _promiseGuide = std::move(prom);
         // read from json
         std::ifstream file("/sdcard/faruzan/config.json");
         // Check if the file is opened successfully
@@ -41,12 +125,125 @@ namespace fastbotx {
                 _model_str = config["Model"];
                 callJavaLogger(MAIN_THREAD, "Set model_str to %s", _model_str.c_str());
             }
+            std::string baseUrl;
             if (config.contains("BaseUrl")) {
-                _gpt.ChatCompletion->set_base_url(config["BaseUrl"]);
-                callJavaLogger(MAIN_THREAD, "Set base_url to %s", config["BaseUrl"].get<std::string>().c_str());
+                baseUrl = config["BaseUrl"];
+                callJavaLogger(MAIN_THREAD, "Set base_url to %s", baseUrl.c_str());
+            }
+            RetryPolicy::Options retryOptions;
+            retryOptions.maxAttempts = config.value("RetryAttempts", retryOptions.maxAttempts);
+            retryOptions.baseDelayMs = config.value("RetryBaseDelay", retryOptions.baseDelayMs);
+            retryOptions.maxDelayMs = config.value("RetryMaxDelay", retryOptions.maxDelayMs);
+            retryOptions.breakerThreshold = config.value("BreakerThreshold", retryOptions.breakerThreshold);
+            retryOptions.breakerCooldownMs = config.value("BreakerCooldown", retryOptions.breakerCooldownMs);
+            retryOptions.hedgePercentile = config.value("HedgePercentile", retryOptions.hedgePercentile);
+            _hedge = config.value("Hedge", false);
+            callJavaLogger(MAIN_THREAD,
+                           "Retry %d times, circuit of an endpoint opens after %d failures for %ld ms, hedge: %d",
+                           retryOptions.maxAttempts, retryOptions.breakerThreshold, retryOptions.breakerCooldownMs, _hedge);
+            // the endpoint of Model and BaseUrl comes first, it answers whatever no route matches
+            _router = std::make_shared<ModelRouter>();
+            _router->addEndpoint("default", _model_str, baseUrl, "", retryOptions);
+            if (config.contains("Endpoints")) {
+                for (const auto& endpoint : config["Endpoints"]) {
+                    std::string name = endpoint["Name"];
+                    _router->addEndpoint(name, endpoint.value("Model", _model_str), endpoint.value("BaseUrl", baseUrl),
+                                         endpoint.value("ApiKey", std::string()), retryOptions);
+                    callJavaLogger(MAIN_THREAD, "Add endpoint %s: %s", name.c_str(),
+                                   endpoint.value("Model", _model_str).c_str());
+                }
+            }
+            if (config.contains("Routes")) {
+                for (const auto& route : config["Routes"]) {
+                    ModelRouter::Route parsed;
+                    for (const auto& type : route.value("Types", json::array())) {
+                        int id = askModelFromName(type);
+                        if (id < 0) {
+                            callJavaLogger(MAIN_THREAD, "Unknown question type %s in Routes", type.dump().c_str());
+                            continue;
+                        }
+                        parsed.types.insert(id);
+                    }
+                    parsed.maxPromptTokens = route.value("MaxPromptTokens", parsed.maxPromptTokens);
+                    parsed.maxFailureRate = route.value("MaxFailureRate", parsed.maxFailureRate);
+                    for (const auto& name : route.value("Cascade", json::array())) {
+                        int index = _router->findEndpoint(name);
+                        if (index < 0) {
+                            callJavaLogger(MAIN_THREAD, "Unknown endpoint %s in Routes", name.dump().c_str());
+                            continue;
+                        }
+                        parsed.cascade.push_back(index);
+                    }
+                    _router->addRoute(parsed);
+                    callJavaLogger(MAIN_THREAD, "Add route: %s", route.dump().c_str());
+                }
+            }
+            if (config.contains("WarmUp")) {
+                _warmUp = config["WarmUp"].get<bool>();
+                callJavaLogger(MAIN_THREAD, "Set warm up to %d", _warmUp);
+            }
+            if (config.contains("WarmUpChat")) {
+                _warmUpChat = config["WarmUpChat"].get<bool>();
+                callJavaLogger(MAIN_THREAD, "Set warm up chat to %d", _warmUpChat);
+            }
+            if (config.contains("Stream")) {
+                _stream = config["Stream"].get<bool>();
+                callJavaLogger(MAIN_THREAD, "Set stream to %d", _stream);
+            }
+            if (config.contains("MaxInFlight")) {
+                _maxInFlight = std::max(1, config["MaxInFlight"].get<int>());
+                callJavaLogger(MAIN_THREAD, "Set max in flight questions to %d", _maxInFlight);
+            }
+            if (config.contains("DrainTimeout")) {
+                _drainTimeoutMs = config["DrainTimeout"].get<int>();
+                callJavaLogger(MAIN_THREAD, "Set queue drain timeout to %d ms", _drainTimeoutMs);
+            }
+            if (config.contains("GuideTimeout")) {
+                _guideTimeoutMs = config["GuideTimeout"].get<int>();
+                callJavaLogger(MAIN_THREAD, "Set guide timeout to %d ms", _guideTimeoutMs);
+            }
+            if (config.contains("MaxJsonFixes")) {
+                _maxJsonFixes = std::max(0, config["MaxJsonFixes"].get<int>());
+                callJavaLogger(MAIN_THREAD, "Set max json fixes to %d", _maxJsonFixes);
+            }
+            if (config.contains("DescriptionTokens")) {
+                _descriptionTokens = std::max(100, config["DescriptionTokens"].get<int>());
+                callJavaLogger(MAIN_THREAD, "Set description token budget to %zu", _descriptionTokens);
+            }
+            if (config.contains("OverviewBatchTokens")) {
+                _overviewBatchTokens = std::max(0, config["OverviewBatchTokens"].get<int>());
+                callJavaLogger(MAIN_THREAD, "Set overview batch token budget to %zu", _overviewBatchTokens);
+            }
+            if (config.contains("TestHistoryTurns")) {
+                _testHistoryTurns = config["TestHistoryTurns"].get<int>();
+                callJavaLogger(MAIN_THREAD, "Set test history turns to %d", _testHistoryTurns);
+            }
+            ConsultationScheduler::Options consultOptions;
+            consultOptions.tokenBudget = config.value("ConsultTokenBudget", consultOptions.tokenBudget);
+            consultOptions.backgroundShare = config.value("ConsultBackgroundShare", consultOptions.backgroundShare);
+            consultOptions.warmup = config.value("ConsultWarmup", consultOptions.warmup);
+            consultOptions.yieldMargin = config.value("ConsultYieldMargin", consultOptions.yieldMargin);
+            consultOptions.baseBackoffSec = config.value("ConsultBackoff", consultOptions.baseBackoffSec);
+            consultOptions.maxBackoffSec = config.value("ConsultMaxBackoff", consultOptions.maxBackoffSec);
+            consultOptions.lowYieldFraction = config.value("ConsultLowYield", consultOptions.lowYieldFraction);
+            _scheduler = std::make_shared<ConsultationScheduler>(consultOptions);
+            callJavaLogger(MAIN_THREAD, "Consultation token budget %ld, warm up %d, back off %f-%f s",
+                           consultOptions.tokenBudget, consultOptions.warmup, consultOptions.baseBackoffSec,
+                           consultOptions.maxBackoffSec);
+            if (config.value("EnableCache", true)) {
+                std::string cacheDir = config.value("CacheDir", std::string(LLM_CACHE_DIR));
+                size_t maxEntries = config.value("CacheMaxEntries", (size_t) LLM_CACHE_MAX_ENTRIES);
+                size_t maxBytes = config.value("CacheMaxBytes", (size_t) LLM_CACHE_MAX_BYTES);
+                _responseCache = std::make_shared<LLMResponseCache>(cacheDir, maxEntries, maxBytes);
+                if (!_responseCache->isAvailable()) {
+                    _responseCache = nullptr;
+                }
+                callJavaLogger(MAIN_THREAD, "LLM response cache: %s, %zu entries", cacheDir.c_str(),
+                               _responseCache ? _responseCache->size() : 0);
             }
             if (!appName.empty() && !description.empty()) {
                 _startPrompt = "I'm now testing an app called " + appName + " on Android.\n" + description + "\n";
+                _promptBuilder = std::make_shared<PromptBuilder>(_startPrompt);
                 _apiKey = apiKey;
                 callJavaLogger(MAIN_THREAD, "App:%s\nDesc: %s\nkey: %s", appName.c_str(), description.c_str(), _apiKey.c_str());
             }
@@ -77,69 +274,153 @@ namespace fastbotx {
     bool GPTAgent::init()
     {
         _gpt.auth.SetMaxTimeout(300000);
-        callJavaLogger(MAIN_THREAD, "Start child thread!!!");
-        std::thread child(&GPTAgent::pageAnalysisLoop, this);
-        child.detach();
+        // the authorization is shared by all workers, so it is only written before they start
+        if (!_gpt.auth.SetKey(_apiKey)) {
+            callJavaLogger(MAIN_THREAD, "!!!Set key failed!!!");
+            exit(0);
+        }
+        callJavaLogger(MAIN_THREAD, "Start %d child threads!!!", _maxInFlight);
+        for (int i = 0; i < _maxInFlight; i++) {
+            std::thread child(&GPTAgent::pageAnalysisLoop, this);
+            child.detach();
+        }
         return true;
     }
 
+    void GPTAgent::warmUp()
+    {
+        if (!_warmUp) {
+            return;
+        }
+        // sent without blocking, the answers come back on the liboai I/O thread
+        liboai::Conversation conversation;
+        conversation.AddUserData("Reply with OK.");
+        double beginStamp = currentStamp();
+        for (size_t i = 0; i < _router->endpointCount(); i++) {
+            const ModelEndpoint& endpoint = _router->endpoint(static_cast<int>(i));
+            std::string name = endpoint.name + " (" + endpoint.model + ")";
+            bool chat = _warmUpChat;
+            auto onDone = [name, beginStamp, chat](liboai::Response, std::exception_ptr error) {
+                if (!error) {
+                    callJavaLogger(CHILD_THREAD, "[THREAD]Endpoint %s is ready after %f s", name.c_str(),
+                                   (currentStamp() - beginStamp) / 1000.0);
+                    return;
+                }
+                try {
+                    std::rethrow_exception(error);
+                }
+                catch (const std::exception& e) {
+                    callJavaLogger(CHILD_THREAD, "[ERROR]: endpoint %s can't be used, check its BaseUrl%s in config.json: %s",
+                                   name.c_str(), chat ? ", ApiKey and Model" : " and ApiKey", e.what());
+                }
+            };
+            try {
+                if (chat) {
+                    endpoint.chat->create_async(endpoint.model, conversation, onDone, 0.0, std::nullopt, 1);
+                }
+                else {
+                    endpoint.chat->list_models_async(onDone);
+                }
+            }
+            catch (const std::exception& e) {
+                callJavaLogger(MAIN_THREAD, "[ERROR]: can't warm up endpoint %s: %s", name.c_str(), e.what());
+            }
+        }
+    }
+
     void GPTAgent::pushStateToQueue(QuestionPayload payload)
     {
+        payload.promiseGuide = _promiseGuide;
+        payload.promiseTestStep = _promiseTestStep;
+        std::unique_lock<std::mutex> questionCountLock(_questionMtx);
+        // Protect access to queues using mutex locks
+        std::unique_lock<std::mutex> lock(_mtx);
+        payload.generation = _testStepGeneration;
         if (payload.type == AskModel::REANALYSIS) {
             // need to protect _topValuedMergedState
-            std::unique_lock<std::mutex> lock(_mtx); 
             int targetId = payload.from->getId();
             auto end = _topValuedMergedState->begin() + std::min(_P2 + 1ul, _topValuedMergedState->size());
             auto found = std::find_if(_topValuedMergedState->begin(), end,
                                       [targetId](MergedStatePtr& ms){
                                           return targetId == ms->getId();
                                       });
-            if (found != end) {
-                // std::lock_guard<std::mutex> lock(_mtx);
-                std::unique_lock<std::mutex> questionCountLock(_questionMtx);
-                _questionRemained++;
-
-                this->_lowQueue.push(payload);
-                callJavaLogger(MAIN_THREAD, "[MAIN] push M%d to low priority queue, remains: %d", payload.from->getId(), _lowQueue.size());
-                lock.unlock();
-                _cv.notify_one();
+            if (found == end) {
+                return;
             }
         }
+        if (coalesceQuestion(payload)) {
+            return;
+        }
+        _questionRemained++;
+        if (payload.type == AskModel::REANALYSIS) {
+            this->_lowQueue.push_back(payload);
+            callJavaLogger(MAIN_THREAD, "[MAIN] push M%d to low priority queue, remains: %d", payload.from->getId(), _lowQueue.size());
+        }
         else {
-            {
-                std::unique_lock<std::mutex> questionCountLock(_questionMtx);
-                _questionRemained++;
-                // Protect access to queues using mutex locks
-                std::lock_guard<std::mutex> lock(_mtx);
-                this->_stateQueue.push(payload);
-                std::stringstream ss;
-                if (payload.from) { ss << "from: MergedState" << payload.from->getId();}
-                callJavaLogger(MAIN_THREAD, "[MAIN] push {%s} to high priority queue, remains: %d", ss.str().c_str(), _stateQueue.size());
-            }
-            _cv.notify_one();
+            this->_stateQueue.push_back(payload);
+            std::stringstream ss;
+            if (payload.from) { ss << "from: MergedState" << payload.from->getId();}
+            callJavaLogger(MAIN_THREAD, "[MAIN] push {%s} to high priority queue, remains: %d", ss.str().c_str(), _stateQueue.size());
         }
+        lock.unlock();
+        questionCountLock.unlock();
+        _cv.notify_one();
     }
 
-    void GPTAgent::waitUntilQueueEmpty()
+    bool GPTAgent::coalesceQuestion(const QuestionPayload& payload)
     {
-        callJavaLogger(MAIN_THREAD, "[MAIN] wait until queue is empty");
-        int questionRemained = 0;
-        while(true)
-        {
-            std::unique_lock<std::mutex> questionCountLock(_questionMtx);
-            questionRemained = _questionRemained;//_questionRemained.load();
-            questionCountLock.unlock();
-
-            if (questionRemained == 0) {
-                callJavaLogger(MAIN_THREAD, "[MAIN] question all done");
-                break;
-            }
-            else {
-                callJavaLogger(MAIN_THREAD, "[MAIN] question remains: %d, sleep 3 seconds", questionRemained);
-                std::this_thread::sleep_for(std::chrono::seconds(3));
+        if (!payload.from || (payload.type != AskModel::STATE_OVERVIEW && payload.type != AskModel::REANALYSIS)) {
+            return false;
+        }
+        int targetId = payload.from->getId();
+        auto about = [targetId](const QuestionPayload& p, AskModel type) {
+            return p.type == type && p.from && p.from->getId() == targetId;
+        };
+        for (auto queue: {&_stateQueue, &_lowQueue}) {
+            auto found = std::find_if(queue->begin(), queue->end(), [&](const QuestionPayload& p) {
+                return about(p, payload.type) || about(p, AskModel::STATE_OVERVIEW);
+            });
+            if (found != queue->end()) {
+                _coalescedQuestions++;
+                callJavaLogger(MAIN_THREAD, "[MAIN] M%d is queued already, coalesced questions: %d", targetId,
+                               _coalescedQuestions);
+                return true;
             }
         }
-        
+        if (payload.type == AskModel::STATE_OVERVIEW) {
+            size_t before = _lowQueue.size();
+            _lowQueue.erase(std::remove_if(_lowQueue.begin(), _lowQueue.end(), [&](const QuestionPayload& p) {
+                return about(p, AskModel::REANALYSIS);
+            }), _lowQueue.end());
+            int removed = static_cast<int>(before - _lowQueue.size());
+            _questionRemained -= removed;
+            _coalescedQuestions += removed;
+        }
+        return false;
+    }
+
+    bool GPTAgent::isAnswered(const QuestionPayload& payload)
+    {
+        if (!payload.from) {
+            return false;
+        }
+        switch (payload.type) {
+            case AskModel::STATE_OVERVIEW:
+                return payload.from->hasOverview() &&
+                       std::all_of(payload.batch.begin(), payload.batch.end(), [](const MergedStatePtr& ms) {
+                           return ms->hasOverview();
+                       });
+            case AskModel::REANALYSIS:
+                return !payload.from->needReanalysed();
+            default:
+                return false;
+        }
+    }
+
+    bool GPTAgent::isQueueEmpty()
+    {
+        std::lock_guard<std::mutex> questionCountLock(_questionMtx);
+        return _questionRemained == 0;
     }
 
     void GPTAgent::pageAnalysisLoop()
@@ -150,60 +431,109 @@ namespace fastbotx {
             QuestionPayload payload;
             {
                 std::unique_lock<std::mutex> lock(_mtx);
-                if (_cv.wait_for(lock, std::chrono::seconds(1), [this]() { return !_stateQueue.empty() || !_lowQueue.empty(); })) {
-                    if (!_stateQueue.empty()) {
-                        payload = _stateQueue.front();
-                        _stateQueue.pop();
-                        callJavaLogger(CHILD_THREAD, "[THREAD]pop one payload from high priority queue, remains: %d", _stateQueue.size());
-                    }
-                    else if (!_lowQueue.empty()) {
-                        payload = _lowQueue.front();
-                        _lowQueue.pop();
-                        callJavaLogger(CHILD_THREAD, "[THREAD]pop one payload from low priority queue, remains: %d", _lowQueue.size());
-                    }
-                }
-                else {
-                    continue; // No payload available, retry
-                }
+                // woken by pushStateToQueue, or by a worker releasing a MergedState
+                _cv.wait(lock, [this, &payload]() { return takePayload(payload); });
             } // Lock is automatically released here
             
-            switch(payload.type)
-            {
-                case AskModel::STATE_OVERVIEW:
-                {
-                    askForStateOverview(payload);
-                    break;
-                }
-                case AskModel::GUIDE:
-                {
-                    askForGuiding(payload);
-                    break;
-                }
-                case AskModel::TEST_FUNCTION:
-                {
-                    askForTestFunction(payload);
-                    break;
-                }
-                case AskModel::REANALYSIS:
+            if (isAnswered(payload)) {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _skippedQuestions++;
+                callJavaLogger(CHILD_THREAD, "[THREAD]answer about MergedState%d is known, skip it, skipped questions: %d",
+                               payload.from->getId(), _skippedQuestions);
+            }
+            else {
+                switch(payload.type)
                 {
-                    askForReanalysis(payload);
-                    break;
-                }
-                default: {
-                    break;
+                    case AskModel::STATE_OVERVIEW:
+                    {
+                        askForStateOverview(payload);
+                        break;
+                    }
+                    case AskModel::GUIDE:
+                    {
+                        askForGuiding(payload);
+                        break;
+                    }
+                    case AskModel::TEST_FUNCTION:
+                    {
+                        askForTestFunction(payload);
+                        break;
+                    }
+                    case AskModel::REANALYSIS:
+                    {
+                        askForReanalysis(payload);
+                        break;
+                    }
+                    default: {
+                        break;
+                    }
+                }// end switch
+            }
+
+            if (payload.from) {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _busyMergedStates.erase(payload.from->getId());
+                for (const auto& mergedState: payload.batch) {
+                    _busyMergedStates.erase(mergedState->getId());
                 }
-            }// end switch
+            }
+            // questions about the same MergedState may be waiting for this one
+            _cv.notify_all();
 
             //_questionRemained.fetch_sub(1);
             //std::unique_lock<std::mutex> questionCountLock2(_questionMtx);
             std::unique_lock<std::mutex> questionCountLock(_questionMtx);
-            _questionRemained--;
-            //questionCountLock2.unlock();
+            _questionRemained -= 1 + static_cast<int>(payload.batch.size());
         }        
     }
 
+    bool GPTAgent::takePayload(QuestionPayload& payload)
+    {
+        auto dispatchable = [this](const QuestionPayload& p) {
+            return !p.from || _busyMergedStates.count(p.from->getId()) == 0;
+        };
+        auto blocking = [](const QuestionPayload& p) {
+            return p.type == AskModel::GUIDE || p.type == AskModel::TEST_FUNCTION;
+        };
+        auto found = std::find_if(_stateQueue.begin(), _stateQueue.end(), blocking);
+        std::deque<QuestionPayload>* queue = &_stateQueue;
+        if (found == _stateQueue.end()) {
+            found = std::find_if(_stateQueue.begin(), _stateQueue.end(), dispatchable);
+        }
+        if (found == _stateQueue.end()) {
+            queue = &_lowQueue;
+            found = std::find_if(_lowQueue.begin(), _lowQueue.end(), dispatchable);
+            if (found == _lowQueue.end()) {
+                return false;
+            }
+        }
+        payload = std::move(*found);
+        queue->erase(found);
+        if (payload.from) {
+            _busyMergedStates.insert(payload.from->getId());
+        }
+        // overviews waiting behind this one share its prompt, every description is within _descriptionTokens
+        size_t capacity = _overviewBatchTokens / std::max<size_t>(1, _descriptionTokens);
+        if (payload.type == AskModel::STATE_OVERVIEW && payload.from) {
+            for (auto it = _stateQueue.begin(); it != _stateQueue.end() && payload.batch.size() + 1 < capacity; ) {
+                if (it->type == AskModel::STATE_OVERVIEW && it->from && dispatchable(*it)) {
+                    _busyMergedStates.insert(it->from->getId());
+                    payload.batch.push_back(it->from);
+                    it = _stateQueue.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+        callJavaLogger(CHILD_THREAD, "[THREAD]pop one payload from %s priority queue, remains: %d",
+                       queue == &_stateQueue ? "high" : "low", queue->size());
+        return true;
+    }
+
     void GPTAgent::saveToFile(const std::string& prompt, const std::string& response)
     {
+        std::lock_guard<std::mutex> lock(_logMtx);
         if (_file.is_open()) {
             _file << "---------------------------------------" << std::endl;
             _file << "Prompt:\n" << prompt << std::endl;
@@ -215,6 +545,7 @@ namespace fastbotx {
 
     void GPTAgent::saveToFile(const std::string& value, int type)
     {
+        std::lock_guard<std::mutex> lock(_logMtx);
         if (_file.is_open()) {
             _file << "---------------------------------------" << std::endl;
             if (type == 0) {
@@ -231,107 +562,164 @@ namespace fastbotx {
 
     void GPTAgent::askForStateOverview(QuestionPayload& payload)
     {
-        std::unique_lock<std::mutex> lock(_mtx);
-        
         if (!payload.from) 
         {
             callJavaLogger(CHILD_THREAD, "[THREAD] payload.from is null, skip");
             return;
         }
-        callJavaLogger(CHILD_THREAD, "[THREAD] ask for MergedState's overview and funtion list");
+        // the pages of a batch answered meanwhile are left out
+        MergedStateVec targets;
+        for (const auto& mergedState: payload.batch) {
+            if (!mergedState->hasOverview()) {
+                targets.push_back(mergedState);
+            }
+        }
+        if (!payload.from->hasOverview()) {
+            targets.insert(targets.begin(), payload.from);
+        }
+        if (targets.empty()) {
+            return;
+        }
+        for (const auto& target: targets) {
+            _scheduler->recordSubject(static_cast<int>(AskModel::STATE_OVERVIEW), target->getId());
+        }
+        bool batched = targets.size() > 1;
+        callJavaLogger(CHILD_THREAD, "[THREAD] ask for overview and funtion list of %zu MergedStates", targets.size());
 
         std::stringstream promptstream;
-        promptstream << _startPrompt << _functionExplanationPrompt << _inputExplanationPrompt_state;
         // If a new state has been added to the merged state here, it will be asked along with the new one.
-        promptstream << "\n```HTML Description\n";
-        std::string stateDesc = payload.from->stateDescription();
-        if (stateDesc.length() > 7000) {
-            stateDesc = safe_utf8_substr(stateDesc, 0, 7000);
-        }
-        promptstream << stateDesc << "```\n";
-
-        if (_topValuedMergedState->size() >= 5) {
-            // ask gpt to maintain the M list
-            promptstream << _requiredOutputPrompt_state3;
-            // M list
-            nlohmann::ordered_json top5;
-            int count = 0;
-            for (auto it = _topValuedMergedState->begin(); it < _topValuedMergedState->end() && count < 5; ++it) {
-                // M: overview, top 5 function to json
-                if ((*it)->hasUntestedFunctions()) {
-                    (*it)->writeOverviewAndTop5Tojson(top5);
-                    count++;
-                }
+        for (const auto& target: targets) {
+            promptstream << "\n```HTML Description";
+            if (batched) {
+                promptstream << " of State" << target->getId();
+            }
+            promptstream << "\n" << target->stateDescription(_descriptionTokens) << "```\n";
+        }
 
+        bool maintainTopList = false;
+        uint64_t ticket = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            maintainTopList = _topValuedMergedState->size() >= 5;
+            if (maintainTopList) {
+                // ask gpt to maintain the M list
+                nlohmann::ordered_json top5;
+                int count = 0;
+                for (auto it = _topValuedMergedState->begin(); it < _topValuedMergedState->end() && count < 5; ++it) {
+                    // M: overview, top 5 function to json
+                    if ((*it)->hasUntestedFunctions()) {
+                        (*it)->writeOverviewAndTop5Tojson(top5);
+                        count++;
+                    }
+
+                }
+                promptstream << "Current: ";
+                for (size_t i = 0; i < targets.size(); i++) {
+                    promptstream << (i == 0 ? "" : ", ") << "State" << targets[i]->getId();
+                }
+                promptstream << "\n";
+                promptstream << "Five other pages:\n" << top5.dump(4) << "\n";
             }
-            promptstream << "Current: State" << payload.from->getId() << "\n";
-            promptstream << "Five other pages:\n" << top5.dump(4) << "\n";
-            promptstream << _requiredOutputPrompt_state_summary3 << _anwserFormatPrompt_state3;
+            ticket = _issuedTopTicket++;
         }
-        else {
-            promptstream << _requiredOutputPrompt_state2 <<  _requiredOutputPrompt_state_summary2 << _anwserFormatPrompt_state2;
+        PromptLayout layout = batched ? (maintainTopList ? PromptLayout::OVERVIEW_BATCH_TOP : PromptLayout::OVERVIEW_BATCH)
+                                      : (maintainTopList ? PromptLayout::OVERVIEW_TOP : PromptLayout::OVERVIEW);
+
+        nlohmann::ordered_json jsonResponse = getResponse(_promptBuilder->build(layout, promptstream.str()),
+                                                          AskModel::STATE_OVERVIEW);
+
+        // process response, an unanswered question still takes its turn on the top list
+        MergedStateVec answered;
+        MergedStateVec missed;
+        for (const auto& target: targets) {
+            nlohmann::ordered_json answer = jsonResponse;
+            if (batched) {
+                std::string key = "State" + std::to_string(target->getId());
+                answer = jsonResponse.is_object() && jsonResponse.contains("States") && jsonResponse["States"].contains(key)
+                        ? jsonResponse["States"][key] : nlohmann::ordered_json();
+            }
+            if (isOverview(answer)) {
+                target->updateFromStateOverview(answer);
+                answered.push_back(target);
+            }
+            else if (batched && !jsonResponse.is_null()) {
+                missed.push_back(target);
+            }
         }
+        applyTopList(jsonResponse, maintainTopList, answered, ticket);
 
-        nlohmann::ordered_json jsonResponse = getResponse(promptstream.str(), AskModel::STATE_OVERVIEW);
+        // the model skipped or cut off some pages of the batch
+        for (const auto& target: missed) {
+            callJavaLogger(CHILD_THREAD, "[THREAD] no overview of MergedState%d in the batched answer, ask alone", target->getId());
+            QuestionPayload single{AskModel::STATE_OVERVIEW, target};
+            askForStateOverview(single);
+        }
+        callJavaLogger(CHILD_THREAD, "askForStateOverview complete!");
+    }
 
-        // process response
-        payload.from->updateFromStateOverview(jsonResponse);
-        if (_topValuedMergedState->size() >= 5) {
-            // update M list from response
-            std::vector<int> topList;
+    void GPTAgent::applyTopList(const nlohmann::ordered_json& jsonResponse, bool maintainTopList,
+                                const MergedStateVec& answered, uint64_t ticket)
+    {
+        // resolve the ids before waiting for the turn
+        std::vector<int> topList;
+        if (maintainTopList && jsonResponse.is_object()) {
             std::string key = jsonResponse.contains("Top5") ? "Top5" : "Top 5";
             try {
                 topList = jsonResponse[key].get<std::vector<int>>();
             }
             catch (const std::exception& e) {
                 callJavaLogger(CHILD_THREAD, "\t\t\t\t[WARNING] GPT's response is not an int list, try to resolve as string list");
-                std::vector<std::string> strs = jsonResponse[key];
-                for (auto str: strs) {
-                    topList.push_back(std::stoi(str.substr(5)));
+                try {
+                    std::vector<std::string> strs = jsonResponse[key];
+                    for (auto str: strs) {
+                        topList.push_back(std::stoi(str.substr(5)));
+                    }
+                }
+                catch (const std::exception& e) {
+                    // the turn must still be taken, or the answers after this one would wait forever
+                    callJavaLogger(CHILD_THREAD, "\t\t\t\t[WARNING] can't resolve top list: %s, keep it unchanged", e.what());
+                    topList.clear();
                 }
             }
+        }
 
-            // Store the first 5 elements of _topValuedMergedState
-            std::vector<MergedStatePtr> originalFirstFive(_topValuedMergedState->begin(), _topValuedMergedState->begin() + 5);
-            // Replace the first 5 elements of _topValuedMergedState with elements from topList
-            for (size_t i = 0; i < topList.size(); ++i) {
-                MergedStatePtr mergedState = _mergedStateGraph->findMergedStateById(topList[i]);
-                if (mergedState) {
-                    (*_topValuedMergedState)[i] = mergedState;
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _topCv.wait(lock, [this, ticket]() { return _appliedTopTicket == ticket; });
+            if (maintainTopList) {
+                // The states picked by gpt go first, in its order, then the rest of the list in the previous order,
+                // so the displaced ones of the first five follow right after the new five.
+                // Other answers may have been applied since this prompt was built, so skip states already placed.
+                MergedStateVec reordered;
+                for (int id: topList) {
+                    MergedStatePtr mergedState = _mergedStateGraph->findMergedStateById(id);
+                    if (mergedState && std::find(reordered.begin(), reordered.end(), mergedState) == reordered.end()) {
+                        reordered.push_back(mergedState);
+                    }
                 }
-            }
-            // Find elements in originalFirstFive that are not in topList
-            std::vector<MergedStatePtr> elementsToInsert;
-            for (const auto& elem : originalFirstFive) {
-                int id = elem->getId();
-                if (std::find(topList.begin(), topList.end(), id) == topList.end()) {
-                    elementsToInsert.push_back(elem);
+                size_t picked = reordered.size();
+                for (const auto& elem : *_topValuedMergedState) {
+                    if (std::find(reordered.begin(), reordered.begin() + picked, elem) == reordered.begin() + picked) {
+                        reordered.push_back(elem);
+                    }
                 }
+                _topValuedMergedState->swap(reordered);
             }
-            // Insert the elementsToInsert after the 5th element of _topValuedMergedState
-            _topValuedMergedState->insert(_topValuedMergedState->begin() + 5, elementsToInsert.begin(), elementsToInsert.end());
-
-            /*for (int i = 0; i < topList.size(); i++) {
-                if (topList[i] == (*_topValuedMergedState)[i]->getId()) { continue; }
-                MergedStatePtr mergedState = _mergedStateGraph->findMergedStateById(topList[i]);
-                MergedStatePtr tmp = (*_topValuedMergedState)[i];
-                (*_topValuedMergedState)[i] = mergedState;
-                _topValuedMergedState->insert(_topValuedMergedState->begin() + 4 , tmp);
-            }*/
-        }
-        else {
-            _topValuedMergedState->push_back(payload.from);
+            else {
+                _topValuedMergedState->insert(_topValuedMergedState->end(), answered.begin(), answered.end());
+            }
+            _appliedTopTicket++;
         }
-        callJavaLogger(CHILD_THREAD, "askForStateOverview complete!");
+        _topCv.notify_all();
     }
 
     void GPTAgent::askForGuiding(QuestionPayload& payload)
     {
         callJavaLogger(CHILD_THREAD, "[THREAD] ask for guiding");
         std::stringstream promptstream;
-        promptstream << _startPrompt << _inputExplanationPrompt_guide;
 
         nlohmann::ordered_json jsonData;
+        std::unique_lock<std::mutex> lock(_mtx);
         int end = (_topValuedMergedState->size() > _P2) ? _P2 : _topValuedMergedState->size();
         int count = 0;
         for (int i = 0; i < _topValuedMergedState->size(); i++) {
@@ -356,64 +744,116 @@ namespace fastbotx {
         promptstream << "\n```State Informations\n" << jsonData.dump(4) << "\n```\n";
 
         // tested function
-        promptstream << _requiredOutputPrompt_guide_part1 << "{";
+        promptstream << "Tested Functions: {";
         for (auto it: _testedFunctions) {
             promptstream << it << ", ";
         }
-        promptstream << "}" << _requiredOutputPrompt_guide_part2;
-        promptstream << _answerFormatPrompt_guide;
+        promptstream << "}\n";
+        lock.unlock();
 
         // ask
-        nlohmann::ordered_json jsonResponse = getResponse(promptstream.str(), AskModel::GUIDE);
+        nlohmann::ordered_json jsonResponse = getResponse(_promptBuilder->build(PromptLayout::GUIDE, promptstream.str()),
+                                                          AskModel::GUIDE);
+        GuideAnswer answer;
+        if (jsonResponse.is_null()) {
+            payload.promiseGuide->set_value(answer);
+            return;
+        }
 
-        // process response
+        // process response, the target is only changed by the main thread accepting the answer
         std::string targetState = jsonResponse["Target State"];
-        _targetFunction =  jsonResponse["Target Function"];
-        _targetMergedStateId = std::stoi(targetState.substr(5));
-
-        MergedStatePtr destination = _mergedStateGraph->findMergedStateById(_targetMergedStateId);
-        if (!destination) {
-            _promiseInt->set_value(-1);
+        int mergedStateId = mergedStateIdOf(targetState);
+        if (mergedStateId == -1) {
+            callJavaLogger(CHILD_THREAD, "[THREAD] guide names no State: %s", targetState.c_str());
+            payload.promiseGuide->set_value(answer);
+            return;
         }
-        else {
-            ReuseStatePtr targetState = destination->getTargetState(_targetFunction);
-            _promiseInt->set_value((targetState? targetState->getIdi(): -1));
-        }   
+        answer.function = jsonResponse["Target Function"];
+        answer.mergedStateId = mergedStateId;
+        payload.promiseGuide->set_value(answer);
     }
 
     void GPTAgent::askForTestFunction(QuestionPayload& payload)
     {
         callJavaLogger(CHILD_THREAD, "[THREAD] ask for testing function");
+        // executed functions and the conversation so far
+        std::unique_lock<std::mutex> lock(_mtx);
+        if (payload.generation != _testStepGeneration) {
+            callJavaLogger(CHILD_THREAD, "[THREAD] test step for R%d was dropped, don't ask", payload.reuseState->getIdi());
+            return;
+        }
+        std::vector<std::string> executedFunctions = _executedFunctions;
+        std::string targetFunction = _targetFunction;
+        ChatHistory history = _testHistory;
+        uint64_t conversationId = _testConversation;
+        ReuseStatePtr reference = nullptr;
+        MergedStatePtr mergedState = payload.reuseState->getMergedState();
+        if (mergedState) {
+            auto found = _describedStates.find(mergedState->getId());
+            if (found != _describedStates.end()) {
+                reference = found->second;
+            }
+        }
+        lock.unlock();
+
         std::stringstream promptstream;
-        promptstream << _startPrompt << _inputExplanationPrompt_functionTest;
         // Provide a detailed description of the page (including action number)
         // To extend to mergedWidget
-        std::string html = (payload.reuseState)->getStateDescription();
-        promptstream << "\n```Page Description\n" 
-            << html
-            << "```\n";
+        std::string html = (payload.reuseState)->getCompactDescription(_descriptionTokens);
+        // a page of a MergedState the model has read a page of is told as the changes from that page,
+        // unless it changed so much that the changes are not much shorter or lines were left out of that page
+        std::map<int, int> addedIds;
+        bool byChanges = false;
+        std::string changes;
+        if (reference && payload.reuseState->describeChangesFrom(reference, changes, addedIds)) {
+            byChanges = estimate_tokens(changes) * 2 < estimate_tokens(html);
+            if (byChanges) {
+                promptstream << _pageChangesPrompt_functionTest
+                    << "```Page Changes of Page" << reference->getIdi() << "\n"
+                    << (changes.empty() ? "Nothing changed.\n" : changes)
+                    << "```\n";
+            }
+        }
+        if (!byChanges) {
+            promptstream << "\n```Page Description of Page" << payload.reuseState->getIdi() << "\n"
+                << html
+                << "```\n";
+        }
 
         // Function to be tested
-        promptstream << "The target function I want to test is : " << _targetFunction << "\n";
+        promptstream << "The target function I want to test is : " << targetFunction << "\n";
 
-        // executed functions
-        if (!_executedFunctions.empty()) {
+        if (!executedFunctions.empty()) {
             promptstream << "I've already I have already executed: [";
-            for (int i = 0; i < _executedFunctions.size(); i++) {
+            for (int i = 0; i < executedFunctions.size(); i++) {
                 if (i != 0) { promptstream << ",\n"; }
-                promptstream << _executedFunctions[i];
+                promptstream << executedFunctions[i];
             }
             promptstream << "]\n";
         }
         
-        // Ask which control to click
-        promptstream << _requiredOutputPrompt_functionTest << "\n" << _answerFormatPrompt_functionTest;
-        if (!_executedFunctions.empty()) {
-            promptstream << _answerFormatPrompt_functionTestEmpty;
+        // Ask which control to click, a later step of the conversation only repeats the question
+        std::string prompt;
+        if (history.empty()) {
+            prompt = _promptBuilder->build(executedFunctions.empty() ? PromptLayout::TEST_FUNCTION
+                                                                    : PromptLayout::TEST_FUNCTION_EXECUTED,
+                                           promptstream.str());
+        }
+        else {
+            promptstream << _requiredOutputPrompt_functionTest;
+            if (!executedFunctions.empty()) {
+                promptstream << _answerFormatPrompt_functionTestEmpty;
+            }
+            prompt = promptstream.str();
         }
 
         // ask
-        nlohmann::ordered_json jsonResponse = getResponse(promptstream.str(), AskModel::TEST_FUNCTION);
+        nlohmann::ordered_json jsonResponse = getResponse(prompt, AskModel::TEST_FUNCTION, history);
+        TestStepAnswer answer;
+        if (jsonResponse.is_null()) {
+            payload.promiseTestStep->set_value(answer);
+            return;
+        }
 
         // process response
         int elementId = jsonResponse["Element Id"];
@@ -424,42 +864,64 @@ namespace fastbotx {
         }
 
         if (elementId == -1) {
-            _promiseAction->set_value(nullptr);
+            payload.promiseTestStep->set_value(answer);
             return;
         }
 
+        // ids of a prompt with changes are those of the reference page, or of the added elements
+        if (byChanges) {
+            auto added = addedIds.find(elementId);
+            int translated = added != addedIds.end() ? added->second
+                                                     : payload.reuseState->translateElementId(reference, elementId);
+            if (translated == -1) {
+                callJavaLogger(CHILD_THREAD, "Element id %d of Page%d is not on Page%d", elementId,
+                               reference->getIdi(), payload.reuseState->getIdi());
+                payload.promiseTestStep->set_value(answer);
+                return;
+            }
+            elementId = translated;
+        }
+
         // Find action based on number
-        // If the widget comes from mergedWidgets, change the target widget of the action
-        // Directly return actionPtr, with inputText set, and add executed event in here, using line in html
-        int actionId = payload.reuseState->findActionByElementId(elementId, actionType);
-        ActivityStateActionPtr ret = nullptr;
+        // If the widget comes from mergedWidgets, the target widget of the action is changed by acceptTestStep,
+        // along with the input text and the executed event: the page may only be predicted
+        int whichWidget = -1;
+        WidgetPtr target = nullptr;
+        int actionId = payload.reuseState->findActionByElementId(elementId, actionType, whichWidget, target);
         if (actionId == -1) {
             // _actionByGPT = state->getActions()[0];
-            ret = nullptr;
-            callJavaLogger(CHILD_THREAD, "LLM returns None, meaning function %s is either finished testing or can't be tested", _targetFunction.c_str());
+            callJavaLogger(CHILD_THREAD, "LLM returns None, meaning function %s is either finished testing or can't be tested", targetFunction.c_str());
         }
         else {
-            ret = (payload.reuseState)->getActions()[actionId];
-            // set inputText to action
+            answer.state = payload.reuseState;
+            answer.action = (payload.reuseState)->getActions()[actionId];
+            answer.target = target;
+            answer.whichWidget = whichWidget;
+            // inputText for action
             if (jsonResponse.contains("Input")) {
-                ret->setInputText(jsonResponse["Input"].get<std::string>());
+                answer.hasInput = true;
+                answer.input = jsonResponse["Input"].get<std::string>();
             }
-            addExecutedEvent(html, elementId, ret);
+            answer.eventSubject = describedLineOf(html, elementId);
+            answer.question = prompt;
+            answer.reply = jsonResponse.dump();
+            answer.describedState = byChanges ? nullptr : payload.reuseState;
+            answer.conversationId = conversationId;
         }
-        _promiseAction->set_value(ret);
+        payload.promiseTestStep->set_value(answer);
     }
 
     void GPTAgent::askForReanalysis(QuestionPayload& payload) {
         callJavaLogger(CHILD_THREAD, "Ask for Reanalysis of MergedState%d", payload.from->getId());
+        _scheduler->recordSubject(static_cast<int>(AskModel::REANALYSIS), payload.from->getId());
         std::stringstream prompt;
 
-        prompt << _startPrompt << inputExplanationReanalysis1;
         prompt << "```Overview and Function List\n";
         nlohmann::ordered_json data = payload.from->toJson();
         prompt << data.dump(4);
         prompt << "\n```\n";
 
-        prompt << inputExplanationReanalysis2 << "```Controls in HTML Description\n";
+        prompt << "```Controls in HTML Description\n";
 
         // create widgetsDict
         std::unordered_map<int, WidgetInfo> widgetsDict;
@@ -497,69 +959,193 @@ namespace fastbotx {
         }
 
         prompt << "```\n";
-        prompt << requiredOutputReanalysis + answerFormatReanalysis;
-
-        nlohmann::ordered_json json_resp = getResponse(prompt.str(), AskModel::REANALYSIS);
+        nlohmann::ordered_json json_resp = getResponse(_promptBuilder->build(PromptLayout::REANALYSIS, prompt.str()),
+                                                       AskModel::REANALYSIS);
+        if (json_resp.is_null()) {
+            return;
+        }
 
         payload.from->updateFromReanalysis(json_resp, uniqueWidgets, widgetsDict);
 
     }
     
-    nlohmann::ordered_json GPTAgent::getResponse(const std::string& prompt, AskModel type)
+    nlohmann::ordered_json GPTAgent::getResponse(const std::string& prompt, AskModel type,
+                                                 const ChatHistory& history)
+    {
+        using UnderlyingType = typename std::underlying_type<AskModel>::type;
+        size_t promptTokens = estimate_tokens(prompt);
+        for (const auto& turn : history) {
+            promptTokens += estimate_tokens(turn.first) + estimate_tokens(turn.second);
+        }
+        std::vector<int> cascade = _router->plan(static_cast<UnderlyingType>(type), promptTokens);
+
+        // answers are cached per model, one of any model the question would be asked is taken
+        bool cacheable = isCacheable(type);
+        std::string normalizedPrompt = cacheable ? LLMResponseCache::normalize(prompt) : std::string();
+        auto cacheKeyOf = [&](const ModelEndpoint& endpoint) {
+            return LLMResponseCache::makeKey({std::to_string(static_cast<UnderlyingType>(type)), endpoint.model,
+                                              normalizedPrompt});
+        };
+        for (size_t step = 0; cacheable && step < cascade.size(); step++) {
+            std::string cacheKey = cacheKeyOf(_router->endpoint(cascade[step]));
+            std::string cached;
+            if (_responseCache->get(cacheKey, cached)) {
+                try {
+                    nlohmann::ordered_json jsonResponse = nlohmann::ordered_json::parse(cached);
+                    std::lock_guard<std::mutex> logLock(_logMtx);
+                    _interactionFile << std::fixed << std::setprecision(5) <<
+                            0.0 << ", cache, 0, 0, " << static_cast<UnderlyingType>(type) << std::endl;
+                    callJavaLogger(CHILD_THREAD, "[THREAD]Cache hit %s (hits: %zu, misses: %zu)", cacheKey.c_str(),
+                                   _responseCache->hits(), _responseCache->misses());
+                    return jsonResponse;
+                }
+                catch (nlohmann::json::parse_error& e) {
+                    callJavaLogger(CHILD_THREAD, "[THREAD]Broken cache entry %s, ask the model", cacheKey.c_str());
+                }
+            }
+        }
+
+        for (size_t step = 0; step < cascade.size(); step++) {
+            const ModelEndpoint& endpoint = _router->endpoint(cascade[step]);
+            // a model that can't answer is replaced by the next one, only the last one is asked to fix its json
+            bool last = step + 1 == cascade.size();
+            int maxFixes = last ? _maxJsonFixes : 0;
+            std::string response;
+            bool decided = false;
+            nlohmann::ordered_json decidedFields;
+            // a model with another one after it isn't retried, the next one is asked right away
+            if (!requestCompletion(endpoint, prompt, type, last, response, decided, decidedFields, history)) {
+                if (last) {
+                    return nlohmann::ordered_json();
+                }
+                callJavaLogger(CHILD_THREAD, "\t\t\t\t[WARNING] %s didn't answer, escalate", endpoint.name.c_str());
+                continue;
+            }
+
+            nlohmann::ordered_json jsonResponse;
+            int fixes = 0;
+            bool valid = true;
+            while (!decided && (!parseLenientJson(response, jsonResponse) || !hasRequiredFields(type, jsonResponse))) {
+                if (fixes >= maxFixes) {
+                    valid = false;
+                    break;
+                }
+                fixes++;
+                callJavaLogger(CHILD_THREAD, "\t\t\t\t[WARNING] GPT's response is not valid json, ask to fix it (%d/%d)", fixes, maxFixes);
+                if (!requestCompletion(endpoint, _fixJsonPrompt + response + "\n```\n", type, true, response, decided,
+                                       decidedFields)) {
+                    return nlohmann::ordered_json();
+                }
+            }
+            _router->recordOutcome(cascade[step], static_cast<UnderlyingType>(type), valid);
+            if (!valid) {
+                if (last) {
+                    callJavaLogger(CHILD_THREAD, "[ERROR]: can't read GPT's response as json after %d fixes, drop the question", fixes);
+                    callJavaLogger(CHILD_THREAD, "[THREAD]model routing: %s", _router->statistics().c_str());
+                    return nlohmann::ordered_json();
+                }
+                callJavaLogger(CHILD_THREAD, "\t\t\t\t[WARNING] can't read the answer of %s, escalate", endpoint.name.c_str());
+                continue;
+            }
+            if (decided) {
+                return decidedFields;
+            }
+            if (cacheable) {
+                _responseCache->put(cacheKeyOf(endpoint), jsonResponse.dump());
+            }
+            return jsonResponse;
+        }
+        return nlohmann::ordered_json();
+    }
+
+    bool GPTAgent::requestCompletion(const ModelEndpoint& endpoint, const std::string& prompt, AskModel type,
+                                     bool retry, std::string& response,
+                                     bool& decided, nlohmann::ordered_json& decidedFields,
+                                     const ChatHistory& history)
     {
+        using UnderlyingType = typename std::underlying_type<AskModel>::type;
+        decided = false;
+        const RetryPolicyPtr& retryPolicy = endpoint.retryPolicy;
+        if (!retryPolicy->allowRequest()) {
+            callJavaLogger(CHILD_THREAD, "\t\t\t\t[WARNING] LLM circuit of %s is open, the question is not asked",
+                           endpoint.name.c_str());
+            return false;
+        }
         saveToFile(prompt, 0);
         callJavaLogger(CHILD_THREAD, "[THREAD]prompt:\n%s\n-----prompt end %d-----", prompt.c_str(), prompt.length());
-        callJavaLogger(CHILD_THREAD, "[THREAD]Start Asking...");
-        
-        _conversation.AddUserData(prompt);
-        double beginStamp = 0;
-        double endStamp = 0;
-        liboai::Response rawResponse;
+        callJavaLogger(CHILD_THREAD, "[THREAD]Start Asking %s...", endpoint.name.c_str());
         
-        if (_gpt.auth.SetKey(_apiKey))
-        {
-            int try_times = 0;
-            beginStamp = currentStamp();
-            while (try_times < 5) {
-                try {
-                    rawResponse = _gpt.ChatCompletion->create(_model_str, _conversation, 0.0);
-                    bool success = _conversation.Update(rawResponse);
-                    if (success) { break; }
-                } catch (const std::exception& e) {
-                    // Catch any exception from std::exception and its derived classes
-                    callJavaLogger(CHILD_THREAD, "[Exception]: %s", e.what());
-                    // try again
-                    callJavaLogger(CHILD_THREAD, "\t\t\t\t[WARNING] GPT chat got an exception, try to ask again in 3 seconds");
-                    std::this_thread::sleep_for(std::chrono::seconds(3));
-                    try_times++;
-                }
+        // each worker keeps its own messages, only function test steps are asked with history
+        liboai::ChatMessages messages;
+        for (const auto& turn : history) {
+            messages.AddUserData(turn.first);
+            messages.AddAssistantData(turn.second);
+        }
+        messages.AddUserData(prompt);
+        CompletionResult result;
+        bool success = false;
+        double beginStamp = currentStamp();
+        for (int attempt = 0; ; attempt++) {
+            long retryAfterMs = -1;
+            try {
+                result = _hedge ? hedgedCompletion(endpoint, messages, type)
+                                : tryCompletion(endpoint, messages, type);
+                retryPolicy->onSuccess(result.elapsedMs);
+                success = true;
+                break;
             }
-            endStamp = currentStamp();
-            if (try_times == 5) {
-                callJavaLogger(CHILD_THREAD, "[ERROR]: error when getting GPT's response");
-                exit(0);
+            catch (const liboai::exception::OpenAIRateLimited& e) {
+                callJavaLogger(CHILD_THREAD, "[Exception]: %s, retry after %ld ms", e.what(), e.GetRetryAfterMs());
+                retryAfterMs = e.GetRetryAfterMs();
+            }
+            catch (const std::exception& e) {
+                callJavaLogger(CHILD_THREAD, "[Exception]: %s", e.what());
+            }
+            retryPolicy->onFailure();
+            if (!retry || attempt + 1 >= retryPolicy->maxAttempts()) {
+                break;
+            }
+            long delay = retryPolicy->backoffMs(attempt, retryAfterMs);
+            callJavaLogger(CHILD_THREAD, "\t\t\t\t[WARNING] GPT chat got an exception, try to ask again in %ld ms", delay);
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+            if (!retryPolicy->allowRequest()) {
+                callJavaLogger(CHILD_THREAD, "\t\t\t\t[WARNING] LLM circuit of %s is open, stop retrying",
+                               endpoint.name.c_str());
+                break;
             }
-            
         }
-        else
-        {
-            callJavaLogger(CHILD_THREAD, "!!!Set key failed!!!");
-            exit(0);
+        double endStamp = currentStamp();
+        if (!success) {
+            // the question is dropped, the test goes on without its answer
+            _scheduler->recordCost(static_cast<UnderlyingType>(type), (endStamp - beginStamp) / 1000.0,
+                                   static_cast<long>(estimate_tokens(prompt)));
+            callJavaLogger(CHILD_THREAD, "[ERROR]: error when getting GPT's response");
+            return false;
         }
+        response = result.response;
+        // fields that can't be acted on leave the reply to the full parse, and the json fix if need be
+        decided = result.decided && hasRequiredFields(type, result.decidedFields);
+        decidedFields = result.decidedFields;
+        _promptBuilder->recordUsage(static_cast<UnderlyingType>(type), result.usage);
+        callJavaLogger(CHILD_THREAD, "[THREAD]prompt cache: %s", _promptBuilder->statistics().c_str());
         
-        _cachedConversation++;
-        std::string response = _conversation.GetLastResponse();
-
         double timeCost = (endStamp - beginStamp) / 1000.0;
-        nlohmann::json rawJson = rawResponse.raw_json;
+        long tokens = result.usage.is_object() ? result.usage.value("prompt_tokens", 0L) + result.usage.value("completion_tokens", 0L) : 0;
+        if (tokens <= 0) {
+            tokens = static_cast<long>(estimate_tokens(prompt) + estimate_tokens(response));
+        }
+        _scheduler->recordCost(static_cast<UnderlyingType>(type), timeCost, tokens);
+        callJavaLogger(CHILD_THREAD, "[THREAD]consultation payoff: %s", _scheduler->statistics().c_str());
 
-        using UnderlyingType = typename std::underlying_type<AskModel>::type;
+        // usage is null when the server doesn't report it in the stream
+        std::unique_lock<std::mutex> logLock(_logMtx);
         _interactionFile << std::fixed << std::setprecision(5) <<
                 timeCost << ", " <<
-                _model_str << ", " <<
-                rawJson["usage"]["prompt_tokens"] << ", " <<
-                rawJson["usage"]["completion_tokens"] << ", " <<
+                endpoint.model << ", " <<
+                result.usage["prompt_tokens"] << ", " <<
+                result.usage["completion_tokens"] << ", " <<
                 static_cast<UnderlyingType>(type) << std::endl;
+        logLock.unlock();
 
         callJavaLogger(1, "[THREAD]Get response\n%s\n", response.c_str());
 
@@ -568,46 +1154,178 @@ namespace fastbotx {
             saveToFile(response, 1);
         }
 
-        if (_cachedConversation > _maxCachedConversation) {
-            if (_conversation.PopFirstUserData() && _conversation.PopFirstResponse()) {
-                callJavaLogger(CHILD_THREAD, "[THREAD] Reach max cached conversation, pop the earliest one");
-                _cachedConversation--;
+        if (decided) {
+            callJavaLogger(CHILD_THREAD, "[THREAD]Answer decided after %f s, the rest of the reply is skipped", timeCost);
+        }
+        return true;
+    }
+
+    GPTAgent::CompletionResult GPTAgent::tryCompletion(const ModelEndpoint& endpoint,
+                                                       const liboai::ChatMessages& messages, AskModel type)
+    {
+        CompletionResult result;
+        double beginStamp = currentStamp();
+        if (_stream) {
+            ChatStreamReader reader(decisiveFieldsOf(type));
+            std::exception_ptr error;
+            try {
+                endpoint.chat->create(endpoint.model, messages, 0.0f,
+                                      [&reader](std::string chunk, intptr_t) { return reader.feed(chunk); });
             }
-            else {
-                callJavaLogger(CHILD_THREAD, "[THREAD] Pop conversation failed!");
-            }            
+            catch (...) {
+                error = std::current_exception();
+            }
+            result = streamResult(reader, error);
         }
+        else {
+            result = replyResult(endpoint.chat->create(endpoint.model, messages, 0.0f));
+        }
+        result.elapsedMs = currentStamp() - beginStamp;
+        return result;
+    }
 
-        // Intercept the following string starting from the "{" character
-        size_t pos = response.find('{');
-        if (pos != std::string::npos) {
-            response = response.substr(pos);
+    GPTAgent::CompletionResult GPTAgent::streamResult(ChatStreamReader& reader, const std::exception_ptr& error)
+    {
+        // stopping in the callback aborts the transfer with a write error
+        if (error && !reader.isDecided()) {
+            reader.finish();
+            std::string message = reader.errorMessage();
+            if (message.empty()) {
+                std::rethrow_exception(error);
+            }
+            callJavaLogger(CHILD_THREAD, "[THREAD]stream body: %s", reader.unframedBody().c_str());
+            // the body went to the stream callback, so only it tells what the provider said
+            try {
+                std::rethrow_exception(error);
+            }
+            catch (const liboai::exception::OpenAIRateLimited&) {
+                throw;
+            }
+            catch (...) {
+                throw liboai::exception::OpenAIException(message, liboai::exception::EType::E_APIERROR,
+                                                         "fastbotx::GPTAgent::streamResult()");
+            }
         }
-        pos = response.rfind('}');
-        if (pos != std::string::npos) {
-            response = response.substr(0, pos + 1);
+        reader.finish();
+        if (reader.text().empty()) {
+            std::string message = reader.errorMessage();
+            throw std::runtime_error(message.empty() ? "no content in the stream" : "no content in the stream: " + message);
         }
+        CompletionResult result;
+        result.response = reader.text();
+        result.usage = reader.usage();
+        // a closed object is parsed as a whole by getResponse, like a non-streamed reply
+        result.decided = reader.isDecided() && !reader.isComplete();
+        result.decidedFields = reader.fields();
+        return result;
+    }
 
-        nlohmann::ordered_json jsonResponse;
-        try {
-            jsonResponse = nlohmann::ordered_json::parse(response);
+    GPTAgent::CompletionResult GPTAgent::replyResult(const liboai::Response& response)
+    {
+        // only the content and the usage are read from the body
+        CompletionResult result;
+        if (!liboai::ExtractChatReply(response.content, result.response, result.usage)) {
+            throw std::runtime_error("no message in the response");
         }
-        catch (nlohmann::json::parse_error& e) {
-            callJavaLogger(CHILD_THREAD, "[Exception] %s, ask for response again", e.what());
-            return getResponse(prompt, type);
+        return result;
+    }
+
+    GPTAgent::CompletionResult GPTAgent::hedgedCompletion(const ModelEndpoint& endpoint,
+                                                          const liboai::ChatMessages& messages, AskModel type)
+    {
+        long hedgeDelay = endpoint.retryPolicy->hedgeDelayMs();
+        if (hedgeDelay < 0) {
+            // no latency known yet
+            return tryCompletion(endpoint, messages, type);
         }
-        return jsonResponse;
+
+        // both requests run on the I/O thread of liboai, the loser finishes after this returns
+        struct Race
+        {
+            std::mutex mtx;
+            std::condition_variable cv;
+            std::atomic<bool> won{false};
+            CompletionResult result;
+            std::exception_ptr error;
+            int failed = 0;
+        };
+        auto race = std::make_shared<Race>();
+        bool streamed = _stream;
+        auto launch = [race, &endpoint, &messages, type, streamed]() {
+            double beginStamp = currentStamp();
+            auto reader = std::make_shared<ChatStreamReader>(decisiveFieldsOf(type));
+            auto onDone = [race, reader, beginStamp, streamed](liboai::Response response, std::exception_ptr error) {
+                try {
+                    if (!streamed && error) {
+                        std::rethrow_exception(error);
+                    }
+                    CompletionResult result = streamed ? streamResult(*reader, error) : replyResult(response);
+                    result.elapsedMs = currentStamp() - beginStamp;
+                    std::lock_guard<std::mutex> lock(race->mtx);
+                    if (!race->won) {
+                        race->result = std::move(result);
+                        race->won = true;
+                    }
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(race->mtx);
+                    race->failed++;
+                    race->error = std::current_exception();
+                }
+                race->cv.notify_all();
+            };
+            // the loser is aborted once the other request has answered, whether it streams or not
+            auto onProgress = [race](curl_off_t, curl_off_t, curl_off_t, curl_off_t, intptr_t) {
+                return !race->won.load();
+            };
+            if (streamed) {
+                auto onChunk = [race, reader](std::string chunk, intptr_t) {
+                    return !race->won.load() && reader->feed(chunk);
+                };
+                endpoint.chat->create_async(endpoint.model, messages, onDone, 0.0f, onChunk, onProgress);
+            }
+            else {
+                endpoint.chat->create_async(endpoint.model, messages, onDone, 0.0f, std::nullopt, onProgress);
+            }
+        };
+
+        int launched = 1;
+        launch();
+        std::unique_lock<std::mutex> lock(race->mtx);
+        if (!race->cv.wait_for(lock, std::chrono::milliseconds(hedgeDelay),
+                               [&race]() { return race->won || race->failed > 0; })) {
+            callJavaLogger(CHILD_THREAD, "[THREAD]No answer after %ld ms, send a hedged request", hedgeDelay);
+            launched++;
+            lock.unlock();
+            launch();
+            lock.lock();
+        }
+        race->cv.wait(lock, [&race, launched]() { return race->won || race->failed == launched; });
+        if (race->won) {
+            return race->result;
+        }
+        std::rethrow_exception(race->error);
+    }
+
+    void GPTAgent::resetPromise(PromiseGuidePtr promGuide, PromiseTestStepPtr promTestStep)
+    {
+        _promiseTestStep = std::move(promTestStep);
+        _promiseGuide = std::move(promGuide);
     }
 
-    void GPTAgent::resetPromise(PromiseIntPtr promInt, PromiseActionPtr promAction)
+    void GPTAgent::acceptGuide(const GuideAnswer& answer)
     {
-        _promiseAction = std::move(promAction);
-        _promiseInt = std::move(promInt);
+        std::lock_guard<std::mutex> lock(_mtx);
+        _targetFunction = answer.function;
+        _targetMergedStateId = answer.mergedStateId;
     }
 
     void GPTAgent::addTestedFunction()
     {
-        _testedFunctions.insert(_targetFunction);
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _testedFunctions.insert(_targetFunction);
+        }
         // add update tested function to mergedState(target)
         MergedStatePtr ms = _mergedStateGraph->findMergedStateById(_targetMergedStateId);
         if (ms) {
@@ -618,13 +1336,15 @@ namespace fastbotx {
         }
     }
 
-    void GPTAgent::addExecutedEvent(const std::string& html, int widget_id, ActionPtr act) {
+    std::string GPTAgent::describedLineOf(const std::string& html, int widget_id) {
         std::istringstream stream(html);
         std::string line;
         std::string target = "id=" + std::to_string(widget_id);
         
         while (std::getline(stream, line)) {
-            if (line.find(target) != std::string::npos) {
+            size_t found = line.find(target);
+            // id=1 is not id=12
+            if (found != std::string::npos && !std::isdigit(static_cast<unsigned char>(line[found + target.size()]))) {
                 std::istringstream line_stream(line);
                 std::string cell;
                 std::string last_cell;
@@ -633,14 +1353,70 @@ namespace fastbotx {
                     last_cell = cell;
                 }
                 
-                _executedFunctions.push_back(act->toDescription(last_cell));
-                break;
+                return last_cell;
             }
         }
+        return "";
+    }
+
+    bool GPTAgent::acceptTestStep(const TestStepAnswer& answer, const ReuseStatePtr& reached) {
+        if (!answer.action) {
+            return false;
+        }
+        if (answer.state != reached) {
+            callJavaLogger(MAIN_THREAD, "[MAIN] test step answer is for R%d, not for R%d, drop it",
+                           answer.state ? answer.state->getIdi() : -1, reached ? reached->getIdi() : -1);
+            return false;
+        }
+        answer.action->setWhichWidget(answer.whichWidget);
+        answer.action->setTarget(answer.target);
+        callJavaLogger(MAIN_THREAD, "set target element->widget %d", answer.whichWidget);
+        if (answer.hasInput) {
+            answer.action->setInputText(answer.input);
+        }
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (!answer.eventSubject.empty()) {
+            _executedFunctions.push_back(answer.action->toDescription(answer.eventSubject));
+        }
+        // an answer asked in a dropped conversation may refer to a page description the next prompts won't hold
+        if (_testHistoryTurns <= 0 || answer.question.empty() || answer.conversationId != _testConversation) {
+            return true;
+        }
+        if (_testHistory.size() >= static_cast<size_t>(_testHistoryTurns)) {
+            resetTestConversation();
+            return true;
+        }
+        _testHistory.emplace_back(answer.question, answer.reply);
+        MergedStatePtr mergedState = answer.describedState ? answer.describedState->getMergedState() : nullptr;
+        if (mergedState) {
+            _describedStates[mergedState->getId()] = answer.describedState;
+        }
+        return true;
+    }
+
+    void GPTAgent::dropTestSteps() {
+        std::lock_guard<std::mutex> questionCountLock(_questionMtx);
+        std::lock_guard<std::mutex> lock(_mtx);
+        _testStepGeneration++;
+        size_t before = _stateQueue.size();
+        _stateQueue.erase(std::remove_if(_stateQueue.begin(), _stateQueue.end(), [](const QuestionPayload& p) {
+            return p.type == AskModel::TEST_FUNCTION;
+        }), _stateQueue.end());
+        int removed = static_cast<int>(before - _stateQueue.size());
+        _questionRemained -= removed;
+        callJavaLogger(MAIN_THREAD, "[MAIN] drop test steps asked so far, %d of them queued", removed);
     }
 
     void GPTAgent::clearExecutedEvents() {
+        std::lock_guard<std::mutex> lock(_mtx);
         _executedFunctions.clear();
+        resetTestConversation();
+    }
+
+    void GPTAgent::resetTestConversation() {
+        _testHistory.clear();
+        _describedStates.clear();
+        _testConversation++;
     }
 
 }
@@ -5,8 +5,16 @@
 #include "liboai.h"
 #include "ReuseState.h"
 #include <queue>
+#include <deque>
 #include "MergedState.h"
 #include "prompt.h"
+#include "LLMResponseCache.h"
+#include "ChatStreamReader.h"
+#include "JsonRepair.h"
+#include "RetryPolicy.h"
+#include "PromptBuilder.h"
+#include "ConsultationScheduler.h"
+#include "ModelRouter.h"
 #include <atomic>
 #include <future>
 
@@ -14,14 +22,58 @@
 #define GPT_4 1
 #define CLAUDE 2
 
+#define LLM_CACHE_DIR "/sdcard/faruzan/llm_cache"
+#define LLM_CACHE_MAX_ENTRIES 2000
+#define LLM_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+#define LLM_MAX_IN_FLIGHT 3
+#define GUIDE_TIMEOUT_MS 120000
+#define LLM_MAX_JSON_FIXES 1
+#define DESCRIPTION_TOKEN_BUDGET 2000
+#define TEST_HISTORY_TURNS 5
+#define OVERVIEW_BATCH_TOKENS 6000
+
 namespace fastbotx {
 
     typedef std::shared_ptr<std::promise<int>> PromiseIntPtr;
     typedef std::future<int> FutureInt;
     typedef std::shared_ptr<std::promise<std::string>> PromiseStrPtr;
     typedef std::future<std::string> FutureStr;
-    typedef std::shared_ptr<std::promise<ActivityStateActionPtr>> PromiseActionPtr;
-    typedef std::future<ActivityStateActionPtr> FutureAction;
+
+    /// earlier (question, answer) turns of a conversation, oldest first
+    typedef std::vector<std::pair<std::string, std::string>> ChatHistory;
+
+    /// Answer of a TEST_FUNCTION question, nothing of it is applied until the main thread accepts it,
+    /// so an answer asked ahead for a predicted page can be thrown away.
+    struct TestStepAnswer
+    {
+        ReuseStatePtr state = nullptr; // the page asked about
+        ActivityStateActionPtr action = nullptr;
+        // the widget of the chosen element, action is aimed at it once accepted
+        WidgetPtr target = nullptr;
+        int whichWidget = -1;
+        bool hasInput = false;
+        std::string input;
+        std::string eventSubject; // the element's line in the page description, the action is shown as executed on it
+        // the turn kept in the conversation of the function test once accepted
+        std::string question;
+        std::string reply;
+        ReuseStatePtr describedState = nullptr; // described in full by question
+        uint64_t conversationId = 0; // the conversation question was asked in
+    };
+    typedef std::shared_ptr<std::promise<TestStepAnswer>> PromiseTestStepPtr;
+    typedef std::future<TestStepAnswer> FutureTestStep;
+
+    /// Answer of a GUIDE question, applied by the main thread once it accepts it (GPTAgent::acceptGuide),
+    /// so an abandoned answer never changes the target. The main thread also looks up the page to navigate to,
+    /// the graph keeps changing while the question is asked.
+    struct GuideAnswer
+    {
+        std::string function;
+        int mergedStateId = -1;
+    };
+    typedef std::shared_ptr<std::promise<GuideAnswer>> PromiseGuidePtr;
+    typedef std::future<GuideAnswer> FutureGuide;
 
     enum class AskModel
     {
@@ -36,19 +88,28 @@ namespace fastbotx {
         int transitCount = 0;
         ReuseStatePtr reuseState = nullptr;
         bool flag = false; // GUIDE:guideFailed, TEST_FUNCTION:firstTime
+        std::vector<MergedStatePtr> batch; // STATE_OVERVIEW: more MergedStates asked about in the same prompt
+        // filled by pushStateToQueue with the promises current at that time,
+        // so an abandoned answer can't fulfill the promise of a later question
+        PromiseGuidePtr promiseGuide = nullptr;
+        PromiseTestStepPtr promiseTestStep = nullptr;
+        uint64_t generation = 0; // TEST_FUNCTION: GPTAgent::_testStepGeneration when queued
     };
     
     
     /**
      * @brief Responsible for interacting with GPT.
      *
-     * Call the test thread the main thread, and the thread that interacts with gpt is called the child thread
+     * Call the test thread the main thread, and the threads that interact with gpt are called child threads.
+     * Up to _maxInFlight questions are asked at the same time. Questions about the same MergedState are asked
+     * one after another, and answers that rewrite _topValuedMergedState are applied in the order their prompts
+     * were built.
      * 
      */
     class GPTAgent
     {
     public:
-        GPTAgent(MergedStateGraphPtr& graph, PromiseIntPtr prom);
+        GPTAgent(MergedStateGraphPtr& graph, PromiseGuidePtr prom);
         ~GPTAgent();
 
         /**
@@ -59,9 +120,26 @@ namespace fastbotx {
          */
         void pushStateToQueue(QuestionPayload state);
 
-        void waitUntilQueueEmpty();
+        /// true if every queued question has been answered, never blocks
+        bool isQueueEmpty();
+
+        /// how long the main thread waits for the queue to drain before asking GUIDE, DrainTimeout in config.json
+        int getDrainTimeout() const { return _drainTimeoutMs; }
+
+        int getGuideTimeout() const { return _guideTimeoutMs; }
+
+        /// false while the circuit breakers keep every model from being asked, explore without them meanwhile
+        bool isAvailable() const { return _router->isAvailable(); }
+
+        /// what the questions cost and gained so far, decides whether and what to ask
+        ConsultationSchedulerPtr getScheduler() const { return _scheduler; }
 
-        void resetPromise(PromiseIntPtr promInt, PromiseActionPtr promAction);
+        int getTargetMergedStateId() const { return _targetMergedStateId; }
+
+        void resetPromise(PromiseGuidePtr promGuide, PromiseTestStepPtr promTestStep);
+
+        /// make the answer of the guide the function to test, called by the main thread
+        void acceptGuide(const GuideAnswer& answer);
 
         std::string getFunctionToTest() { return _targetFunction; }
         
@@ -72,8 +150,33 @@ namespace fastbotx {
         */
         void addTestedFunction();
 
+        /**
+         * Aim the chosen action at the chosen widget, set its input text and record it as executed.
+         * @param reached the page the action is going to be performed in
+         * @return false if the answer is about another page, nothing is applied then
+         * @note call from main thread, right before the action is performed
+         */
+        bool acceptTestStep(const TestStepAnswer& answer, const ReuseStatePtr& reached);
+
         void clearExecutedEvents();
 
+        /**
+         * @brief Drop the TEST_FUNCTION questions asked so far, e.g. the prefetch for a page that was not reached.
+         * Queued ones are removed, so the next question doesn't wait behind them,
+         * and one already taken by a worker is not sent if it has not been yet.
+         * @note call from main thread
+         */
+        void dropTestSteps();
+
+        /**
+         * @brief Set up the connection to every endpoint in the background, so the first question doesn't pay
+         * for DNS, TCP and TLS. Each endpoint is asked for its model list, which costs no tokens and also checks
+         * its url and key: a misconfigured endpoint is reported right away instead of at the first question.
+         * With WarmUpChat true in config.json it is asked a one token question instead, which checks its model too.
+         * Nothing is done if WarmUp is false in config.json.
+         */
+        void warmUp();
+
     private:
         //std::atomic<int> _questionRemained;
         bool _saveToFile = true;
@@ -81,38 +184,68 @@ namespace fastbotx {
         std::ofstream _interactionFile;
 
         std::string _model_str = "gpt-4o-mini";
+        ModelRouterPtr _router; // which endpoints answer which questions, the first one is Model at BaseUrl
+        bool _stream = true; // read answers as server-sent events and stop once they are decided
+        bool _hedge = false; // send a second request when the first one is slower than most
+        bool _warmUp = true;
+        bool _warmUpChat = false; // warm up with a chat completion instead of the model list
+        ConsultationSchedulerPtr _scheduler;
 
         std::string _startPrompt;
+        PromptBuilderPtr _promptBuilder; // lays out every prompt after _startPrompt is known
         std::string _apiKey;
         liboai::OpenAI _gpt;
-        liboai::Conversation _conversation;
-        const int _maxCachedConversation = 0;
-        int _cachedConversation = 0;
-        size_t _conversationLen = 0;
-        std::queue<QuestionPayload> _stateQueue;
-        std::queue<QuestionPayload> _lowQueue;
+        std::deque<QuestionPayload> _stateQueue;
+        std::deque<QuestionPayload> _lowQueue;
         std::mutex _mtx;
         std::condition_variable _cv;
+        std::mutex _logMtx; // _file and _interactionFile
+
+        // worker pool, protected by _mtx
+        int _maxInFlight = LLM_MAX_IN_FLIGHT;
+        std::set<int> _busyMergedStates; // MergedStates some worker is asking about
+        int _coalescedQuestions = 0; // not queued or removed, a queued question answers them
+        int _skippedQuestions = 0; // taken from the queue with their answer already known
+        uint64_t _issuedTopTicket = 0; // one ticket per snapshot of _topValuedMergedState taken for a prompt
+        uint64_t _appliedTopTicket = 0; // the ticket whose answer may update _topValuedMergedState next
+        std::condition_variable _topCv;
 
         MergedStateGraphPtr _mergedStateGraph;
         std::string _mergedStateGraphString;
 
-        PromiseIntPtr _promiseInt;
+        PromiseGuidePtr _promiseGuide;
         PromiseStrPtr _promiseStr;
-        PromiseActionPtr _promiseAction;
+        PromiseTestStepPtr _promiseTestStep;
 
         std::mutex _questionMtx;
-        int _questionRemained = 0;
+        int _questionRemained = 0; // queued and in flight
+        int _drainTimeoutMs = 0; // <= 0: wait until all done, see AbstractAgent::pollGuidance
+        int _guideTimeoutMs = GUIDE_TIMEOUT_MS; // <= 0: wait for the guide answer as long as it takes
+        int _maxJsonFixes = LLM_MAX_JSON_FIXES; // "fix this json" follow-ups for a reply the repair can't read
+        size_t _descriptionTokens = DESCRIPTION_TOKEN_BUDGET; // budget of a page description in a prompt
+        size_t _overviewBatchTokens = OVERVIEW_BATCH_TOKENS; // budget of the page descriptions in one overview prompt
+
+        // conversation of the current function test, protected by _mtx.
+        // Once the model has read a page of a MergedState in it, other pages of it are described by their changes.
+        int _testHistoryTurns = TEST_HISTORY_TURNS; // <= 0: every step is asked without history
+        ChatHistory _testHistory;
+        std::map<int, ReuseStatePtr> _describedStates; // MergedState id -> its page described in full in _testHistory
+        uint64_t _testConversation = 0; // changes whenever _testHistory is dropped
+        uint64_t _testStepGeneration = 0; // TEST_FUNCTION questions of an older one are not asked anymore
 
+        // protected by _mtx, only the main thread writes them
         std::string _targetFunction; //Gpt in the guide determines the test function
-        int _targetMergedStateId;
+        int _targetMergedStateId = -1;
         std::set<std::string> _testedFunctions; // All functions that have been implemented in the guide
-        std::vector<std::string> _executedFunctions;
+        std::vector<std::string> _executedFunctions; // protected by _mtx, read by child threads
 
         // state overview
         const unsigned long _P2 = 10;
         MergedStateVecPtr _topValuedMergedState = std::make_shared<MergedStateVec>();
 
+        // answers of STATE_OVERVIEW questions kept across runs, null if disabled in config.json
+        LLMResponseCachePtr _responseCache;
+
         bool init();
 
         /**
@@ -122,6 +255,33 @@ namespace fastbotx {
          */
         void pageAnalysisLoop();
 
+        /**
+         * @brief Pop the first question whose MergedState is not being asked about by another worker.
+         * Questions the main thread is blocked on come first, then the high priority queue, then the low one.
+         * An overview takes the other overviews waiting in the queue along into its batch,
+         * as many as fit in _overviewBatchTokens.
+         * @note call with _mtx held
+         */
+        bool takePayload(QuestionPayload& payload);
+
+        /**
+         * @brief Merge an overview or reanalysis question with the queued ones about the same MergedState.
+         * Prompts are built from the MergedState when the question is taken, so a queued question
+         * already covers the pages added since it was queued. An overview covers a reanalysis as well,
+         * and replaces a queued one.
+         * @return true if a queued question answers payload, which must not be queued then
+         * @note call with _questionMtx and _mtx held
+         */
+        bool coalesceQuestion(const QuestionPayload& payload);
+
+        /// the answer to payload is known by now, e.g. from a question about the same MergedState asked meanwhile
+        bool isAnswered(const QuestionPayload& payload);
+
+        /// put the answer of an overview into _topValuedMergedState, in the order the prompts were built
+        void applyTopList(const nlohmann::ordered_json& jsonResponse, bool maintainTopList,
+                          const MergedStateVec& answered, uint64_t ticket);
+
+        /// one prompt for payload.from and payload.batch, the pages a batched answer leaves out are asked alone
         void askForStateOverview(QuestionPayload& payload);
 
         void askForGuiding(QuestionPayload& payload);
@@ -130,13 +290,67 @@ namespace fastbotx {
 
         void askForReanalysis(QuestionPayload& payload);
 
+        /// start the next function test step without history, @note call with _mtx held
+        void resetTestConversation();
+
         void saveToFile(const std::string& prompt, const std::string& response);
 
         void saveToFile(const std::string& value, int type);
 
-        nlohmann::ordered_json getResponse(const std::string& prompt, AskModel type);
+        /**
+         * @brief Ask the model and read its answer as json.
+         * A malformed reply is repaired locally first, only a reply that can't be repaired is sent back
+         * with a short "fix this json" follow-up, never with the original prompt.
+         * The endpoints _router picks are asked in turn, the next one when an answer can't be read.
+         * @param history earlier turns the prompt follows in the conversation
+         * @return the answer, null if no usable answer came back
+         */
+        nlohmann::ordered_json getResponse(const std::string& prompt, AskModel type,
+                                           const ChatHistory& history = {});
+
+        /**
+         * @brief Send one prompt to endpoint and wait for the reply text, retried on transport errors as its retryPolicy says.
+         * @param retry false to give up after the first failed attempt
+         * @param decided set if the stream was stopped once decisiveFieldsOf(type) were read,
+         * the answer is then in decidedFields and response holds the part read so far
+         * @return false if every attempt failed or the circuit is open
+         */
+        bool requestCompletion(const ModelEndpoint& endpoint, const std::string& prompt, AskModel type,
+                               bool retry, std::string& response,
+                               bool& decided, nlohmann::ordered_json& decidedFields,
+                               const ChatHistory& history = {});
+
+        struct CompletionResult
+        {
+            std::string response;
+            nlohmann::json usage;
+            bool decided = false;
+            nlohmann::ordered_json decidedFields;
+            double elapsedMs = 0;
+        };
+
+        /// One attempt, throws on any failure.
+        CompletionResult tryCompletion(const ModelEndpoint& endpoint, const liboai::ChatMessages& messages,
+                                       AskModel type);
+
+        /**
+         * @brief tryCompletion, plus a duplicate request if no answer came within the usual latency, the first answer wins.
+         * Both are sent without blocking and the loser is aborted on the I/O thread of liboai, no thread is left behind.
+         */
+        CompletionResult hedgedCompletion(const ModelEndpoint& endpoint, const liboai::ChatMessages& messages,
+                                          AskModel type);
+
+        /// the answer read by reader once its request is over, error is what the request threw if it failed
+        static CompletionResult streamResult(ChatStreamReader& reader, const std::exception_ptr& error);
+
+        /// the answer in the body of a non-streamed reply
+        static CompletionResult replyResult(const liboai::Response& response);
+
+        /// only the page overview is a pure function of its prompt, the other questions depend on the test progress
+        bool isCacheable(AskModel type) const { return _responseCache && type == AskModel::STATE_OVERVIEW; }
     
-        void addExecutedEvent(const std::string& html, int widget_id, ActionPtr act);
+        /// the text of the line of html showing widget_id, empty if there is none
+        static std::string describedLineOf(const std::string& html, int widget_id);
     };
 
 }
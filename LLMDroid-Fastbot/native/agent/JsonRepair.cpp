@@ -0,0 +1,212 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef JsonRepair_CPP_
+#define JsonRepair_CPP_
+
+#include "JsonRepair.h"
+#include <cctype>
+#include <vector>
+
+namespace fastbotx {
+
+    namespace {
+
+        /// the body of the first fenced block if it holds an object, the whole text otherwise
+        std::string stripFence(const std::string &text) {
+            size_t fence = text.find("```");
+            if (fence == std::string::npos)
+                return text;
+            size_t bodyBegin = text.find('\n', fence);
+            if (bodyBegin == std::string::npos)
+                return text;
+            bodyBegin++;
+            size_t bodyEnd = text.find("```", bodyBegin);
+            std::string body = text.substr(bodyBegin, bodyEnd == std::string::npos ? std::string::npos
+                                                                                  : bodyEnd - bodyBegin);
+            return body.find('{') == std::string::npos ? text : body;
+        }
+
+        void dropTrailingComma(std::string &out) {
+            size_t last = out.find_last_not_of(" \t\r\n");
+            out.erase(last == std::string::npos ? 0 : last + 1);
+            if (!out.empty() && out.back() == ',')
+                out.pop_back();
+        }
+
+        std::string closeAll(std::string out, const std::vector<char> &closers, size_t depth) {
+            dropTrailingComma(out);
+            for (size_t i = depth; i > 0; i--)
+                out += closers[i - 1];
+            return out;
+        }
+
+        void appendStringChar(std::string &out, char c) {
+            switch (c) {
+                case '\n':
+                    out += "\\n";
+                    break;
+                case '\r':
+                    out += "\\r";
+                    break;
+                case '\t':
+                    out += "\\t";
+                    break;
+                default:
+                    out += c;
+            }
+        }
+
+    }
+
+    std::string repairJson(const std::string &reply) {
+        std::string text = stripFence(reply);
+        size_t begin = text.find('{');
+        if (begin == std::string::npos)
+            return "";
+
+        enum class Quote {
+            None, Double, Single
+        };
+        std::string out;
+        out.reserve(text.size() - begin + 8);
+        std::vector<char> closers;
+        std::vector<size_t> memberStart; // where the last member of each open container starts in out
+        Quote quote = Quote::None;
+        bool escape = false;
+        bool numberAtEnd = false;
+        for (size_t i = begin; i < text.size(); i++) {
+            char c = text[i];
+            if (quote == Quote::Double) {
+                if (escape) {
+                    escape = false;
+                    out += c;
+                } else if (c == '\\') {
+                    escape = true;
+                    out += c;
+                } else if (c == '"') {
+                    quote = Quote::None;
+                    out += c;
+                } else {
+                    appendStringChar(out, c);
+                }
+                continue;
+            }
+            if (quote == Quote::Single) {
+                if (escape) {
+                    escape = false;
+                    if (c != '\'')
+                        out += '\\';
+                    out += c;
+                } else if (c == '\\') {
+                    escape = true;
+                } else if (c == '\'') {
+                    quote = Quote::None;
+                    out += '"';
+                } else if (c == '"') {
+                    out += "\\\"";
+                } else {
+                    appendStringChar(out, c);
+                }
+                continue;
+            }
+            switch (c) {
+                case '"':
+                    quote = Quote::Double;
+                    out += c;
+                    break;
+                case '\'':
+                    quote = Quote::Single;
+                    out += '"';
+                    break;
+                case '{':
+                case '[':
+                    closers.push_back(c == '{' ? '}' : ']');
+                    out += c;
+                    memberStart.push_back(out.size());
+                    break;
+                case '}':
+                case ']':
+                    dropTrailingComma(out);
+                    if (!closers.empty()) {
+                        out += closers.back();
+                        closers.pop_back();
+                        memberStart.pop_back();
+                    }
+                    if (closers.empty())
+                        return out; // anything after the object is prose
+                    break;
+                case ',':
+                    out += c;
+                    if (!memberStart.empty())
+                        memberStart.back() = out.size();
+                    break;
+                case '/':
+                    // comment till the end of line
+                    if (i + 1 < text.size() && text[i + 1] == '/') {
+                        size_t lineEnd = text.find('\n', i);
+                        i = lineEnd == std::string::npos ? text.size() : lineEnd;
+                    } else {
+                        out += c;
+                    }
+                    break;
+                default:
+                    if (std::isalpha(static_cast<unsigned char>(c))) {
+                        size_t wordEnd = i;
+                        while (wordEnd < text.size() && std::isalpha(static_cast<unsigned char>(text[wordEnd])))
+                            wordEnd++;
+                        std::string word = text.substr(i, wordEnd - i);
+                        if (word == "True")
+                            word = "true";
+                        else if (word == "False")
+                            word = "false";
+                        else if (word == "None")
+                            word = "null";
+                        out += word;
+                        i = wordEnd - 1;
+                    } else {
+                        numberAtEnd = i + 1 == text.size() &&
+                                      (std::isdigit(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '+');
+                        out += c;
+                    }
+            }
+        }
+
+        // cut off: close everything, dropping the unfinished member of the innermost container,
+        // then of the outer ones, until it parses.
+        // A string or a number cut off at the end is never completed, "12" cut to "1" would be read as 1
+        std::string candidate;
+        if (quote == Quote::None && !numberAtEnd) {
+            candidate = closeAll(out, closers, closers.size());
+            if (nlohmann::ordered_json::accept(candidate))
+                return candidate;
+        }
+        for (size_t depth = closers.size(); depth > 0; depth--) {
+            candidate = closeAll(out.substr(0, memberStart[depth - 1]), closers, depth);
+            if (nlohmann::ordered_json::accept(candidate))
+                return candidate;
+        }
+        return candidate;
+    }
+
+    bool parseLenientJson(const std::string &reply, nlohmann::ordered_json &out) {
+        size_t begin = reply.find('{');
+        size_t end = reply.rfind('}');
+        if (begin != std::string::npos && end != std::string::npos && end > begin) {
+            out = nlohmann::ordered_json::parse(reply.begin() + begin, reply.begin() + end + 1, nullptr, false);
+            if (!out.is_discarded() && out.is_object())
+                return true;
+        }
+        std::string repaired = repairJson(reply);
+        if (repaired.empty())
+            return false;
+        out = nlohmann::ordered_json::parse(repaired, nullptr, false);
+        return !out.is_discarded() && out.is_object();
+    }
+
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef JsonRepair_H_
+#define JsonRepair_H_
+
+#include "../thirdpart/json/json.hpp"
+#include <string>
+
+namespace fastbotx {
+
+    /**
+     * @brief Rewrite the first json object in a model reply into strict json.
+     * Handles code fences and prose around the object, single quoted strings, raw line breaks in strings,
+     * trailing commas, python literals (True, False, None) and objects cut off in the middle.
+     * Only the containers of a cut off object are closed: a member whose string or number reaches the end
+     * may have lost the rest of its value, so it is dropped, like a truncated member that can't be completed.
+     *
+     * @return the repaired text, empty if the reply has no object at all
+     */
+    std::string repairJson(const std::string &reply);
+
+    /// parse the reply as is, then its repaired form
+    bool parseLenientJson(const std::string &reply, nlohmann::ordered_json &out);
+
+}
+
+#endif /* JsonRepair_H_ */
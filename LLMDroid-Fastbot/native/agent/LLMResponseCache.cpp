@@ -0,0 +1,302 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef LLMResponseCache_CPP_
+#define LLMResponseCache_CPP_
+
+#include "LLMResponseCache.h"
+#include "Base.h"
+#include "utils.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+namespace fastbotx {
+
+    namespace {
+
+        const uint32_t Sha256RoundConstants[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+        void sha256Block(uint32_t state[8], const unsigned char *block) {
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++) {
+                w[i] = (uint32_t(block[i * 4]) << 24) | (uint32_t(block[i * 4 + 1]) << 16) |
+                       (uint32_t(block[i * 4 + 2]) << 8) | uint32_t(block[i * 4 + 3]);
+            }
+            for (int i = 16; i < 64; i++) {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; i++) {
+                uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+                uint32_t ch = (e & f) ^ (~e & g);
+                uint32_t t1 = h + s1 + ch + Sha256RoundConstants[i] + w[i];
+                uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+                uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+                uint32_t t2 = s0 + maj;
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+
+        bool isDigestName(const std::string &name) {
+            if (name.size() != 64)
+                return false;
+            return std::all_of(name.begin(), name.end(), [](char c) {
+                return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+            });
+        }
+
+        /// mkdir -p
+        bool makeDirs(const std::string &dir) {
+            std::string current;
+            std::stringstream stream(dir);
+            std::string part;
+            if (!dir.empty() && dir[0] == '/')
+                current = "/";
+            while (std::getline(stream, part, '/')) {
+                if (part.empty())
+                    continue;
+                current += part + "/";
+                if (mkdir(current.c_str(), 0755) != 0 && errno != EEXIST)
+                    return false;
+            }
+            struct stat st{};
+            return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        }
+
+    }
+
+    LLMResponseCache::LLMResponseCache(std::string dir, size_t maxEntries, size_t maxBytes)
+            : _dir(std::move(dir)), _maxEntries(maxEntries), _maxBytes(maxBytes), _available(false),
+              _totalBytes(0), _clock(0), _hits(0), _misses(0) {
+        if (!this->_dir.empty() && this->_dir.back() == '/')
+            this->_dir.pop_back();
+        this->_available = makeDirs(this->_dir);
+        if (!this->_available) {
+            BLOGE("can't create llm cache directory %s", this->_dir.c_str());
+            return;
+        }
+        load();
+        evict();
+        BLOG("llm cache %s loaded, %zu entries, %zu bytes", this->_dir.c_str(),
+             this->_entries.size(), this->_totalBytes);
+    }
+
+    std::string LLMResponseCache::sha256Hex(const std::string &data) {
+        uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                             0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+        size_t length = data.size();
+        size_t offset = 0;
+        for (; offset + 64 <= length; offset += 64)
+            sha256Block(state, bytes + offset);
+
+        // padding: 0x80, zeros, then the bit length in big endian
+        unsigned char tail[128] = {0};
+        size_t rest = length - offset;
+        std::copy(bytes + offset, bytes + length, tail);
+        tail[rest] = 0x80;
+        size_t tailSize = rest + 1 + 8 <= 64 ? 64 : 128;
+        uint64_t bitLength = static_cast<uint64_t>(length) * 8;
+        for (int i = 0; i < 8; i++)
+            tail[tailSize - 1 - i] = static_cast<unsigned char>(bitLength >> (i * 8));
+        for (size_t i = 0; i < tailSize; i += 64)
+            sha256Block(state, tail + i);
+
+        static const char *hexDigits = "0123456789abcdef";
+        std::string hex(64, '0');
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++)
+                hex[i * 8 + j] = hexDigits[(state[i] >> (28 - j * 4)) & 0xf];
+        }
+        return hex;
+    }
+
+    std::string LLMResponseCache::makeKey(const std::vector<std::string> &parts) {
+        std::string material;
+        for (const auto &part: parts) {
+            material += std::to_string(part.size());
+            material += ':';
+            material += part;
+        }
+        return sha256Hex(material);
+    }
+
+    std::string LLMResponseCache::normalize(const std::string &text) {
+        std::string result;
+        result.reserve(text.size());
+        bool pendingSpace = false;
+        for (char c: text) {
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                pendingSpace = !result.empty();
+                continue;
+            }
+            if (pendingSpace)
+                result += ' ';
+            pendingSpace = false;
+            result += c;
+        }
+        return result;
+    }
+
+    std::string LLMResponseCache::pathOf(const std::string &key) const {
+        return this->_dir + "/" + key;
+    }
+
+    void LLMResponseCache::load() {
+        DIR *dir = opendir(this->_dir.c_str());
+        if (!dir)
+            return;
+        std::vector<std::pair<time_t, std::string>> files;
+        struct dirent *item;
+        while ((item = readdir(dir)) != nullptr) {
+            std::string name = item->d_name;
+            if (!isDigestName(name))
+                continue;
+            struct stat st{};
+            if (stat(pathOf(name).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+                continue;
+            files.emplace_back(st.st_mtime, name);
+            this->_entries[name] = Entry{static_cast<size_t>(st.st_size), 0};
+            this->_totalBytes += static_cast<size_t>(st.st_size);
+        }
+        closedir(dir);
+        std::sort(files.begin(), files.end());
+        for (const auto &file: files)
+            this->_entries[file.second].lastUsed = ++this->_clock;
+    }
+
+    void LLMResponseCache::remove(const std::string &key) {
+        auto found = this->_entries.find(key);
+        if (found == this->_entries.end())
+            return;
+        this->_totalBytes -= found->second.bytes;
+        this->_entries.erase(found);
+        std::remove(pathOf(key).c_str());
+    }
+
+    void LLMResponseCache::evict() {
+        if (this->_entries.size() <= this->_maxEntries && this->_totalBytes <= this->_maxBytes)
+            return;
+        std::vector<std::pair<uint64_t, std::string>> order;
+        order.reserve(this->_entries.size());
+        for (const auto &entry: this->_entries)
+            order.emplace_back(entry.second.lastUsed, entry.first);
+        std::sort(order.begin(), order.end());
+        for (const auto &victim: order) {
+            if (this->_entries.size() <= this->_maxEntries && this->_totalBytes <= this->_maxBytes)
+                break;
+            remove(victim.second);
+        }
+    }
+
+    bool LLMResponseCache::get(const std::string &key, std::string &value) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        auto found = this->_entries.find(key);
+        if (!this->_available || found == this->_entries.end()) {
+            this->_misses++;
+            return false;
+        }
+        std::ifstream in(pathOf(key), std::ios::in | std::ios::binary);
+        if (!in.is_open()) {
+            remove(key);
+            this->_misses++;
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        value = buffer.str();
+        found->second.lastUsed = ++this->_clock;
+        // keep the recency across runs
+        utime(pathOf(key).c_str(), nullptr);
+        this->_hits++;
+        return true;
+    }
+
+    void LLMResponseCache::put(const std::string &key, const std::string &value) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if (!this->_available || value.size() > this->_maxBytes)
+            return;
+        // write aside and rename, a crash never leaves a truncated entry behind
+        std::string path = pathOf(key);
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!out.is_open()) {
+                BLOGE("can't write llm cache entry %s", tmpPath.c_str());
+                return;
+            }
+            out << value;
+            if (!out.good()) {
+                out.close();
+                std::remove(tmpPath.c_str());
+                return;
+            }
+        }
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::remove(tmpPath.c_str());
+            return;
+        }
+        auto found = this->_entries.find(key);
+        if (found != this->_entries.end())
+            this->_totalBytes -= found->second.bytes;
+        this->_entries[key] = Entry{value.size(), ++this->_clock};
+        this->_totalBytes += value.size();
+        evict();
+    }
+
+    size_t LLMResponseCache::size() const {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        return this->_entries.size();
+    }
+
+    size_t LLMResponseCache::hits() const {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        return this->_hits;
+    }
+
+    size_t LLMResponseCache::misses() const {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        return this->_misses;
+    }
+
+}
+
+#endif
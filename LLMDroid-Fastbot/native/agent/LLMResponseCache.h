@@ -0,0 +1,81 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef LLMResponseCache_H_
+#define LLMResponseCache_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+
+namespace fastbotx {
+
+    /// On-disk cache of LLM answers, addressed by the SHA-256 of the question.
+    /// Every entry is one file named by its hex digest under the cache directory, so the cache
+    /// survives restarts of the test. When the entry count or the total size goes over the limits,
+    /// the least recently used entries are removed. Thread safe.
+    class LLMResponseCache {
+    public:
+        LLMResponseCache(std::string dir, size_t maxEntries, size_t maxBytes);
+
+        /// digest of the given parts, each part is length prefixed so that the concatenation is unambiguous
+        static std::string makeKey(const std::vector<std::string> &parts);
+
+        /// collapse every run of whitespace into a single space and trim both ends,
+        /// so that layout only differences of a description hit the same entry
+        static std::string normalize(const std::string &text);
+
+        static std::string sha256Hex(const std::string &data);
+
+        /// read the entry of key into value and mark it as the most recently used one
+        bool get(const std::string &key, std::string &value);
+
+        void put(const std::string &key, const std::string &value);
+
+        size_t size() const;
+
+        size_t hits() const;
+
+        size_t misses() const;
+
+        bool isAvailable() const { return this->_available; }
+
+    private:
+        struct Entry {
+            size_t bytes;
+            uint64_t lastUsed;
+        };
+
+        std::string _dir;
+        size_t _maxEntries;
+        size_t _maxBytes;
+        bool _available;
+
+        mutable std::mutex _mutex;
+        std::unordered_map<std::string, Entry> _entries;
+        size_t _totalBytes;
+        uint64_t _clock;
+        size_t _hits;
+        size_t _misses;
+
+        std::string pathOf(const std::string &key) const;
+
+        /// build the in memory index from the files left by former runs, ordered by their mtime
+        void load();
+
+        void evict();
+
+        void remove(const std::string &key);
+    };
+
+    typedef std::shared_ptr<LLMResponseCache> LLMResponseCachePtr;
+
+}
+
+#endif /* LLMResponseCache_H_ */
@@ -17,7 +17,9 @@
 #include <limits>
 #include <mutex>
 #include <utility>
+#include <algorithm>
 #include "ReuseState.h"
+#include "ActionFilter.h"
 
 
 namespace fastbotx {
@@ -73,23 +75,23 @@ namespace fastbotx {
         if (nullptr != this->_newState) {
             this->computeAlphaValue();
             const GraphPtr &graphRef = this->_model.lock()->getGraph();
-            auto visitedActivities = graphRef->getVisitedActivities(); // get the set of visited activities
+            const ActivityIndex &activityIndex = graphRef->getActivityIndex(); // the index of visited activities
             // get the last, or previous, action in the vector containing previous actions.
             ActivityStateActionPtr lastSelectedAction = std::dynamic_pointer_cast<ActivityStateAction>(
                     this->_previousActions.back());
             if (nullptr != lastSelectedAction) {
                 // Get the expectation of this action for accessing unvisited new activity.
                 rewardValue = this->probabilityOfVisitingNewActivities(lastSelectedAction,
-                                                                       visitedActivities);
+                                                                       activityIndex);
                 // If this is an action not in reuse model, this action is new and should definitely be used
                 if (std::abs(rewardValue - 0.0) < 0.0001)
                     rewardValue = 1.0; // Set the expectation of this action to 1
                 rewardValue = (rewardValue / sqrt(lastSelectedAction->getVisitedCount() + 1.0));
             }
             rewardValue = rewardValue + (this->getStateActionExpectationValue(this->_newState,
-                                                                              visitedActivities) /
+                                                                              activityIndex) /
                                          sqrt(this->_newState->getVisitedCount() + 1.0));
-            BLOG("total visited " ACTIVITY_VC_STR " count is %zu", visitedActivities.size());
+            BLOG("total visited " ACTIVITY_VC_STR " count is %zu", activityIndex.visitedCount());
         }
         BDLOG("reuse-cov-opti action reward=%f", rewardValue);
         this->_rewardCache.emplace_back(rewardValue);
@@ -101,45 +103,50 @@ namespace fastbotx {
     }
 
     /// Based on the reuse model, compute the probability of this current action visiting a unvisited activity,
-    /// which not in visitedActivities set. This value is the percentage of count of
-    /// activities that this state has not reached compared with the visitedActivities set.
+    /// which not visited in activityIndex. This value is the percentage of count of
+    /// activities that this state has not reached compared with the visited activities.
     /// \param action The chosen action in this state.
-    /// \param visitedActivities A string set, containing already visited activities.
-    /// \return percentage of count of activities that this state has not reached compared with the visitedActivities set.
+    /// \param activityIndex The activity index of the graph, telling which activities are already visited.
+    /// \return percentage of count of activities that this state has not reached compared with the visited activities.
     double
     ModelReusableAgent::probabilityOfVisitingNewActivities(const ActivityStateActionPtr &action,
-                                                           const stringPtrSet &visitedActivities) const {
+                                                           const ActivityIndex &activityIndex) const {
+        // find this action in this model according to its int hash
+        // according to the given action, get the activities that this action could reach in reuse model.
+        auto actionMapIterator = this->_reuseModelActivityIds.find(action->hash());
+        if (actionMapIterator == this->_reuseModelActivityIds.end())
+            return .0;
+        return probabilityOfVisitingNewActivities((*actionMapIterator).second, activityIndex);
+    }
+
+    double
+    ModelReusableAgent::probabilityOfVisitingNewActivities(const ReuseEntryIdVec &activityCounts,
+                                                           const ActivityIndex &activityIndex) {
         double value = .0;
         int total = 0;
         int unvisited = 0;
-        // find this action in this model according to its int hash
-        // according to the given action, get the activities that this action could reach in reuse model.
-        auto actionMapIterator = this->_reuseModel.find(action->hash());
-        if (actionMapIterator != this->_reuseModel.end()) {
-            // Iterate the map containing entry of activity name and visited count
-            // to ascertain the unvisited activity count according to the pre-saved reuse model
-            for (const auto &activityCountMapIterator: (*actionMapIterator).second) {
-                total += activityCountMapIterator.second;
-                stringPtr activity = activityCountMapIterator.first;
-                if (visitedActivities.find(activity) == visitedActivities.end()) {
-                    unvisited += activityCountMapIterator.second;
-                }
-            }
-            if (total > 0 && unvisited > 0) {
-                value = static_cast<double>(unvisited) / total;
+        // Iterate the pairs of activity id and visited count
+        // to ascertain the unvisited activity count according to the pre-saved reuse model
+        for (const auto &activityCount: activityCounts) {
+            total += activityCount.second;
+            if (!activityIndex.isVisited(activityCount.first)) {
+                unvisited += activityCount.second;
             }
         }
+        if (total > 0 && unvisited > 0) {
+            value = static_cast<double>(unvisited) / total;
+        }
         return value;
     }
 
     /// Return the expectation of reaching an unvisited activity after executing one of the action
     /// from this state. It estimate the expectation from the perspective of the whole state.
     /// @param state the newly reached state
-    /// @param visitedActivities the visited activity set AFTER reaching this state(the activity of this
+    /// @param activityIndex the visited activity index AFTER reaching this state(the activity of this
     ///         state is included)
     /// @return the expectation of this state reaching an unvisited activity after executing one of the action
     double ModelReusableAgent::getStateActionExpectationValue(const StatePtr &state,
-                                                              const stringPtrSet &visitedActivities) const {
+                                                              const ActivityIndex &activityIndex) const {
         double value = 0.0;
         for (const auto &action: state->getActions()) {
             uintptr_t actionHash = action->hash();
@@ -156,7 +163,7 @@ namespace fastbotx {
             // regardless of the back action
             // Expectation of reaching an unvisited activity.
             if (action->getTarget() != nullptr) {
-                value += probabilityOfVisitingNewActivities(action, visitedActivities);
+                value += probabilityOfVisitingNewActivities(action, activityIndex);
             }
         }
         return value;
@@ -229,6 +236,20 @@ namespace fastbotx {
             auto qValueReuseEntryIter = this->_reuseQValue.find(hash);
             this->_reuseQValue[hash] = modelAction->getQValue();
         }
+        // the activity of _newState has been interned by the graph already
+        auto modelPointer = this->_model.lock();
+        if (modelPointer) {
+            int activityId = modelPointer->getGraph()->internActivityId(*activity);
+            ReuseEntryIdVec &activityIds = this->_reuseModelActivityIds[hash];
+            auto idIter = std::find_if(activityIds.begin(), activityIds.end(),
+                                       [activityId](const std::pair<int, int> &entry) {
+                                           return entry.first == activityId;
+                                       });
+            if (idIter == activityIds.end())
+                activityIds.emplace_back(activityId, 1);
+            else
+                idIter->second += 1;
+        }
     }
 
     ActivityStateActionPtr ModelReusableAgent::selectNewActionEpsilonGreedyRandomly() const {
@@ -237,13 +258,12 @@ namespace fastbotx {
             return this->_newState->greedyPickMaxQValue(enableValidValuePriorityFilter);
         }
         BDLOG("%s", "Try to randomly select a value action.");
-        return this->_newState->randomPickAction(enableValidValuePriorityFilter);
+        return this->_newState->randomPickAction(enableValidValuePriorityFilter, this->_random);
     }
 
 
     bool ModelReusableAgent::eGreedy() const {
-        srand((uint32_t) (int) time(nullptr)); // @TODO the random range
-        auto r = static_cast<double>(static_cast<double>(rand() % 100 ) / 100.0L);
+        auto r = static_cast<double>(static_cast<double>(this->_random.nextInt(0, 100)) / 100.0L);
         if (r < this->_epsilon)
             return false;
         return true;
@@ -252,6 +272,8 @@ namespace fastbotx {
 
     ActionPtr ModelReusableAgent::selectNewAction() {
         ActionPtr action = nullptr;
+        // score every action once, all the following strategies select from this table
+        this->buildActionScoreTable();
         // use action->getVisitedCount() to check if an action is visited
         action = this->selectUnperformedActionNotInReuseModel();
         if (nullptr != action) {
@@ -265,7 +287,7 @@ namespace fastbotx {
             return action;
         }
 
-        action = this->_newState->randomPickUnvisitedAction();
+        action = this->selectUnvisitedAction();
         if (nullptr != action) {
             MLOG("select action in unvisited action");
             return action;
@@ -312,86 +334,97 @@ namespace fastbotx {
     /// use action->getVisitedCount() to check if an action is visited
     /// \return An action in this new state but not been performed before nor been recorded by Reuse Model
     ActionPtr ModelReusableAgent::selectUnperformedActionNotInReuseModel() const {
-        ActionPtr retAct = nullptr;
-        std::vector<ActionPtr> actionsNotInModel;
-        for (const auto &action: this->_newState->getActions()) {
-            bool matched = action->isModelAct() // should be one of aforementioned actions.
-                           && (this->_reuseModel.find(action->hash()) ==
-                               this->_reuseModel.end()) // this action should not be in reuse model
-                           && action->getVisitedCount() <=
-                              0; // find the action that not been explored before
-            if (matched) {
-                actionsNotInModel.emplace_back(action);
-            }
-        }
+        const ActionScoreTable &table = this->_scoreTable;
+        // should be one of aforementioned actions, not in reuse model and not been explored before
+        const uint8_t excluded = ActionScoreTable::InReuseModel | ActionScoreTable::Visited;
         // random by priority
-        int totalWeight = 0;
-        for (const auto &action: actionsNotInModel) {
-            totalWeight += action->getPriority();
-        }
+        int totalWeight = table.totalPriority(ActionScoreTable::ModelAct, excluded);
         if (totalWeight <= 0) {
             BDLOGE("%s", " total weights is 0");
             return nullptr;
         }
-        int randI = randomInt(0, totalWeight);
-        for (auto action: actionsNotInModel) {
-            if (randI < action->getPriority()) {
-                return action;
-            }
-            randI -= action->getPriority();
+        int randI = this->_random.nextInt(0, totalWeight);
+        int row = table.pickByPriority(ActionScoreTable::ModelAct, excluded, randI);
+        if (row < 0) {
+            BDLOGE("%s", " rand a null action");
+            return nullptr;
         }
-        BDLOGE("%s", " rand a null action");
-        return nullptr;
+        return table.action(row);
     }
 
     ActionPtr ModelReusableAgent::selectUnperformedActionInReuseModel() const {
+        const ActionScoreTable &table = this->_scoreTable;
         float maxValue = -MAXFLOAT;
         ActionPtr nextAction = nullptr;
         // use humble gumbel(http://amid.fish/humble-gumbel) to affect the sampling of actions from reuseModel
-        for (const auto &action: this->_newState->targetActions())  // except BACK/FEED/EVENT_SHELL actions. Only actions from  ActionType::CLICK to ActionType::SCROLL_BOTTOM_UP_N are allowed
-        {
-            uintptr_t actionHash = action->hash();
-            if (this->_reuseModel.find(actionHash) !=
-                this->_reuseModel.end()) // found this action in reuse model
+        // except BACK/FEED/EVENT_SHELL actions. Only actions from  ActionType::CLICK to ActionType::SCROLL_BOTTOM_UP_N are allowed
+        for (size_t row = 0; row < table.size(); row++) {
+            // found this action in reuse model, and in this state, it has not been performed in this round.
+            if (!table.matches(row, ActionScoreTable::RequireTarget | ActionScoreTable::InReuseModel,
+                               ActionScoreTable::Visited))
+                continue;
+            float qualityValue = table.newActivityProbability(row);
+            if (qualityValue >
+                1e-4) // quality value of candidate action should be larger than 0
             {
-                if (action->getVisitedCount() >
-                    0) // In this state, this action has just been performed in this round.
-                {
-                    BDLOG("%s", "action has been visited");
-                    continue;
-                }
-                auto modelPointer = this->_model.lock();
-                if (modelPointer) {
-                    const GraphPtr &graphRef = modelPointer->getGraph();
-                    auto visitedActivities = graphRef->getVisitedActivities();
-                    auto qualityValue = static_cast<float>(this->probabilityOfVisitingNewActivities(
-                            action,
-                            visitedActivities));
-                    if (qualityValue >
-                        1e-4) // quality value of candidate action should be larger than 0
-                    {
-                        // following code is for generating a random value to slight affect the quality value
-                        qualityValue = 10.0f * qualityValue;
-                        auto uniform = static_cast<float>(static_cast<float>(randomInt(0, 10)) /
-                                                          10.0f);
-                        // random value from uniform distribution should not be 0, or log function will return INF
-                        if (uniform < std::numeric_limits<float>::min())
-                            uniform = std::numeric_limits<float>::min();
-                        // add this random factor to quality value
-                        qualityValue -= log(-log(uniform));
-
-                        // choose the action with the maximum quality value
-                        if (qualityValue > maxValue) {
-                            maxValue = qualityValue;
-                            nextAction = action;
-                        }
-                    }
+                // following code is for generating a random value to slight affect the quality value
+                qualityValue = 10.0f * qualityValue;
+                auto uniform = static_cast<float>(static_cast<float>(this->_random.nextInt(0, 10)) /
+                                                  10.0f);
+                // random value from uniform distribution should not be 0, or log function will return INF
+                if (uniform < std::numeric_limits<float>::min())
+                    uniform = std::numeric_limits<float>::min();
+                // add this random factor to quality value
+                qualityValue -= log(-log(uniform));
+
+                // choose the action with the maximum quality value
+                if (qualityValue > maxValue) {
+                    maxValue = qualityValue;
+                    nextAction = table.action(row);
                 }
             }
         }
         return nextAction;
     }
 
+    /// Same as State::randomPickUnvisitedAction, but sampled from the score table
+    /// \return an enabled, valid and unvisited action by priority, or the back action if no one left
+    ActionPtr ModelReusableAgent::selectUnvisitedAction() const {
+        const ActionScoreTable &table = this->_scoreTable;
+        const uint8_t required = ActionScoreTable::Enabled | ActionScoreTable::Valid;
+        const uint8_t excluded = ActionScoreTable::Visited | ActionScoreTable::Back;
+        int total = table.totalPriority(required, excluded);
+        if (total > 0) {
+            int row = table.pickByPriority(required, excluded, this->_random.nextInt(0, total));
+            if (row >= 0)
+                return table.action(row);
+        }
+        ActivityStateActionPtr backAction = this->_newState->getBackAction();
+        if (backAction && enableValidUnvisitedFilter->include(backAction))
+            return backAction;
+        return nullptr;
+    }
+
+    void ModelReusableAgent::buildActionScoreTable() {
+        this->_scoreTable.clear();
+        if (nullptr == this->_newState)
+            return;
+        auto modelPointer = this->_model.lock();
+        if (!modelPointer)
+            return;
+        const ActivityIndex &activityIndex = modelPointer->getGraph()->getActivityIndex();
+        const ActivityStateActionPtrVec &actions = this->_newState->getActions();
+        this->_scoreTable.reserve(actions.size());
+        for (const auto &action: actions) {
+            // the only probe into the reuse model for this action in this step
+            auto iterator = this->_reuseModelActivityIds.find(action->hash());
+            bool inReuseModel = iterator != this->_reuseModelActivityIds.end();
+            float probability = inReuseModel ? static_cast<float>(
+                    probabilityOfVisitingNewActivities((*iterator).second, activityIndex)) : 0.0f;
+            this->_scoreTable.append(action, inReuseModel, probability);
+        }
+    }
+
     ActionPtr ModelReusableAgent::askGPTForAction() 
     {
         // 生成之前测试过程的flowchart
@@ -429,27 +462,24 @@ namespace fastbotx {
     /// its quality value and the uniform distribution
     /// \return the selected action with the highest quality value
     ActionPtr ModelReusableAgent::selectActionByQValue() {
+        const ActionScoreTable &table = this->_scoreTable;
         ActionPtr returnAction = nullptr;
         float maxQ = -MAXFLOAT;
-        const GraphPtr &graphRef = this->_model.lock()->getGraph();
-        auto visitedActivities = graphRef->getVisitedActivities();
-        for (auto action: this->_newState->getActions()) {
+        for (size_t row = 0; row < table.size(); row++) {
             double qv = 0.0;
-            uintptr_t actionHash = action->hash();
             // it won't happen, since if there is am unvisited action in state, it will be
             // visited before this method is called.
-            if (action->getVisitedCount() <= 0) {
-                auto iterator = this->_reuseModel.find(actionHash);
-                if (iterator != this->_reuseModel.end()) {
-                    qv += this->probabilityOfVisitingNewActivities(action, visitedActivities);
+            if (!table.matches(row, 0, ActionScoreTable::Visited)) {
+                if (table.matches(row, ActionScoreTable::InReuseModel)) {
+                    qv += table.newActivityProbability(row);
                 } else {
-                    BDLOG("qvalue pick return a action: %s", action->toString().c_str());
-                    return action;
+                    BDLOG("qvalue pick return a action: %s", table.action(row)->toString().c_str());
+                    return table.action(row);
                 }
             }
-            qv += getQValue(action);
+            qv += table.qValue(row);
             qv /= entropyAlpha;
-            float uniform = static_cast<float>(randomInt(0, 10)) /
+            float uniform = static_cast<float>(this->_random.nextInt(0, 10)) /
                             10.0f; // with this uniform distribution, add a little disturbance to the qv value
 
             // use the uniform distribution and humble gumbel to add some randomness to the qv value
@@ -459,7 +489,7 @@ namespace fastbotx {
             // choose the action with the highest qv value
             if (qv > maxQ) {
                 maxQ = static_cast<float >(qv);
-                returnAction = action;
+                returnAction = table.action(row);
             }
         }
         return returnAction; // return the action with the largest qv value
@@ -519,6 +549,14 @@ namespace fastbotx {
             this->_reuseModel.clear();
             this->_reuseQValue.clear();
         }
+        this->_reuseModelActivityIds.clear();
+        auto modelPointer = this->_model.lock();
+        if (!modelPointer) {
+            BLOG("%s", "model is released, skip loading reuse model");
+            delete[] modelFileData;
+            return;
+        }
+        const GraphPtr &graphRef = modelPointer->getGraph();
         auto reusedModelDataPtr = reuseFBModel->model();
         if (!reusedModelDataPtr) {
             BLOG("%s", "model data is null");
@@ -529,18 +567,23 @@ namespace fastbotx {
             uint64_t actionHash = reuseEntryInReuseModel->action();
             auto activityEntry = reuseEntryInReuseModel->targets();
             ReuseEntryM entryPtr;
+            ReuseEntryIdVec entryIds;
             for (int targetIndex = 0; targetIndex < activityEntry->size(); targetIndex++) {
                 auto targetEntry = activityEntry->Get(targetIndex);
                 BDLOG("load model hash: %llu %s %d", actionHash,
                       targetEntry->activity()->str().c_str(), (int) targetEntry->times());
-                entryPtr.insert(std::make_pair(
-                        std::make_shared<std::string>(targetEntry->activity()->str()),
-                        (int) targetEntry->times()));
+                // intern the activity, so that the loaded model shares the strings with the graph
+                int activityId = graphRef->internActivityId(targetEntry->activity()->str());
+                if (entryPtr.insert(std::make_pair(graphRef->getActivityIndex().name(activityId),
+                                                   (int) targetEntry->times())).second) {
+                    entryIds.emplace_back(activityId, (int) targetEntry->times());
+                }
             }
             if (!entryPtr.empty()) {
                 std::lock_guard<std::mutex> reuseGuard(this->_reuseModelLock);
 //            this->_reuseQValue.insert(std::make_pair(actionHash, reuseEntryInReuseModel->quality()));
                 this->_reuseModel.insert(std::make_pair(actionHash, entryPtr));
+                this->_reuseModelActivityIds.insert(std::make_pair(actionHash, entryIds));
             }
         }
         BLOG("loaded model contains actions: %zu", this->_reuseModel.size());
@@ -10,6 +10,7 @@
 #include "AbstractAgent.h"
 #include "State.h"
 #include "Action.h"
+#include "ActionScoreTable.h"
 #include <vector>
 #include <map>
 
@@ -23,6 +24,9 @@ namespace fastbotx {
     typedef std::map<stringPtr, int> ReuseEntryM;
     typedef std::map<uint64_t, ReuseEntryM> ReuseEntryIntMap;
     typedef std::map<uint64_t, double> ReuseEntryQValueMap;
+    // the same content as ReuseEntryM, with activities resolved to ids of the graph's ActivityIndex
+    typedef std::vector<std::pair<int, int>> ReuseEntryIdVec;
+    typedef std::map<uint64_t, ReuseEntryIdVec> ReuseEntryIdMap;
 
     class ModelReusableAgent : public AbstractAgent {
 
@@ -51,10 +55,13 @@ namespace fastbotx {
         ActionPtr selectNewAction() override;
 
         double probabilityOfVisitingNewActivities(const ActivityStateActionPtr &action,
-                                                  const stringPtrSet &visitedActivities) const;
+                                                  const ActivityIndex &activityIndex) const;
+
+        static double probabilityOfVisitingNewActivities(const ReuseEntryIdVec &activityCounts,
+                                                         const ActivityIndex &activityIndex);
 
         double getStateActionExpectationValue(const StatePtr &state,
-                                              const stringPtrSet &visitedActivities) const;
+                                              const ActivityIndex &activityIndex) const;
 
         virtual void updateReuseModel();
 
@@ -69,6 +76,12 @@ namespace fastbotx {
 
         ActionPtr selectActionByQValue();
 
+        /// Randomly choose an enabled, valid and unvisited action by priority, BACK as the last resort
+        ActionPtr selectUnvisitedAction() const;
+
+        /// Fill _scoreTable with the actions of _newState, called once at the beginning of selectNewAction
+        void buildActionScoreTable();
+
         ActionPtr askGPTForAction();
 
 
@@ -80,10 +93,15 @@ namespace fastbotx {
         std::vector<double> _rewardCache;
         std::vector<ActionPtr> _previousActions;
 
+        // scores of the actions of _newState in current step, rebuilt by buildActionScoreTable
+        ActionScoreTable _scoreTable;
+
     private:
         // A map containing entry of hash code of Action and map, which containing entry of name of activity that this
         // action goes to and the count of this very activity being visited.
         ReuseEntryIntMap _reuseModel;
+        // _reuseModel keyed by activity ids, only touched from the main thread, so it needs no lock
+        ReuseEntryIdMap _reuseModelActivityIds;
         ReuseEntryQValueMap _reuseQValue;
         std::string _modelSavePath;
         std::string _defaultModelSavePath;
@@ -0,0 +1,105 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef ModelRouter_CPP_
+#define ModelRouter_CPP_
+
+#include "ModelRouter.h"
+#include "Base.h"
+#include <sstream>
+
+namespace fastbotx {
+
+    int ModelRouter::addEndpoint(const std::string &name, const std::string &model, const std::string &baseUrl,
+                                 const std::string &apiKey, const RetryPolicy::Options &retryOptions) {
+        ModelEndpoint endpoint{name, model, std::make_shared<liboai::ChatCompletion>(),
+                               std::make_shared<RetryPolicy>(retryOptions)};
+        if (!baseUrl.empty()) {
+            endpoint.chat->set_base_url(baseUrl);
+        }
+        if (!apiKey.empty()) {
+            endpoint.chat->set_api_key(apiKey);
+        }
+        this->_endpoints.push_back(endpoint);
+        return static_cast<int>(this->_endpoints.size()) - 1;
+    }
+
+    int ModelRouter::findEndpoint(const std::string &name) const {
+        for (size_t i = 0; i < this->_endpoints.size(); i++) {
+            if (this->_endpoints[i].name == name)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    bool ModelRouter::isAvailable() const {
+        for (const ModelEndpoint &endpoint: this->_endpoints) {
+            if (!endpoint.retryPolicy->isOpen())
+                return true;
+        }
+        return false;
+    }
+
+    void ModelRouter::addRoute(const Route &route) {
+        if (!route.cascade.empty())
+            this->_routes.push_back(route);
+    }
+
+    double ModelRouter::failureRate(int endpoint, int type) const {
+        auto found = this->_outcomes.find({endpoint, type});
+        if (found == this->_outcomes.end() || found->second.recent.size() < this->_minSamples)
+            return 0;
+        return static_cast<double>(found->second.failures) / static_cast<double>(found->second.recent.size());
+    }
+
+    std::vector<int> ModelRouter::plan(int type, size_t promptTokens) {
+        for (const Route &route: this->_routes) {
+            if (!route.types.empty() && route.types.count(type) == 0)
+                continue;
+            if (route.maxPromptTokens > 0 && promptTokens > route.maxPromptTokens)
+                continue;
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            std::vector<int> cascade;
+            for (size_t i = 0; i < route.cascade.size(); i++) {
+                bool last = i + 1 == route.cascade.size();
+                if (last || failureRate(route.cascade[i], type) <= route.maxFailureRate)
+                    cascade.push_back(route.cascade[i]);
+            }
+            return cascade;
+        }
+        if (this->_endpoints.empty())
+            return {};
+        return {0};
+    }
+
+    void ModelRouter::recordOutcome(int endpoint, int type, bool valid) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        Outcomes &outcomes = this->_outcomes[{endpoint, type}];
+        outcomes.asked++;
+        outcomes.recent.push_back(!valid);
+        if (!valid)
+            outcomes.failures++;
+        if (outcomes.recent.size() > this->_window) {
+            if (outcomes.recent.front())
+                outcomes.failures--;
+            outcomes.recent.pop_front();
+        }
+    }
+
+    std::string ModelRouter::statistics() {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        std::stringstream ss;
+        for (const auto &it: this->_outcomes) {
+            ss << "[" << this->_endpoints[it.first.first].name << ", type " << it.first.second << "] "
+               << it.second.asked << " asked, " << it.second.failures << "/" << it.second.recent.size()
+               << " recent unreadable; ";
+        }
+        return ss.str();
+    }
+
+}
+
+#endif
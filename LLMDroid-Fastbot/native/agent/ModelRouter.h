@@ -0,0 +1,95 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef ModelRouter_H_
+#define ModelRouter_H_
+
+#include "liboai.h"
+#include "RetryPolicy.h"
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fastbotx {
+
+    /// one model behind one OpenAI compatible base url
+    struct ModelEndpoint {
+        std::string name;
+        std::string model;
+        std::shared_ptr<liboai::ChatCompletion> chat;
+        RetryPolicyPtr retryPolicy; // its own circuit and latencies, a failing endpoint doesn't stop the others
+    };
+
+    /**
+     * @brief Picks the models a question is asked, cheapest first.
+     *
+     * A route matches questions by type and prompt size and names a cascade of endpoints.
+     * The question goes to the first one, and on to the next when the answer can't be read.
+     * An endpoint whose recent answers to a type were unreadable too often is skipped for that type,
+     * the last one of a cascade is always asked.
+     * Questions no route matches go to the first endpoint, the one configured by Model and BaseUrl.
+     * Endpoints and routes are set up before the workers start, outcomes are recorded by them.
+     */
+    class ModelRouter {
+    public:
+        struct Route {
+            std::set<int> types; // empty: any
+            size_t maxPromptTokens = 0; // 0: any size
+            std::vector<int> cascade; // endpoint indices
+            double maxFailureRate = 0.3;
+        };
+
+        /// @return the index of the endpoint
+        int addEndpoint(const std::string &name, const std::string &model, const std::string &baseUrl,
+                        const std::string &apiKey, const RetryPolicy::Options &retryOptions);
+
+        /// -1 if there is no endpoint of that name
+        int findEndpoint(const std::string &name) const;
+
+        void addRoute(const Route &route);
+
+        const ModelEndpoint &endpoint(int index) const { return this->_endpoints[index]; }
+
+        size_t endpointCount() const { return this->_endpoints.size(); }
+
+        /// false while the circuit of every endpoint is open
+        bool isAvailable() const;
+
+        /// the endpoints to ask in turn, never empty once an endpoint has been added
+        std::vector<int> plan(int type, size_t promptTokens);
+
+        /// whether the answer of endpoint to a question of type could be read
+        void recordOutcome(int endpoint, int type, bool valid);
+
+        std::string statistics();
+
+    private:
+        struct Outcomes {
+            std::deque<bool> recent; // true: unreadable
+            int failures = 0;
+            int asked = 0;
+        };
+
+        const size_t _window = 20;
+        const size_t _minSamples = 5; // answers before an endpoint may be skipped
+
+        std::vector<ModelEndpoint> _endpoints;
+        std::vector<Route> _routes;
+        std::mutex _mutex;
+        std::map<std::pair<int, int>, Outcomes> _outcomes; // (endpoint, type)
+
+        double failureRate(int endpoint, int type) const;
+    };
+
+    typedef std::shared_ptr<ModelRouter> ModelRouterPtr;
+
+}
+
+#endif /* ModelRouter_H_ */
@@ -0,0 +1,122 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef PromptBuilder_CPP_
+#define PromptBuilder_CPP_
+
+#include "PromptBuilder.h"
+#include "prompt.h"
+#include <sstream>
+
+namespace fastbotx {
+
+    namespace {
+
+        std::string instructionsOf(PromptLayout layout)
+        {
+            switch (layout) {
+                case PromptLayout::OVERVIEW:
+                    return _functionExplanationPrompt + _inputExplanationPrompt_state + _requiredOutputPrompt_state2 +
+                           _requiredOutputPrompt_state_summary2 + _anwserFormatPrompt_state2;
+                case PromptLayout::OVERVIEW_TOP:
+                    return _functionExplanationPrompt + _inputExplanationPrompt_state + _requiredOutputPrompt_state3 +
+                           _requiredOutputPrompt_state_summary3 + _anwserFormatPrompt_state3;
+                case PromptLayout::OVERVIEW_BATCH:
+                    return _functionExplanationPrompt + _inputExplanationPrompt_state + _inputExplanationPrompt_stateBatch +
+                           _requiredOutputPrompt_state2 + _requiredOutputPrompt_state_summary2 +
+                           _anwserFormatPrompt_state2 + _anwserFormatPrompt_stateBatch2;
+                case PromptLayout::OVERVIEW_BATCH_TOP:
+                    return _functionExplanationPrompt + _inputExplanationPrompt_state + _inputExplanationPrompt_stateBatch +
+                           _requiredOutputPrompt_state3 + _requiredOutputPrompt_state_summary3 +
+                           _anwserFormatPrompt_state3 + _anwserFormatPrompt_stateBatch3;
+                case PromptLayout::GUIDE:
+                    return _inputExplanationPrompt_guide + _requiredOutputPrompt_guide_part1 +
+                           " they are listed in \"Tested Functions\" below." + _requiredOutputPrompt_guide_part2 +
+                           _answerFormatPrompt_guide;
+                case PromptLayout::TEST_FUNCTION:
+                    return _inputExplanationPrompt_functionTest + _requiredOutputPrompt_functionTest +
+                           _answerFormatPrompt_functionTest;
+                case PromptLayout::TEST_FUNCTION_EXECUTED:
+                    return _inputExplanationPrompt_functionTest + _requiredOutputPrompt_functionTest +
+                           _answerFormatPrompt_functionTest + _answerFormatPrompt_functionTestEmpty;
+                case PromptLayout::REANALYSIS:
+                    return inputExplanationReanalysis1 + inputExplanationReanalysis2 + requiredOutputReanalysis +
+                           answerFormatReanalysis;
+                default:
+                    return "";
+            }
+        }
+
+        /// prompt tokens served from the prefix cache, -1 if the server doesn't say
+        long cachedTokensOf(const nlohmann::json &usage)
+        {
+            // OpenAI, vLLM, llama.cpp
+            if (usage.contains("prompt_tokens_details") && usage["prompt_tokens_details"].is_object()) {
+                const nlohmann::json &details = usage["prompt_tokens_details"];
+                if (details.contains("cached_tokens") && details["cached_tokens"].is_number_integer()) {
+                    return details["cached_tokens"].get<long>();
+                }
+            }
+            // DeepSeek
+            if (usage.contains("prompt_cache_hit_tokens") && usage["prompt_cache_hit_tokens"].is_number_integer()) {
+                return usage["prompt_cache_hit_tokens"].get<long>();
+            }
+            return -1;
+        }
+
+    }
+
+    PromptBuilder::PromptBuilder(const std::string &runContext)
+    {
+        for (int i = 0; i < static_cast<int>(PromptLayout::COUNT); i++) {
+            this->_prefixes.push_back(instructionsOf(static_cast<PromptLayout>(i)) + "\n" + runContext);
+        }
+    }
+
+    std::string PromptBuilder::build(PromptLayout layout, const std::string &payload) const
+    {
+        const std::string &prefix = this->_prefixes[static_cast<int>(layout)];
+        std::string prompt;
+        prompt.reserve(prefix.size() + payload.size());
+        prompt.append(prefix).append(payload);
+        return prompt;
+    }
+
+    void PromptBuilder::recordUsage(int type, const nlohmann::json &usage)
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        Usage &total = this->_usage[type];
+        total.requests++;
+        if (!usage.is_object()) {
+            return;
+        }
+        long cached = cachedTokensOf(usage);
+        if (cached < 0 || !usage.contains("prompt_tokens") || !usage["prompt_tokens"].is_number_integer()) {
+            return;
+        }
+        total.reported++;
+        total.promptTokens += usage["prompt_tokens"].get<long>();
+        total.cachedTokens += cached;
+    }
+
+    std::string PromptBuilder::statistics() const
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        std::stringstream ss;
+        for (const auto &it: this->_usage) {
+            const Usage &total = it.second;
+            ss << "[type " << it.first << "] cached " << total.cachedTokens << "/" << total.promptTokens << " tokens";
+            if (total.promptTokens > 0) {
+                ss << " (" << 100 * total.cachedTokens / total.promptTokens << "%)";
+            }
+            ss << " in " << total.reported << "/" << total.requests << " requests; ";
+        }
+        return ss.str();
+    }
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef PromptBuilder_H_
+#define PromptBuilder_H_
+
+#include "../thirdpart/json/json.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fastbotx {
+
+    /// the fixed part of a prompt, one per question type and variant
+    enum class PromptLayout
+    {
+        OVERVIEW,                // one page, before the top list is maintained
+        OVERVIEW_TOP,            // one page, ranked with the top list
+        OVERVIEW_BATCH,          // several pages
+        OVERVIEW_BATCH_TOP,
+        GUIDE,
+        TEST_FUNCTION,           // first step of a function test
+        TEST_FUNCTION_EXECUTED,  // a later step asked without history, the function may be tested already
+        REANALYSIS,
+        COUNT
+    };
+
+    /**
+     * @brief Lays out every prompt as the instructions of its layout, then the context of this run, then the payload
+     * of the request. Servers that keep the KV cache of prompt prefixes (OpenAI, vLLM, llama.cpp...) reuse it only
+     * for identical bytes, so what never changes comes first and is rendered once.
+     * Also sums up the prompt tokens the server reports as read from its cache. Thread safe.
+     */
+    class PromptBuilder
+    {
+    public:
+        /// @param runContext the app under test, the same for every prompt of a run
+        explicit PromptBuilder(const std::string &runContext);
+
+        std::string build(PromptLayout layout, const std::string &payload) const;
+
+        /// @param type question type as the caller counts them, usage the usage field of the reply, may be null
+        void recordUsage(int type, const nlohmann::json &usage);
+
+        /// cached and total prompt tokens of each type
+        std::string statistics() const;
+
+    private:
+        struct Usage
+        {
+            size_t requests = 0;
+            size_t reported = 0; // requests whose usage told the cached tokens
+            long promptTokens = 0;
+            long cachedTokens = 0;
+        };
+
+        std::vector<std::string> _prefixes;
+        mutable std::mutex _mutex;
+        std::map<int, Usage> _usage;
+    };
+
+    typedef std::shared_ptr<PromptBuilder> PromptBuilderPtr;
+
+}
+
+#endif /* PromptBuilder_H_ */
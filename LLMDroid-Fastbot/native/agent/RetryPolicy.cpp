@@ -0,0 +1,105 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef RetryPolicy_CPP_
+#define RetryPolicy_CPP_
+
+#include "RetryPolicy.h"
+#include "Base.h"
+#include "utils.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace fastbotx {
+
+    RetryPolicy::RetryPolicy(const Options &options)
+            : _options(options), _circuit(Circuit::CLOSED), _consecutiveFailures(0), _probing(false),
+              _random(std::random_device{}()) {
+        this->_options.maxAttempts = std::max(1, this->_options.maxAttempts);
+        this->_options.breakerThreshold = std::max(1, this->_options.breakerThreshold);
+    }
+
+    bool RetryPolicy::allowRequest() {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        switch (this->_circuit) {
+            case Circuit::CLOSED:
+                return true;
+            case Circuit::OPEN:
+                if (Clock::now() - this->_openedAt < std::chrono::milliseconds(this->_options.breakerCooldownMs))
+                    return false;
+                this->_circuit = Circuit::HALF_OPEN;
+                this->_probing = true;
+                BLOG("llm circuit half open, probing");
+                return true;
+            case Circuit::HALF_OPEN:
+            default:
+                // one probe at a time
+                if (this->_probing)
+                    return false;
+                this->_probing = true;
+                return true;
+        }
+    }
+
+    void RetryPolicy::onSuccess(double latencyMs) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if (this->_circuit != Circuit::CLOSED)
+            BLOG("llm circuit closed");
+        this->_circuit = Circuit::CLOSED;
+        this->_consecutiveFailures = 0;
+        this->_probing = false;
+        this->_latencies.push_back(latencyMs);
+        if (this->_latencies.size() > this->_options.latencyWindow)
+            this->_latencies.pop_front();
+    }
+
+    void RetryPolicy::onFailure() {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_consecutiveFailures++;
+        if (this->_circuit == Circuit::HALF_OPEN ||
+            (this->_circuit == Circuit::CLOSED && this->_consecutiveFailures >= this->_options.breakerThreshold)) {
+            this->_circuit = Circuit::OPEN;
+            this->_openedAt = Clock::now();
+            this->_probing = false;
+            BLOGE("llm circuit open after %d failures, pause asking for %ld ms", this->_consecutiveFailures,
+                  this->_options.breakerCooldownMs);
+        }
+    }
+
+    long RetryPolicy::backoffMs(int attempt, long retryAfterMs) {
+        long ceiling = this->_options.baseDelayMs;
+        for (int i = 0; i < attempt && ceiling < this->_options.maxDelayMs; i++)
+            ceiling *= 2;
+        ceiling = std::min(ceiling, this->_options.maxDelayMs);
+        long delay;
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            delay = std::uniform_int_distribution<long>(0, std::max(0L, ceiling))(this->_random);
+        }
+        if (retryAfterMs >= 0)
+            delay = std::max(delay, std::min(retryAfterMs, this->_options.maxRetryAfterMs));
+        return delay;
+    }
+
+    long RetryPolicy::hedgeDelayMs() const {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if (this->_latencies.empty() || this->_latencies.size() < this->_options.hedgeMinSamples)
+            return -1;
+        std::vector<double> sorted(this->_latencies.begin(), this->_latencies.end());
+        size_t rank = static_cast<size_t>(this->_options.hedgePercentile * static_cast<double>(sorted.size() - 1));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return static_cast<long>(sorted[rank]);
+    }
+
+    bool RetryPolicy::isOpen() const {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        return this->_circuit == Circuit::OPEN &&
+               Clock::now() - this->_openedAt < std::chrono::milliseconds(this->_options.breakerCooldownMs);
+    }
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef RetryPolicy_H_
+#define RetryPolicy_H_
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+
+namespace fastbotx {
+
+    /// When and how long to wait before asking the model again, shared by all workers. Thread safe.
+    /// Retries back off exponentially with full jitter, unless the server sent a Retry-After.
+    /// After breakerThreshold failed attempts in a row the circuit opens: nothing is asked for
+    /// breakerCooldownMs, then a single probe decides whether it closes again.
+    /// The latencies of successful requests give the delay after which a slow request is hedged.
+    class RetryPolicy {
+    public:
+        struct Options {
+            int maxAttempts = 5;
+            long baseDelayMs = 1000;
+            long maxDelayMs = 30000;
+            long maxRetryAfterMs = 60000;
+            int breakerThreshold = 5;
+            long breakerCooldownMs = 60000;
+            double hedgePercentile = 0.95;
+            size_t hedgeMinSamples = 10; // don't hedge before this many latencies are known
+            size_t latencyWindow = 100;
+        };
+
+        explicit RetryPolicy(const Options &options);
+
+        /// false while the circuit is open, true for the one probe once the cooldown is over
+        bool allowRequest();
+
+        void onSuccess(double latencyMs);
+
+        void onFailure();
+
+        /// delay before the attempt after the given one (0 based), retryAfterMs < 0 if the server didn't ask for one
+        long backoffMs(int attempt, long retryAfterMs);
+
+        /// latency percentile of the recent successful requests, -1 if too few are known
+        long hedgeDelayMs() const;
+
+        /// the circuit is open and the cooldown isn't over, asking now would be refused
+        bool isOpen() const;
+
+        int maxAttempts() const { return this->_options.maxAttempts; }
+
+    private:
+        enum class Circuit {
+            CLOSED, OPEN, HALF_OPEN
+        };
+
+        typedef std::chrono::steady_clock Clock;
+
+        Options _options;
+        mutable std::mutex _mutex;
+        Circuit _circuit;
+        int _consecutiveFailures;
+        Clock::time_point _openedAt;
+        bool _probing;
+        std::deque<double> _latencies;
+        std::mt19937 _random;
+    };
+
+    typedef std::shared_ptr<RetryPolicy> RetryPolicyPtr;
+
+}
+
+#endif /* RetryPolicy_H_ */
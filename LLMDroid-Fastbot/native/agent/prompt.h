@@ -100,6 +100,49 @@ An example is given below, where "navigate to 'News'" and "navigate to 'My'" are
 }
 )";
 
+const std::string _inputExplanationPrompt_stateBatch = R"(
+This time I will provide the HTML descriptions of several pages, each in a block named after the page, such as "State12".
+Do the tasks below for every page on its own, using the element IDs of that page.
+)";
+
+const std::string _anwserFormatPrompt_stateBatch2 = R"(
+As there are several pages, put the answer for each page under "States", with the name of the page as the key. For example:
+{
+  "States": {
+    "State12": {
+      "Overview": "Main page of the app, providing buttons to navigate to other tabs, and functions for searching and playing videos.",
+      "Function List": {
+        "navigate to 'News'": 29,
+        ...
+      }
+    },
+    "State13": {
+      "Overview": "...",
+      "Function List": {...}
+    }
+  }
+}
+)";
+
+const std::string _anwserFormatPrompt_stateBatch3 = R"(
+As there are several pages, put the answer for each page under "States", with the name of the page as the key, and give one "Top5" for all of them. For example:
+{
+  "States": {
+    "State12": {
+      "Overview": "Main page of the app, providing buttons to navigate to other tabs, and functions for searching and playing videos.",
+      "Function List": {
+        "navigate to 'News'": 29,
+        ...
+      }
+    },
+    "State13": {
+      "Overview": "...",
+      "Function List": {...}
+    }
+  },
+  "Top5": [12, 3, 13, 7, 4]
+}
+)";
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -153,6 +196,11 @@ Each HTML element has the following attributes:
 id(the unique id of this component), class(the class name of this component), resource-id (the resource-id of this Android component), content-desc (the content description of this component), text (the text of this component), direction (if this component is scrollable, indicating its scroll direction), value (the text that has been input to the text box).
 )";
 
+const std::string _pageChangesPrompt_functionTest = R"(
+The app's current page is a variant of a page I described earlier in our conversation, the one with the same name as the block below.
+Every element of that page not listed as removed is still on the current page with the same id, added elements have new ids.
+)";
+
 const std::string _requiredOutputPrompt_functionTest = R"(
 What action should I perform next to test the target function?
 )";
@@ -232,6 +280,19 @@ An example is given below to demonstrate the situation that Control 5 has the fu
 )";
 
 
+//////////////////////////////////////////////////////////////////////////////
+// Fix JSON
+//////////////////////////////////////////////////////////////////////////////
+
+const std::string _fixJsonPrompt = R"(
+The text below was meant to be a single JSON object, but it is not valid JSON. It may be cut off at the end.
+Return only the corrected JSON object: keep every key and value that is complete, close anything left open, and drop a member that was cut off.
+The output should be pure json string starting with "{", NOT begin with "```json", and must not contain comments.
+
+```Broken JSON
+)";
+
+
 //const std::string StartPrompt = R"(I'm now testing an app called Souhu Video on android.
 //Sohu Video is a platform that provides a variety of video content, including news, entertainment, sports, movies, TV series, animation, cars, technology, etc. Users can watch, upload, search, comment, collect, and share videos online. They can also subscribe verified uploaders and popular topics.
 //)";
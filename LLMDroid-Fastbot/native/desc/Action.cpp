@@ -65,7 +65,18 @@ namespace fastbotx {
     }
 
     void Action::setPriority(int priority) {
+        if (this->_priority == priority)
+            return;
         this->_priority = priority;
+        this->onWeightChanged();
+    }
+
+    void Action::setQValue(double value) {
+        auto qValue = static_cast<float>(value);
+        if (this->_qValue == qValue)
+            return;
+        this->_qValue = qValue;
+        this->onWeightChanged();
     }
 
     std::string Action::toString() const {
@@ -75,12 +86,12 @@ namespace fastbotx {
         return strs.str();
     }
 
-    OperatePtr Action::toOperate() const {
+    OperatePtr Action::toOperate(RandomGenerator &random) const {
         OperatePtr opt = std::make_shared<DeviceOperateWrapper>();
         opt->act = this->_actionType;
         opt->aid = this->getId();
         if (this->_visitedCount <= 1) {
-            opt->throttle = static_cast<float>(randomInt(10, Action::_throttle));
+            opt->throttle = static_cast<float>(random.nextInt(10, Action::_throttle));
         }
         return opt;
     }
@@ -148,8 +159,8 @@ namespace fastbotx {
         this->_target = nullptr;
     }
 
-    OperatePtr ActivityStateAction::toOperate() const {
-        auto opt = Action::toOperate(); // call base virtual method
+    OperatePtr ActivityStateAction::toOperate(RandomGenerator &random) const {
+        auto opt = Action::toOperate(random); // call base virtual method
         opt->sid = this->getState().expired() ? "" : this->getState().lock()->getId();
         if (this->getTarget()) {
             opt->pos = *(this->getTarget()->getBounds());
@@ -284,8 +295,23 @@ namespace fastbotx {
         return className;
     }
 
+    void ActivityStateAction::setTarget(WidgetPtr widget) {
+        if (this->_target == widget)
+            return;
+        this->_target = std::move(widget);
+        this->onWeightChanged();
+    }
+
+    void ActivityStateAction::onWeightChanged() {
+        auto state = this->_state.lock();
+        if (state) {
+            state->markActionDirty(this->_indexInState);
+        }
+    }
+
     void ActivityStateAction::visit(time_t timestamp) {
         Node::visit(timestamp);
+        this->onWeightChanged();
         if (_functionListener) {
             _functionListener->onActionExecuted(shared_from_this());
         }
@@ -296,8 +322,8 @@ namespace fastbotx {
     }
 
     ActivityStateAction::ActivityStateAction(ActivityStateAction &other): Action(other),
-    _hashcode(other._hashcode), _whichWidget(other._whichWidget),
-    _functionListener(other._functionListener), _state(other._state), _target(other._target) {
+    _state(other._state), _target(other._target), _hashcode(other._hashcode),
+    _whichWidget(other._whichWidget), _indexInState(other._indexInState), _functionListener(other._functionListener) {
     }
 
 }
@@ -49,7 +49,8 @@ namespace fastbotx {
 
         virtual bool isValid() const;
 
-        virtual OperatePtr toOperate() const;
+        /// \param random used to jitter the throttle of the first visits
+        virtual OperatePtr toOperate(RandomGenerator &random) const;
 
         uintptr_t _hashcode{};
 
@@ -72,7 +73,7 @@ namespace fastbotx {
         virtual ~Action() = default;
 
 
-        virtual void setQValue(double value) { this->_qValue = static_cast<float>(value); }
+        virtual void setQValue(double value);
 
         virtual double getQValue() const { return this->_qValue; }
 
@@ -89,6 +90,9 @@ namespace fastbotx {
         void setInputText(std::string text) { _inputText = text; }
 
     protected:
+        /// called when the priority, the q value or the visited count changes,
+        /// so that the owner can refresh its cached sampling weights
+        virtual void onWeightChanged() {}
 
         ActionType _actionType;
         static int _throttle;
@@ -137,10 +141,10 @@ class ActivityStateAction : public Action, public std::enable_shared_from_this<A
 
         bool isValid() const override;
 
-        // set target widget without updating hash code
-        void setTarget(WidgetPtr widget) { this->_target = std::move(widget); }
+        // set target widget without updating hash code, the validity cached by the state's sampler is refreshed
+        void setTarget(WidgetPtr widget);
 
-        OperatePtr toOperate() const override;
+        OperatePtr toOperate(RandomGenerator &random) const override;
 
 
         // from ResolveNode
@@ -174,9 +178,18 @@ class ActivityStateAction : public Action, public std::enable_shared_from_this<A
 
         void setListener(FunctionListenerPtr listener);
 
+        /// position of this action in State::getActions(), assigned by the state
+        void setIndexInState(int index) { _indexInState = index; }
+
+        int getIndexInState() const { return _indexInState; }
+
     protected:
         ActivityStateAction();
+
+        void onWeightChanged() override;
+
         int _whichWidget = -1;
+        int _indexInState = -1;
         FunctionListenerPtr _functionListener = nullptr;
 
     private:
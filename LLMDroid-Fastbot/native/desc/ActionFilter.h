@@ -23,6 +23,10 @@ namespace fastbotx {
             return action->getPriority();
         }
 
+        /// true if include() and getPriority() only depend on the action itself,
+        /// which lets a state cache the weights and refresh just the changed actions
+        virtual bool isStable() const { return true; }
+
         virtual ~ActionFilter() = default;
     };
 
@@ -64,6 +68,9 @@ namespace fastbotx {
     class ActionFilterValidUnSaturated : public ActionFilter {
     public:
         bool include(ActivityStateActionPtr action) const override;
+
+        // saturation depends on the visits of the merged widgets of other actions
+        bool isStable() const override { return false; }
     };
 
     class ActionFilterValidValuePriority : public ActionFilter {
@@ -11,6 +11,7 @@
 #include "Element.h"
 #include "../thirdpart/tinyxml2/tinyxml2.h"
 #include "../thirdpart/json/json.hpp"
+#include <cstring>
 
 
 namespace fastbotx {
@@ -505,7 +506,7 @@ namespace fastbotx {
     }
 
     std::string
-    Element::toHTML(const std::vector<ElementPtr> &elementToMerge, bool noChild, int actionId) {
+    Element::toHTML(const std::vector<ElementPtr> &elementToMerge, bool noChild, int actionId, bool compact) {
         std::stringstream infoStr;
 
         HTML_CLASS html_class = getHtmlClass();
@@ -518,7 +519,13 @@ namespace fastbotx {
 
         // Get the view type based on class name
         std::string className = getClassnameTrunc();
-        if (!className.empty()) {
+        if (compact) {
+            className = compactClassname(className, html_class);
+            if (!className.empty()) {
+                infoStr << "class=\"" << className << "\" ";
+            }
+        }
+        else if (!className.empty()) {
             infoStr << "class=\"" << className << "\" ";
         }
         else {
@@ -583,5 +590,28 @@ namespace fastbotx {
 
         return infoStr.str();
     }
+
+    std::string Element::compactClassname(const std::string &classnameTrunc, HTML_CLASS html_class) {
+        std::string name = classnameTrunc;
+        for (const char *prefix: {"AppCompat", "Material"}) {
+            size_t length = strlen(prefix);
+            if (name.size() > length && name.compare(0, length, prefix) == 0) {
+                name = name.substr(length);
+                break;
+            }
+        }
+        // containers say nothing about what a control does
+        const std::string layout = "Layout";
+        if (name == "View" || name == "ViewGroup" ||
+            (name.size() >= layout.size() && name.compare(name.size() - layout.size(), layout.size(), layout) == 0)) {
+            return "";
+        }
+        // in HTML_TABLE order
+        static const char *defaultClass[] = {"Button", "CheckBox", "ScrollView", "EditText", "TextView"};
+        if (name == defaultClass[html_class]) {
+            return "";
+        }
+        return name;
+    }
 }
 #endif //Element_CPP_
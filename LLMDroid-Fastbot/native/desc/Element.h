@@ -160,7 +160,14 @@ namespace fastbotx {
 
         HTML_CLASS getHtmlClass();
 
-        std::string toHTML(const std::vector<ElementPtr>& elementToMerge, bool noChild, int actionId = -1);
+        /**
+         * @param compact leave out class names that tell the model nothing: layouts, and the default view of the tag
+         */
+        std::string toHTML(const std::vector<ElementPtr>& elementToMerge, bool noChild, int actionId = -1,
+                           bool compact = false);
+
+        /// class name for a compact description, empty if it is not worth the tokens
+        static std::string compactClassname(const std::string& classnameTrunc, HTML_CLASS html_class);
 
         std::string getHtmlSpecialAttribute(HTML_CLASS html_class);
 
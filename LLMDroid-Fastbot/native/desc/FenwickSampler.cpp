@@ -0,0 +1,55 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef FenwickSampler_CPP_
+#define FenwickSampler_CPP_
+
+#include "FenwickSampler.h"
+
+namespace fastbotx {
+
+    void FenwickSampler::reset(size_t size) {
+        this->_weights.assign(size, 0);
+        this->_tree.assign(size + 1, 0);
+        this->_total = 0;
+        this->_mask = 1;
+        while (this->_mask <= size)
+            this->_mask <<= 1;
+        this->_mask >>= 1;
+    }
+
+    bool FenwickSampler::set(size_t index, int weight) {
+        if (weight < 0)
+            weight = 0;
+        long delta = (long) weight - this->_weights[index];
+        if (delta == 0)
+            return false;
+        this->_weights[index] = weight;
+        this->_total += delta;
+        for (size_t i = index + 1; i < this->_tree.size(); i += i & (~i + 1)) {
+            this->_tree[i] += delta;
+        }
+        return true;
+    }
+
+    int FenwickSampler::find(long target) const {
+        if (target < 0 || target >= this->_total)
+            return -1;
+        // descend from the highest bit, pos ends as the count of slots whose prefix sum <= target
+        size_t pos = 0;
+        for (size_t step = this->_mask; step > 0; step >>= 1) {
+            size_t next = pos + step;
+            if (next < this->_tree.size() && this->_tree[next] <= target) {
+                pos = next;
+                target -= this->_tree[next];
+            }
+        }
+        return (int) pos;
+    }
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef FenwickSampler_H_
+#define FenwickSampler_H_
+
+#include <vector>
+#include <cstddef>
+
+namespace fastbotx {
+
+    /// Weighted sampler over a fixed number of slots, backed by a Fenwick (binary indexed) tree.
+    /// Updating the weight of one slot and locating a sample are both O(log n).
+    class FenwickSampler {
+    public:
+        FenwickSampler() : _total(0), _mask(0) {}
+
+        /// drop all the weights and resize to size slots of weight 0
+        void reset(size_t size);
+
+        size_t size() const { return this->_weights.size(); }
+
+        /// set the weight of slot index, negative weights are stored as 0
+        /// \return true if the weight actually changed
+        bool set(size_t index, int weight);
+
+        int weight(size_t index) const { return this->_weights[index]; }
+
+        /// sum of all the weights
+        long total() const { return this->_total; }
+
+        /// find the slot covering target in the prefix sums, i.e. the smallest index whose
+        /// inclusive prefix sum is greater than target
+        /// \param target should be in [0, total())
+        /// \return the slot index, or -1 if target is out of range
+        int find(long target) const;
+
+    private:
+        std::vector<int> _weights;
+        std::vector<long> _tree;    // 1-based
+        long _total;
+        size_t _mask;               // highest power of two not greater than size
+    };
+
+}
+
+#endif /* FenwickSampler_H_ */
@@ -71,7 +71,7 @@ namespace fastbotx {
         _next.insert(state);
     }
 
-    std::string MergedState::stateDescription()
+    std::string MergedState::stateDescription(size_t tokenBudget)
     {
         // lock
         std::lock_guard<std::mutex> lock(_mergedStateMutex);
@@ -79,7 +79,7 @@ namespace fastbotx {
         std::stringstream ss;
         //ss << "[Root State" << _root->getIdi() << "]:\n";
         ss << "[Activity: " << *(_root->getActivityString()) << "]\n";
-        ss << _root->getStateDescription();
+        ss << _root->getCompactDescription(tokenBudget);
         /*for (ReuseStatePtr state: _states)
         {
             if (state != _root) {
@@ -371,6 +371,8 @@ namespace fastbotx {
     }
 
     void MergedState::writeOverviewAndTop5Tojson(nlohmann::ordered_json &top5, bool ignoreImportance) {
+        // another child thread may be updating this state from an answer
+        std::lock_guard<std::mutex> lock(_mergedStateMutex);
         std::string key = "State" + std::to_string(_id);
         top5[key]["Overview"] = _overview;
         auto sortedFunctions = sortFunctionsByValue(ignoreImportance);
@@ -446,8 +448,9 @@ namespace fastbotx {
     }
 
     bool MergedState::hasUntestedFunctions() {
-        // when ask for guiding, main thread is blocked
-        // so there is no need to lock _functionList
+        // read by the child thread asking for guiding,
+        // while another child thread may be updating this state from an answer
+        std::lock_guard<std::mutex> lock(_mergedStateMutex);
         bool flag = false;
         for (auto it: _functionList) {
             if (it.second.importance > 0) {
@@ -490,6 +493,11 @@ namespace fastbotx {
         return _needReanalysed;
     }
 
+    bool MergedState::hasOverview() {
+        std::lock_guard<std::mutex> lock(_mergedStateMutex);
+        return !_overview.empty();
+    }
+
 
 
     /////////////////////////////////////////
@@ -623,11 +631,14 @@ namespace fastbotx {
     }
 
     ReuseStatePtr MergedState::getTargetState(std::string function) {
-        if (_functionList.find(function) != _functionList.end()) {
-            return _functionList[function].state;
+        // called by the main thread, a child thread may be updating the function list from an answer
+        std::lock_guard<std::mutex> lock(_mergedStateMutex);
+        auto found = _functionList.find(function);
+        if (found != _functionList.end()) {
+            return found->second.state;
         }
         else {
-            callJavaLogger(CHILD_THREAD, "function{%s} doesn't belong to any state in MergedState{%d}", function.c_str(), _id);
+            callJavaLogger(MAIN_THREAD, "function{%s} doesn't belong to any state in MergedState{%d}", function.c_str(), _id);
             return nullptr;
         }
     }
@@ -98,7 +98,7 @@ namespace fastbotx {
         MergedStateGraphEdgePtr getUnvisitedEdge();
         
         // call from child thread
-        std::string stateDescription();
+        std::string stateDescription(size_t tokenBudget);
         // call from child thread
         std::string walk();
         // call from child thread
@@ -175,6 +175,9 @@ namespace fastbotx {
 
         bool needReanalysed();
 
+        /// the overview has been answered
+        bool hasOverview();
+
         ReuseStatePtr getTargetState(std::string function);
 
     private:
@@ -143,6 +143,7 @@ namespace fastbotx {
         //     widget->clearDetails();
         // }
         this->_mergedWidgets.clear();
+        this->invalidateActionSamplers();
         _hasNoDetail = true;
     }
 
@@ -173,6 +174,7 @@ namespace fastbotx {
             }
 
         }
+        this->invalidateActionSamplers();
         _hasNoDetail = false;
     }
 
@@ -232,19 +234,85 @@ namespace fastbotx {
         return retA;
     }
 
-    ActivityStateActionPtr State::randomPickAction(const ActionFilterPtr &filter) const {
-        return this->randomPickAction(filter, true);
+    ActivityStateActionPtr
+    State::randomPickAction(const ActionFilterPtr &filter, RandomGenerator &random) const {
+        return this->randomPickAction(filter, true, random);
     }
 
     ActivityStateActionPtr
-    State::randomPickAction(const ActionFilterPtr &filter, bool includeBack) const {
-        int total = this->countActionPriority(filter, includeBack);
-        if (total == 0)
+    State::randomPickAction(const ActionFilterPtr &filter, bool includeBack,
+                            RandomGenerator &random) const {
+        if (!filter->isStable()) {
+            int total = this->countActionPriority(filter, includeBack);
+            if (total <= 0)
+                return nullptr;
+            int index = random.nextInt(0, total);
+            return pickAction(filter, includeBack, index);
+        }
+        const FenwickSampler &sampler = this->syncActionSampler(filter, includeBack);
+        long total = sampler.total();
+        if (total <= 0)
+            return nullptr;
+        int index = sampler.find(random.nextLong(total));
+        if (index < 0) {
+            BDLOG("%s", "ERROR: action sampler is out of range");
             return nullptr;
-        srand((uint32_t) (int) time(
-                nullptr)); //// this->_hashcode); // srand with hash, one sequence
-        int index = rand() % total;
-        return pickAction(filter, includeBack, index);
+        }
+        return this->_actions[index];
+    }
+
+    int State::actionWeight(const ActionFilterPtr &filter, bool includeBack, size_t index) const {
+        const ActivityStateActionPtr &action = this->_actions[index];
+        if (!includeBack && action->isBack())
+            return 0;
+        if (!filter->include(action))
+            return 0;
+        int fp = filter->getPriority(action);
+        if (fp <= 0) {
+            BDLOG("Error: Action should has a positive priority, but we get %d", fp);
+            return 0;
+        }
+        return fp;
+    }
+
+    const FenwickSampler &
+    State::syncActionSampler(const ActionFilterPtr &filter, bool includeBack) const {
+        ActionSamplerCache &cache = this->_actionSamplers[std::make_pair(filter.get(), includeBack)];
+        if (cache.stale || cache.sampler.size() != this->_actions.size()) {
+            cache.sampler.reset(this->_actions.size());
+            for (size_t i = 0; i < this->_actions.size(); i++) {
+                this->_actions[i]->setIndexInState((int) i);
+                cache.sampler.set(i, actionWeight(filter, includeBack, i));
+            }
+            cache.stale = false;
+        } else {
+            // only refresh the actions touched since the last sync of this sampler
+            for (size_t k = cache.cursor; k < this->_dirtyActions.size(); k++) {
+                size_t i = (size_t) this->_dirtyActions[k];
+                if (i < this->_actions.size())
+                    cache.sampler.set(i, actionWeight(filter, includeBack, i));
+            }
+        }
+        cache.cursor = this->_dirtyActions.size();
+        return cache.sampler;
+    }
+
+    void State::markActionDirty(int index) {
+        if (index < 0 || this->_actionSamplers.empty())
+            return;
+        this->_dirtyActions.push_back(index);
+        // the log is shared by all the samplers, once it grows larger than a full rebuild, start over
+        if (this->_dirtyActions.size() > 2 * this->_actions.size() + 16) {
+            this->invalidateActionSamplers();
+        }
+    }
+
+    void State::invalidateActionSamplers() {
+        for (auto &cache: this->_actionSamplers) {
+            cache.second.stale = true;
+            cache.second.cursor = 0;
+        }
+        this->_dirtyActions.clear();
     }
 
     ActivityStateActionPtr
@@ -265,8 +333,8 @@ namespace fastbotx {
         return nullptr;
     }
 
-    ActivityStateActionPtr State::randomPickUnvisitedAction() const {
-        ActivityStateActionPtr action = this->randomPickAction(enableValidUnvisitedFilter, false);
+    ActivityStateActionPtr State::randomPickUnvisitedAction(RandomGenerator &random) const {
+        ActivityStateActionPtr action = this->randomPickAction(enableValidUnvisitedFilter, false, random);
         if (action == nullptr && enableValidUnvisitedFilter->include(getBackAction())) {
             action = getBackAction();
         }
@@ -25,7 +25,9 @@
 #include "Widget.h"
 #include "Element.h"
 #include "ActionFilter.h"
+#include "FenwickSampler.h"
 #include <vector>
+#include <map>
 
 
 namespace fastbotx {
@@ -55,9 +57,9 @@ namespace fastbotx {
 
         ActivityStateActionPtr greedyPickMaxQValue(const ActionFilterPtr &filter) const;
 
-        ActivityStateActionPtr randomPickUnvisitedAction() const;
+        ActivityStateActionPtr randomPickUnvisitedAction(RandomGenerator &random) const;
 
-        ActivityStateActionPtr randomPickAction(const ActionFilterPtr &filter) const;
+        ActivityStateActionPtr randomPickAction(const ActionFilterPtr &filter, RandomGenerator &random) const;
 
         ActivityStateActionPtr resolveAt(ActivityStateActionPtr action, time_t t);
 
@@ -67,6 +69,9 @@ namespace fastbotx {
 
         void setPriority(int p) { this->_priority = p; }
 
+        /// record that the sampling weight of the action at index may have changed
+        void markActionDirty(int index);
+
         bool operator<(const State &state) const;
 
         bool operator==(const State &state) const;
@@ -99,9 +104,10 @@ namespace fastbotx {
         ///
         /// \param filter
         /// \param includeBack
+        /// \param random
         /// \return
         ActivityStateActionPtr
-        randomPickAction(const ActionFilterPtr &filter, bool includeBack) const;
+        randomPickAction(const ActionFilterPtr &filter, bool includeBack, RandomGenerator &random) const;
 
         ///
         /// \param filter
@@ -111,6 +117,16 @@ namespace fastbotx {
         ActivityStateActionPtr
         pickAction(const ActionFilterPtr &filter, bool includeBack, int index) const;
 
+        /// Return the sampler of the given filter, with the weights of the dirty actions refreshed
+        /// \param filter should be stable
+        /// \param includeBack
+        /// \return the sampler, one slot per action in _actions
+        const FenwickSampler &syncActionSampler(const ActionFilterPtr &filter, bool includeBack) const;
+
+        int actionWeight(const ActionFilterPtr &filter, bool includeBack, size_t index) const;
+
+        void invalidateActionSamplers();
+
 
         uintptr_t _hashcode{}; //
         stringPtr _activity; //
@@ -122,6 +138,16 @@ namespace fastbotx {
         bool _hasNoDetail; //
         static RectPtr _sameRootBounds; //
         ActivityStateActionPtr _backAction; //
+
+        struct ActionSamplerCache {
+            FenwickSampler sampler;
+            size_t cursor = 0;      // entries of _dirtyActions before cursor are already applied
+            bool stale = true;
+        };
+        // one sampler for each filter and includeBack pair, built on first use
+        mutable std::map<std::pair<const ActionFilter *, bool>, ActionSamplerCache> _actionSamplers;
+        // indexes of actions whose weight may have changed, shared by all the samplers
+        mutable std::vector<int> _dirtyActions;
     private:
         static std::shared_ptr<State> create(ElementPtr elem, stringPtr activityName);
 
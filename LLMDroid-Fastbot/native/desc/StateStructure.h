@@ -3,6 +3,7 @@
 
 #include "Element.h"
 #include <stack>
+#include <mutex>
 
 namespace fastbotx {
 
@@ -16,6 +17,24 @@ namespace fastbotx {
          */
         std::string generateStateDescription(int id);
 
+        /**
+         * @brief A shorter description for prompts, kept within tokenBudget (see estimate_tokens).
+         * Non-interactive wrappers without text are left out and their children move up, a run of
+         * structurally identical siblings keeps its first item as an exemplar and the others as one line items,
+         * and class names that tell nothing are dropped.
+         * While it is over the budget the least valuable lines go first: repeated items, then plain text,
+         * then controls, the deepest and latest first. The items of a run left out are counted in their place.
+         * Element ids are the same as in generateStateDescription.
+         */
+        std::string generateCompactDescription(size_t tokenBudget);
+
+        /**
+         * @brief Ids of the elements the last compact description shows, on a line of their own,
+         * in the text of their parent's line or folded into a run item.
+         * @return false if it has not been generated or lines were left out to fit the budget
+         */
+        bool getDescribedIds(std::set<int>& ids);
+
         const ElementPtr findElement(const uintptr_t target);
 
         void addChildElement(ElementPtr child);
@@ -44,7 +63,40 @@ namespace fastbotx {
         */
         ElementPtr findElementById(int id);
 
+        /// every element of the page, in the order of their ids
+        std::vector<ElementPtr> getElementsInIdOrder();
+
     private:
+        /// a node of the compact description
+        struct DescNode {
+            ElementPtr element;
+            std::vector<ElementPtr> merged;
+            std::vector<DescNode> children;
+            int runIndex = 0; // > 0: a later item of a run of identical siblings, written on one line
+            bool inRun = false;
+            bool wrapper = false; // a P with no text, its children take its place unless it is an item of a run
+        };
+
+        /// a line of the compact description, in document order
+        struct DescLine {
+            std::string open;
+            std::string close; // end tag of a container, empty for a leaf whose open line holds it
+            int depth = 0;
+            int parent = -1;
+            size_t end = 0; // one past the last line of the subtree
+            int children = 0; // children not removed
+            double value = 0; // lines of lower value are removed first
+            bool runItem = false;
+            bool removed = false;
+            std::vector<int> ids; // elements the line shows
+        };
+
+        std::mutex _descriptionMutex;
+        std::string _compactDescription;
+        size_t _compactBudget = 0;
+        std::set<int> _describedIds;
+        bool _compactTrimmed = false;
+
         std::string _stateDescription;
         std::stack<ElementPtr> _stack;
         // Record the depth of recursive traversal, used to represent the structure between components
@@ -68,6 +120,35 @@ namespace fastbotx {
          */
         std::string generateActionList(const ElementPtr target);
 
+        /**
+         * Split the children of element into the ones whose text goes into its line and the ones described on their own
+         * @param mergeAmongMany also merge text leaves of a button with several children, done for the root
+         */
+        void splitChildren(const ElementPtr& element, bool mergeAmongMany,
+                           std::vector<ElementPtr>& elementToMerge, std::vector<ElementPtr>& elementNotMerge);
+
+        void buildDescNodes(const std::vector<ElementPtr>& elements, int depth, std::vector<DescNode>& out);
+
+        /// mark the runs among nodes, then replace the wrappers that are not run items by their children
+        void collapseRuns(std::vector<DescNode>& nodes);
+
+        /// mark the runs of nodes not in a run yet
+        static void markRuns(std::vector<DescNode>& nodes);
+
+        static std::string signatureOf(const DescNode& node);
+
+        /// text of node and all its descendants for a one line item, descendants that can be acted on keep their tag and id
+        static void foldText(const DescNode& node, std::string& text);
+
+        /// ids of node, its merged text and all its descendants
+        static void collectIds(const DescNode& node, std::vector<int>& ids);
+
+        static void appendDescLines(const DescNode& node, int depth, int parent, std::vector<DescLine>& lines);
+
+        static size_t tokensOf(const DescLine& line);
+
+        static void renderDescLine(const std::vector<DescLine>& lines, size_t index, std::string& out);
+
         void addTab();
         
     };
@@ -1,4 +1,5 @@
 #include "StateStructure.h"
+#include <queue>
 
 namespace fastbotx {
 
@@ -78,30 +79,33 @@ namespace fastbotx {
         return (found != _elements.end()) ? *found : nullptr;
     }
 
-    std::string StateStructure::generateStateDescription(int id)
+    std::vector<ElementPtr> StateStructure::getElementsInIdOrder()
     {
-        if (!_stateDescription.empty()) { return _stateDescription; }
-        // begining of a state
-        int actionId = 0;
-        this->tabCount = 0;
-        this->_stateDescription = "";
-        std::vector<ElementPtr> elementToMerge;
-        std::vector<ElementPtr> elementNotMerge;
-        std::vector<ElementPtr> checkList(1, _rootElement);
+        std::vector<ElementPtr> elements(_elements.begin(), _elements.end());
+        std::sort(elements.begin(), elements.end(), [](const ElementPtr& a, const ElementPtr& b) {
+            return a->getId() < b->getId();
+        });
+        return elements;
+    }
+
+    void StateStructure::splitChildren(const ElementPtr& element, bool mergeAmongMany,
+                                       std::vector<ElementPtr>& elementToMerge, std::vector<ElementPtr>& elementNotMerge)
+    {
+        std::vector<ElementPtr> checkList(1, element);
         while (!checkList.empty()) {
-            ElementPtr element = checkList[0];
+            ElementPtr current = checkList[0];
             checkList.erase(checkList.begin());
-            std::vector<ElementPtr> children = element->getChildren();
-            //callJavaLogger(MAIN_THREAD, "element to check: %s, child size: %d", element->toHTML().c_str(), children.size());
+            std::vector<ElementPtr> children = current->getChildren();
+            //callJavaLogger(MAIN_THREAD, "element to check: %s, child size: %d", current->toHTML().c_str(), children.size());
             if (children.size() == 1 && children[0]->getHtmlClass() == HTML_CLASS::P) {
                 //callJavaLogger(MAIN_THREAD, "merge element above's child");
                 elementToMerge.push_back(children[0]);
                 checkList.push_back(children[0]);
             }
             else {
-                for (const auto& child : element->getChildren())
+                for (const auto& child : children)
                 {
-                    if (shouldMerge(element, child)) {
+                    if ((mergeAmongMany || children.size() <= 1) && shouldMerge(current, child)) {
                         elementToMerge.push_back(child);
                     }
                     else {
@@ -110,6 +114,19 @@ namespace fastbotx {
                 }
             }
         }
+    }
+
+    std::string StateStructure::generateStateDescription(int id)
+    {
+        std::lock_guard<std::mutex> lock(_descriptionMutex);
+        if (!_stateDescription.empty()) { return _stateDescription; }
+        // begining of a state
+        int actionId = 0;
+        this->tabCount = 0;
+        this->_stateDescription = "";
+        std::vector<ElementPtr> elementToMerge;
+        std::vector<ElementPtr> elementNotMerge;
+        splitChildren(_rootElement, true, elementToMerge, elementNotMerge);
         // root element
         this->_stateDescription.append(this->_rootElement->toHTML(elementToMerge, false, -1));
         //this->_stateDescription.append(generateActionList(this->_rootElement));
@@ -135,37 +152,7 @@ namespace fastbotx {
         addTab();
         std::vector<ElementPtr> elementToMerge;
         std::vector<ElementPtr> elementNotMerge;
-        std::vector<ElementPtr> checkList(1, target);
-
-        while (!checkList.empty()) {
-            ElementPtr element = checkList[0];
-            checkList.erase(checkList.begin());
-            std::vector<ElementPtr> children = element->getChildren();
-            //callJavaLogger(MAIN_THREAD, "element to check: %s, child size: %d", element->toHTML().c_str(), children.size());
-            if (children.size() == 1 && children[0]->getHtmlClass() == HTML_CLASS::P) {
-                //callJavaLogger(MAIN_THREAD, "merge element above's child");
-                elementToMerge.push_back(children[0]);
-                checkList.push_back(children[0]);
-            }
-            else {
-                if (children.size() > 1) {
-                    for (const auto& child : children) {
-                        elementNotMerge.push_back(child);
-                    }
-                }
-                else {
-                    for (const auto& child : children)
-                    {
-                        if (shouldMerge(element, child)) {
-                            elementToMerge.push_back(child);
-                        }
-                        else {
-                            elementNotMerge.push_back(child);
-                        }
-                    }
-                }
-            }
-        }
+        splitChildren(target, false, elementToMerge, elementNotMerge);
         bool noChild = elementNotMerge.empty();
         // Write the text part of the element
         count++;
@@ -185,6 +172,312 @@ namespace fastbotx {
         }        
     }
 
+    namespace {
+
+        /// at least this many identical siblings in a row make a run
+        const size_t MinRunLength = 3;
+
+        double valueOf(HTML_CLASS htmlClass)
+        {
+            switch (htmlClass) {
+                case HTML_CLASS::INPUT:
+                    return 5;
+                case HTML_CLASS::BUTTON:
+                case HTML_CLASS::CHECKBOX:
+                    return 4;
+                case HTML_CLASS::SCROLLER:
+                    return 3;
+                default:
+                    return 2;
+            }
+        }
+
+    }
+
+    std::string StateStructure::generateCompactDescription(size_t tokenBudget)
+    {
+        std::lock_guard<std::mutex> lock(_descriptionMutex);
+        if (!_compactDescription.empty() && _compactBudget == tokenBudget) { return _compactDescription; }
+
+        DescNode root;
+        root.element = _rootElement;
+        std::vector<ElementPtr> elementNotMerge;
+        splitChildren(_rootElement, true, root.merged, elementNotMerge);
+        buildDescNodes(elementNotMerge, 1, root.children);
+        collapseRuns(root.children);
+
+        std::vector<DescLine> lines;
+        appendDescLines(root, 0, -1, lines);
+
+        // remove the least valuable leaves until it fits, a container whose children are all gone becomes a leaf
+        typedef std::pair<double, size_t> Candidate;
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+        size_t total = 0;
+        for (size_t i = 0; i < lines.size(); i++) {
+            total += tokensOf(lines[i]);
+            if (i != 0 && lines[i].children == 0) {
+                candidates.emplace(lines[i].value, i);
+            }
+        }
+        size_t removed = 0;
+        while (total > tokenBudget && !candidates.empty()) {
+            size_t index = candidates.top().second;
+            candidates.pop();
+            total -= tokensOf(lines[index]);
+            lines[index].removed = true;
+            removed++;
+            DescLine& parent = lines[lines[index].parent];
+            total -= tokensOf(parent);
+            parent.children--;
+            total += tokensOf(parent);
+            if (parent.children == 0 && lines[index].parent != 0) {
+                candidates.emplace(parent.value, lines[index].parent);
+            }
+        }
+        if (removed > 0) {
+            callJavaLogger(CHILD_THREAD, "[StateStructure] %zu of %zu lines left out to fit %zu tokens", removed, lines.size(), tokenBudget);
+        }
+
+        _compactDescription.clear();
+        renderDescLine(lines, 0, _compactDescription);
+        _compactBudget = tokenBudget;
+        _compactTrimmed = removed > 0;
+        _describedIds.clear();
+        for (const auto& line : lines) {
+            if (!line.removed) {
+                _describedIds.insert(line.ids.begin(), line.ids.end());
+            }
+        }
+        return _compactDescription;
+    }
+
+    bool StateStructure::getDescribedIds(std::set<int>& ids)
+    {
+        std::lock_guard<std::mutex> lock(_descriptionMutex);
+        if (_compactDescription.empty() || _compactTrimmed) {
+            return false;
+        }
+        ids = _describedIds;
+        return true;
+    }
+
+    void StateStructure::buildDescNodes(const std::vector<ElementPtr>& elements, int depth, std::vector<DescNode>& out)
+    {
+        if (depth >= 25) {
+            return;
+        }
+        for (const auto& element : elements) {
+            DescNode node;
+            node.element = element;
+            std::vector<ElementPtr> elementNotMerge;
+            splitChildren(element, false, node.merged, elementNotMerge);
+            buildDescNodes(elementNotMerge, depth + 1, node.children);
+
+            bool hasText = !element->getText().empty() || !element->getContentDesc().empty();
+            for (const auto& merged : node.merged) {
+                hasText = hasText || !merged->getText().empty();
+            }
+            // nothing can be done with it and nothing is said about it
+            node.wrapper = element->getHtmlClass() == HTML_CLASS::P && !hasText;
+            out.push_back(std::move(node));
+        }
+    }
+
+    void StateStructure::collapseRuns(std::vector<DescNode>& nodes)
+    {
+        for (auto& node : nodes) {
+            collapseRuns(node.children);
+        }
+        // the rows of a list are mostly such wrappers, they are compared before they are taken apart
+        markRuns(nodes);
+
+        std::vector<DescNode> flattened;
+        flattened.reserve(nodes.size());
+        bool flattenedAny = false;
+        for (auto& node : nodes) {
+            if (node.wrapper && !node.inRun) {
+                for (auto& child : node.children) {
+                    flattened.push_back(std::move(child));
+                }
+                flattenedAny = true;
+            }
+            else {
+                flattened.push_back(std::move(node));
+            }
+        }
+        nodes.swap(flattened);
+        if (flattenedAny) {
+            markRuns(nodes);
+        }
+    }
+
+    void StateStructure::markRuns(std::vector<DescNode>& nodes)
+    {
+        std::vector<std::string> signatures;
+        signatures.reserve(nodes.size());
+        for (const auto& node : nodes) {
+            signatures.push_back(node.inRun ? std::string() : signatureOf(node));
+        }
+        for (size_t begin = 0; begin < nodes.size();) {
+            size_t end = begin + 1;
+            while (end < nodes.size() && !nodes[begin].inRun && !nodes[end].inRun && signatures[end] == signatures[begin]) {
+                end++;
+            }
+            if (end - begin >= MinRunLength) {
+                for (size_t i = begin; i < end; i++) {
+                    // the first one is the exemplar
+                    nodes[i].runIndex = static_cast<int>(i - begin);
+                    nodes[i].inRun = true;
+                }
+            }
+            begin = end;
+        }
+    }
+
+    std::string StateStructure::signatureOf(const DescNode& node)
+    {
+        std::string signature = std::string(htmlClass[node.element->getHtmlClass()]) + ":" +
+                node.element->getClassname() + ":" + node.element->getResourceID() + "(";
+        for (const auto& child : node.children) {
+            signature += signatureOf(child) + ",";
+        }
+        return signature + ")";
+    }
+
+    void StateStructure::foldText(const DescNode& node, std::string& text)
+    {
+        auto append = [&text](const std::string& part) {
+            if (part.empty()) {
+                return;
+            }
+            if (!text.empty()) {
+                text += " <br> ";
+            }
+            text += part;
+        };
+        append(node.element->getText().empty() ? node.element->getContentDesc() : node.element->getText());
+        for (const auto& merged : node.merged) {
+            append(merged->getText());
+        }
+        for (const auto& child : node.children) {
+            HTML_CLASS html_class = child.element->getHtmlClass();
+            if (html_class == HTML_CLASS::P) {
+                foldText(child, text);
+                continue;
+            }
+            // the model may pick it
+            std::string inner;
+            foldText(child, inner);
+            append(std::string("<") + htmlClass[html_class] + " id=" + std::to_string(child.element->getId()) + ">" +
+                   inner + htmlEndTag[html_class]);
+        }
+    }
+
+    void StateStructure::collectIds(const DescNode& node, std::vector<int>& ids)
+    {
+        ids.push_back(node.element->getId());
+        for (const auto& merged : node.merged) {
+            ids.push_back(merged->getId());
+        }
+        for (const auto& child : node.children) {
+            collectIds(child, ids);
+        }
+    }
+
+    void StateStructure::appendDescLines(const DescNode& node, int depth, int parent, std::vector<DescLine>& lines)
+    {
+        size_t index = lines.size();
+        DescLine line;
+        line.depth = depth;
+        line.parent = parent;
+        if (node.runIndex > 0) {
+            HTML_CLASS html_class = node.element->getHtmlClass();
+            std::string text;
+            foldText(node, text);
+            line.open = std::string("<") + htmlClass[html_class];
+            if (html_class != HTML_CLASS::P) {
+                line.open += " id=" + std::to_string(node.element->getId());
+            }
+            line.open += ">" + text + htmlEndTag[html_class];
+            // the exemplar already shows what these are
+            line.value = valueOf(html_class) - 2.5 - 0.01 * node.runIndex;
+            line.runItem = true;
+            collectIds(node, line.ids);
+        }
+        else {
+            HTML_CLASS html_class = node.element->getHtmlClass();
+            bool noChild = node.children.empty();
+            line.open = node.element->toHTML(node.merged, noChild, -1, true);
+            line.open.pop_back(); // '\n'
+            if (!noChild) {
+                line.close = htmlEndTag[html_class];
+            }
+            line.value = valueOf(html_class);
+            line.ids.push_back(node.element->getId());
+            for (const auto& merged : node.merged) {
+                line.ids.push_back(merged->getId());
+            }
+        }
+        // deeper and later lines go first among equals
+        line.value -= 0.001 * depth + 1e-7 * static_cast<double>(index);
+        lines.push_back(line);
+
+        if (node.runIndex == 0) {
+            for (const auto& child : node.children) {
+                appendDescLines(child, depth + 1, static_cast<int>(index), lines);
+                lines[index].children++;
+            }
+        }
+        lines[index].end = lines.size();
+    }
+
+    size_t StateStructure::tokensOf(const DescLine& line)
+    {
+        if (line.removed) {
+            return 0;
+        }
+        // a line break (with indentation) is about one token
+        size_t tokens = estimate_tokens(line.open) + 1;
+        if (!line.close.empty()) {
+            tokens += estimate_tokens(line.close) + (line.children > 0 ? 1 : 0);
+        }
+        return tokens;
+    }
+
+    void StateStructure::renderDescLine(const std::vector<DescLine>& lines, size_t index, std::string& out)
+    {
+        const DescLine& line = lines[index];
+        out.append(line.depth, '\t');
+        out += line.open;
+        if (line.children == 0) {
+            out += line.close;
+            out += '\n';
+            return;
+        }
+        out += '\n';
+        int omitted = 0;
+        for (size_t child = index + 1; child <= line.end; child = lines[child].end) {
+            bool omittedRunItem = child < line.end && lines[child].removed && lines[child].runItem;
+            if (omitted > 0 && !omittedRunItem) {
+                out.append(line.depth + 1, '\t');
+                out += "<p>... " + std::to_string(omitted) + " more like the above</p>\n";
+                omitted = 0;
+            }
+            if (child == line.end) {
+                break;
+            }
+            if (omittedRunItem) {
+                omitted++;
+            }
+            else if (!lines[child].removed) {
+                renderDescLine(lines, child, out);
+            }
+        }
+        out.append(line.depth, '\t');
+        out += line.close;
+        out += '\n';
+    }
+
     std::string StateStructure::generateActionList(const ElementPtr target)
     {
         std::string actionList = "\n";
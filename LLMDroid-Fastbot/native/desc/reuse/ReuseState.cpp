@@ -10,6 +10,8 @@
 #include "ReuseState.h"
 
 #include <utility>
+#include <algorithm>
+#include <sstream>
 #include "RichWidget.h"
 #include "ActivityNameAction.h"
 #include "../utils.hpp"
@@ -159,6 +161,11 @@ namespace fastbotx {
         return this->_stateStructure.generateStateDescription(this->_id);
     }
 
+    const std::string ReuseState::getCompactDescription(size_t tokenBudget)
+    {
+        return this->_stateStructure.generateCompactDescription(tokenBudget);
+    }
+
     void ReuseState::addSubSequentState(ReuseStatePtr state)
     {
         ActionPtr action = this->_actionToPerform;
@@ -198,6 +205,22 @@ namespace fastbotx {
 
     }
 
+    ReuseStatePtr ReuseState::predictNextState(const ActionPtr& action) const
+    {
+        if (!action) {
+            return nullptr;
+        }
+        uintptr_t actionHash = action->hash();
+        const StateGraphEdge* best = nullptr;
+        for (const auto& edge: _edges) {
+            if (edge.action && edge.action->hash() == actionHash &&
+                (!best || edge.remainTimes > best->remainTimes)) {
+                best = &edge;
+            }
+        }
+        return best ? best->nextState : nullptr;
+    }
+
     void ReuseState::addPreviousState(StatePtr state)
     {
         std::shared_ptr<ReuseState> preState = std::dynamic_pointer_cast<ReuseState>(state);
@@ -296,6 +319,112 @@ namespace fastbotx {
         return ret;
     }
 
+    namespace {
+
+        /// elements a description shows as a line of their own, by the line without id, each list in id order
+        /// @param shown if given, only these elements are taken
+        std::map<std::string, std::vector<ElementPtr>> elementsByLine(StateStructure& structure,
+                                                                      const std::set<int>* shown = nullptr)
+        {
+            std::map<std::string, std::vector<ElementPtr>> ret;
+            for (const auto& element : structure.getElementsInIdOrder()) {
+                bool hasText = !element->getText().empty() || !element->getContentDesc().empty();
+                if (!element->getWidget() || (element->getHtmlClass() == HTML_CLASS::P && !hasText)) {
+                    continue;
+                }
+                if (shown && shown->find(element->getId()) == shown->end()) {
+                    continue;
+                }
+                ret[element->toHTML({}, true, 0, true)].push_back(element);
+            }
+            return ret;
+        }
+
+    }
+
+    bool ReuseState::describeChangesFrom(const ReuseStatePtr& reference, std::string& changes, std::map<int, int>& addedIds)
+    {
+        addedIds.clear();
+        changes.clear();
+        // the model knows only what the compact description of reference showed
+        std::set<int> shown;
+        if (!reference->_stateStructure.getDescribedIds(shown)) {
+            return false;
+        }
+        auto mine = elementsByLine(_stateStructure);
+        auto theirs = elementsByLine(reference->_stateStructure, &shown);
+
+        // removed: lines of reference beyond the count of equal lines here
+        std::vector<ElementPtr> removed;
+        for (const auto& line : theirs) {
+            auto found = mine.find(line.first);
+            size_t kept = found == mine.end() ? 0 : found->second.size();
+            for (size_t i = kept; i < line.second.size(); i++) {
+                removed.push_back(line.second[i]);
+            }
+        }
+        std::vector<ElementPtr> added;
+        for (const auto& line : mine) {
+            auto found = theirs.find(line.first);
+            size_t kept = found == theirs.end() ? 0 : found->second.size();
+            for (size_t i = kept; i < line.second.size(); i++) {
+                added.push_back(line.second[i]);
+            }
+        }
+        if (removed.empty() && added.empty()) {
+            return true;
+        }
+        auto byId = [](const ElementPtr& a, const ElementPtr& b) { return a->getId() < b->getId(); };
+        std::sort(removed.begin(), removed.end(), byId);
+        std::sort(added.begin(), added.end(), byId);
+
+        std::stringstream stream;
+        if (!removed.empty()) {
+            stream << "Removed:\n";
+            for (const auto& element : removed) {
+                stream << element->toHTML({}, true, -1, true);
+            }
+        }
+        if (!added.empty()) {
+            int nextId = 0;
+            for (const auto& element : reference->_stateStructure.getElementsInIdOrder()) {
+                nextId = std::max(nextId, element->getId() + 1);
+            }
+            stream << "Added:\n";
+            for (const auto& element : added) {
+                addedIds[nextId] = element->getId();
+                stream << element->toHTML({}, true, nextId, true);
+                nextId++;
+            }
+        }
+        changes = stream.str();
+        return true;
+    }
+
+    int ReuseState::translateElementId(const ReuseStatePtr& reference, int referenceId)
+    {
+        ElementPtr element = reference->findElementById(referenceId);
+        if (!element) {
+            return -1;
+        }
+        std::set<int> shown;
+        if (!reference->_stateStructure.getDescribedIds(shown) || shown.find(referenceId) == shown.end()) {
+            return -1;
+        }
+        auto theirs = elementsByLine(reference->_stateStructure, &shown);
+        auto line = theirs.find(element->toHTML({}, true, 0, true));
+        if (line == theirs.end()) {
+            return -1;
+        }
+        auto mine = elementsByLine(_stateStructure);
+        auto found = mine.find(line->first);
+        size_t index = std::find(line->second.begin(), line->second.end(), element) - line->second.begin();
+        if (found == mine.end() || index >= found->second.size()) {
+            return -1;
+        }
+        return found->second[index]->getId();
+    }
+
     ActivityStateActionPtr ReuseState::findActionByWidget(uintptr_t widgetHash, ActionType actionType)
     {
         ActivityStateActionPtr ret = nullptr;
@@ -384,11 +513,11 @@ namespace fastbotx {
         }
     }
 
-    int ReuseState::findActionByElementId(int elementId, int actionType)
+    int ReuseState::findActionByElementId(int elementId, int actionType, int& whichWidget, WidgetPtr& target)
     {
         // find element
         ElementPtr element = _stateStructure.findElementById(elementId);
-        if (!element) {
+        if (!element || !element->getWidget()) {
             callJavaLogger(CHILD_THREAD, "can't find id:%d in State%d's elements", elementId, _id);
             return -1;
         }
@@ -399,52 +528,32 @@ namespace fastbotx {
         callJavaLogger(CHILD_THREAD, "%s", widget->toHTML().c_str());
 
         // Determine whether the widget is in widgets or merged widgets. If it is in merged widgets, get its index
-        auto it = std::find_if(_widgets.begin(), _widgets.end(), [widget](const WidgetPtr& ptr) {
-            return ptr->hash() == widget->hash();
-        });
-        if (it == _widgets.end()) {
-            callJavaLogger(CHILD_THREAD, "0 widget neither in _widgets nor in _mergedWidgets");
-            exit(0);
-        }
-        else {
-            callJavaLogger(CHILD_THREAD, "widget:%zu, one in widgets:%d", widget->hash(), (it-_widgets.begin()));
-        }
-
-        int whichWidget = findWhichWidget(widget);
+        whichWidget = findWhichWidget(widget);
         if (whichWidget == -1) {
             callJavaLogger(CHILD_THREAD, "found element->widget in _widgets");
         }
-        else if (whichWidget == -2) {
-            callJavaLogger(CHILD_THREAD, "1 widget neither in _widgets nor in _mergedWidgets");
-            exit(0);
-        }
-        else if (whichWidget == -3) {
-            callJavaLogger(CHILD_THREAD, "2 widget neither in _widgets nor in _mergedWidgets");
-            exit(0);
+        else if (whichWidget < -1) {
+            // the page may only be predicted, it is not worth stopping for
+            callJavaLogger(CHILD_THREAD, "%d widget neither in _widgets nor in _mergedWidgets of State%d", whichWidget, _id);
+            return -1;
         }
         else {
             callJavaLogger(CHILD_THREAD, "found element->widget in _mergedWidgets %d", whichWidget);
         }
-        // Locate the action and its index in actions based on the widget's hash and action type.
-        //ActivityStateActionPtr action = findActionByWidget(widget->hash(), widget->getActionType());
-        auto action = std::find_if(_actions.begin(), _actions.end(), [widget, actionType](ActivityStateActionPtr& ptr){
-            if (!ptr->getTarget()) return false;
-            return widget->hash() == ptr->getTarget()->hash() && ptr->getActionType() == actionType;
-        });
-        if (action == _actions.end()) {
-            callJavaLogger(CHILD_THREAD, "No corresponding action found");
-            // LLM may return an element doesn't have action
-            return -1;
-        }
-        else {
-            // Set the target of the action to the target widget and update the flag in the action
-            int index = action - _actions.begin();
-            (*action)->setWhichWidget(whichWidget);
-            (*action)->setTarget(widget);
-            callJavaLogger(CHILD_THREAD, "set target element->widget %d", whichWidget);
-            return index;
+        // Locate the action by the actions recorded on the element of the widget's hash when the state was built,
+        // not by the targets of the actions, which the main thread may be changing meanwhile
+        ElementPtr owner = _stateStructure.findElement(widget->hash());
+        if (owner) {
+            for (const auto& actionInState : owner->getActions()) {
+                if (static_cast<int>(actionInState.second) == actionType) {
+                    target = widget;
+                    return actionInState.first;
+                }
+            }
         }
-
+        callJavaLogger(CHILD_THREAD, "No corresponding action found");
+        // LLM may return an element doesn't have action
+        return -1;
     }
 
     ElementPtr ReuseState::findElementById(int id) {
@@ -36,11 +36,19 @@ class ReuseState : public State, public std::enable_shared_from_this<ReuseState>
 
         //custom
         const std::string getStateDescription();
+        /// the description as sent to the model, see StateStructure::generateCompactDescription
+        const std::string getCompactDescription(size_t tokenBudget);
         void addSubSequentState(std::shared_ptr<ReuseState> state);
         void addPreviousState(StatePtr state);
         float computeSimilarity(std::shared_ptr<ReuseState> state);
 
         const std::vector<StateGraphEdge>& getEdges() { return _edges; }
+
+        /**
+         * The state most often reached by performing action in this state, according to the recorded edges
+         * @return nullptr if action has never been performed here
+         */
+        std::shared_ptr<ReuseState> predictNextState(const ActionPtr& action) const;
         
         std::vector<StateGraphEdge> _edges;     
         std::string getBriefDescription();
@@ -67,6 +75,26 @@ class ReuseState : public State, public std::enable_shared_from_this<ReuseState>
         MiniGraphEdge* getUnvisitedMiniEdge();
         std::vector<WidgetPtr> diffWidgets(ReuseStatePtr target);
 
+        /**
+         * @brief Describe this page by what changed since reference, a page the model has read the compact description of.
+         * Like diffWidgets, but elements are compared by the HTML line the model reads, text included,
+         * and equal lines are paired in the order of their ids. Only the elements that description showed
+         * count for reference. Removed elements keep their id in reference,
+         * added ones are numbered after the largest id of reference.
+         * @param changes filled with the removed and added elements in HTML, empty if nothing changed
+         * @param addedIds filled with the id shown for each added element -> its id in this state
+         * @return false if the description of reference left lines out, describe this page in full then
+         * @note call from child thread
+         */
+        bool describeChangesFrom(const ReuseStatePtr& reference, std::string& changes, std::map<int, int>& addedIds);
+
+        /**
+         * @brief Id in this state of the element shown with referenceId in the description of reference,
+         * elements are paired as in describeChangesFrom.
+         * @return -1 if it is not on this page
+         */
+        int translateElementId(const ReuseStatePtr& reference, int referenceId);
+
         /**
          *find similar action in current state to replace next step
          *@note call from main thread -guideCheck
@@ -74,13 +102,16 @@ class ReuseState : public State, public std::enable_shared_from_this<ReuseState>
         ActionPtr findSimilarAction(ActionPtr target);
 
         /**
-         * find corresponding action using element id and type
+         * find corresponding action using element id and type, nothing is changed:
+         * the action is aimed at the element's widget by the main thread, see GPTAgent::acceptTestStep
          * @param elementId
          * @param actionType
-         * @return
+         * @param whichWidget set to the index of the widget in _mergedWidgets, -1 if it is the one in _widgets
+         * @param target set to the widget of the element
+         * @return index of the action in actions, -1 if there is none
          * @note call from child thread -(askForFunction)when processing gpt's response
         */
-        int findActionByElementId(int elementId, int actionType);
+        int findActionByElementId(int elementId, int actionType, int& whichWidget, WidgetPtr& target);
 
         ElementPtr findElementById(int id);
 
@@ -0,0 +1,149 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef InputTextGenerator_CPP_
+#define InputTextGenerator_CPP_
+
+#include "InputTextGenerator.h"
+
+namespace fastbotx {
+
+    static const char AlphabetSeq[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz~!@#$%^&*()<>_-;',.?/\"|{}";
+    static const int AlphabetSeqLen = sizeof(AlphabetSeq) - 1;
+    // every character is 3 bytes in utf-8
+    static const char AlphabetChSeq[] = "你好中文字符串｜。，；（）【】？！测试啊哈";
+    static const int AlphabetChSeqLen = (sizeof(AlphabetChSeq) - 1) / 3;
+
+    // characters that usually break text handling: emoji, rtl mark, combining accent, zero width joiner,
+    // full width letter, supplementary cjk and ideographic space
+    static const char *const UnicodeSpecials[] = {"\U0001F600", "\u200F", "e\u0301", "\u200D",
+                                                  "\uFF21", "\U0002000B", "\u3000"};
+    static const int UnicodeSpecialsLen = sizeof(UnicodeSpecials) / sizeof(UnicodeSpecials[0]);
+
+    // lengths around common limits of input fields, in bytes
+    static const int BoundaryLengths[] = {1, 8, 16, 32, 64, 128, 255, 256, 1024};
+    static const int BoundaryLengthsLen = sizeof(BoundaryLengths) / sizeof(BoundaryLengths[0]);
+
+    // move pos back to the beginning of the utf-8 character containing it
+    static size_t utf8Boundary(const std::string &text, size_t pos) {
+        if (pos >= text.size())
+            return text.size();
+        while (pos > 0 && (static_cast<unsigned char>(text[pos]) & 0xC0) == 0x80)
+            pos--;
+        return pos;
+    }
+
+    InputTextGenerator::InputTextGenerator(size_t pageTextCapacity)
+            : _pageTextsHead(0), _pageTextCapacity(pageTextCapacity) {
+        this->_pageTexts.reserve(pageTextCapacity);
+    }
+
+    void InputTextGenerator::cachePageText(const std::string &text) {
+        if (text.empty() || this->_pageTextCapacity == 0)
+            return;
+        if (!this->_pageTextSet.insert(text).second)
+            return; // already cached
+        if (this->_pageTexts.size() < this->_pageTextCapacity) {
+            this->_pageTexts.emplace_back(text);
+            return;
+        }
+        std::string &slot = this->_pageTexts[this->_pageTextsHead];
+        this->_pageTextSet.erase(slot);
+        slot = text;
+        this->_pageTextsHead = (this->_pageTextsHead + 1) % this->_pageTextCapacity;
+    }
+
+    InputTextGenerator::TextSource
+    InputTextGenerator::generate(RandomGenerator &random, bool preferUserTexts,
+                                 std::string &text) const {
+        if (preferUserTexts && !this->_userTexts.empty()) {
+            text = pick(this->_userTexts, random);
+            return UserText;
+        }
+        int rate = random.nextInt(0, 100);
+        // mutate one in five texts taken from the corpora
+        bool mutated = random.nextInt(0, 5) == 0;
+        if (rate < 50 && !this->_fuzzingTexts.empty()) {
+            const std::string &seed = pick(this->_fuzzingTexts, random);
+            text = mutated ? mutate(seed, random) : seed;
+            return FuzzingText;
+        }
+        if (rate < 85) {
+            if (this->_pageTexts.empty()) {
+                text = randomString(random, 1, 64);
+                return RandomString;
+            }
+            const std::string &seed = pick(this->_pageTexts, random);
+            text = mutated ? mutate(seed, random) : seed;
+            return PageText;
+        }
+        // 15% no text
+        return None;
+    }
+
+    std::string InputTextGenerator::randomString(RandomGenerator &random, int minLength, int maxLength) {
+        int len = random.nextInt(minLength, maxLength);
+        std::string ret;
+        ret.reserve((size_t) len * 3);
+        for (int i = 0; i < len; i++) {
+            // ascii characters are four times as likely as chinese ones
+            int index = random.nextInt(0, AlphabetSeqLen * 4 + AlphabetChSeqLen);
+            if (index < AlphabetSeqLen * 4) {
+                ret.push_back(AlphabetSeq[index / 4]);
+            } else {
+                ret.append(AlphabetChSeq + (index - AlphabetSeqLen * 4) * 3, 3);
+            }
+        }
+        return ret;
+    }
+
+    std::string InputTextGenerator::mutate(const std::string &text, RandomGenerator &random) {
+        switch (random.nextInt(0, 4)) {
+            case 0: { // truncation
+                if (text.size() <= 1)
+                    return text;
+                size_t cut = utf8Boundary(text, (size_t) random.nextInt(1, (int) text.size()));
+                return cut == 0 ? text : text.substr(0, cut);
+            }
+            case 1: { // unicode insertion
+                size_t pos = utf8Boundary(text, (size_t) random.nextInt(0, (int) text.size() + 1));
+                std::string ret(text);
+                ret.insert(pos, UnicodeSpecials[random.nextInt(0, UnicodeSpecialsLen)]);
+                return ret;
+            }
+            case 2: { // boundary length, repeat the text and cut at a limit
+                auto length = (size_t) BoundaryLengths[random.nextInt(0, BoundaryLengthsLen)];
+                const std::string &unit = text.empty() ? std::string("a") : text;
+                std::string ret;
+                ret.reserve(length + unit.size());
+                while (ret.size() < length)
+                    ret.append(unit);
+                ret.resize(utf8Boundary(ret, length));
+                return ret.empty() ? unit : ret;
+            }
+            default: // whitespace padding
+                return " " + text + " ";
+        }
+    }
+
+    const char *InputTextGenerator::sourceName(TextSource source) {
+        switch (source) {
+            case UserText:
+                return "user preset strings";
+            case FuzzingText:
+                return "fuzzing text";
+            case PageText:
+                return "page text";
+            case RandomString:
+                return "random string";
+            default:
+                return "15% no text";
+        }
+    }
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+#ifndef InputTextGenerator_H_
+#define InputTextGenerator_H_
+
+#include "Base.h"
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+namespace fastbotx {
+
+#define PageTextsMaxCount 300
+
+    /// Generates texts for editable widgets, from the texts preset by user (max.strings),
+    /// the fuzzing texts (max.fuzzing.strings), the texts seen on recent pages and random strings.
+    /// All the draws use the generator of the caller, so the same seed gives the same texts.
+    class InputTextGenerator {
+    public:
+        enum TextSource {
+            None, UserText, FuzzingText, PageText, RandomString
+        };
+
+        explicit InputTextGenerator(size_t pageTextCapacity = PageTextsMaxCount);
+
+        void setUserTexts(std::vector<std::string> texts) { this->_userTexts = std::move(texts); }
+
+        void addFuzzingText(const std::string &text) { this->_fuzzingTexts.emplace_back(text); }
+
+        bool hasUserTexts() const { return !this->_userTexts.empty(); }
+
+        /// remember a text seen on page, the oldest one is overwritten once the cache is full
+        void cachePageText(const std::string &text);
+
+        size_t pageTextCount() const { return this->_pageTexts.size(); }
+
+        /// pick a text following the policy of fastbot:
+        /// user texts only if preferUserTexts, otherwise 50% fuzzing texts, 35% page texts, 15% no text
+        /// \param random the generator of the agent
+        /// \param preferUserTexts max.randomPickFromStringList
+        /// \param text output, untouched if TextSource::None is returned
+        /// \return where the text comes from
+        TextSource generate(RandomGenerator &random, bool preferUserTexts, std::string &text) const;
+
+        /// a random mix of ascii and chinese characters, of length in [minLength, maxLength) characters
+        static std::string randomString(RandomGenerator &random, int minLength, int maxLength);
+
+        /// apply one of truncation, unicode insertion, boundary length and whitespace padding
+        static std::string mutate(const std::string &text, RandomGenerator &random);
+
+        static const char *sourceName(TextSource source);
+
+    private:
+        static const std::string &pick(const std::vector<std::string> &corpus, RandomGenerator &random) {
+            return corpus[random.nextInt(0, (int) corpus.size())];
+        }
+
+        std::vector<std::string> _userTexts;
+        std::vector<std::string> _fuzzingTexts;
+
+        // ring buffer of page texts, _pageTextsHead is the slot to overwrite next once full
+        std::vector<std::string> _pageTexts;
+        size_t _pageTextsHead;
+        size_t _pageTextCapacity;
+        std::unordered_set<std::string> _pageTextSet;
+    };
+
+}
+
+#endif /* InputTextGenerator_H_ */
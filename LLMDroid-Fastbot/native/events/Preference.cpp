@@ -26,8 +26,8 @@ namespace fastbotx {
 
     }
 
-    OperatePtr CustomAction::toOperate() const {
-        OperatePtr opt = Action::toOperate();
+    OperatePtr CustomAction::toOperate(RandomGenerator &random) const {
+        OperatePtr opt = Action::toOperate(random);
         opt->sid = "customact";
         opt->aid = "customact";
         opt->editable = true;
@@ -105,7 +105,6 @@ namespace fastbotx {
         this->_resMapping.clear();
         this->_blackWidgetActions.clear();
         this->_treePrunings.clear();
-        this->_inputTexts.clear();
         this->_blackList.clear();
         std::queue<ActionPtr> empty;
         this->_currentActions.swap(empty);
@@ -114,7 +113,8 @@ namespace fastbotx {
     }
 
     ActionPtr Preference::resolvePageAndGetSpecifiedAction(const std::string &activity,
-                                                           const ElementPtr &rootXML) {
+                                                           const ElementPtr &rootXML,
+                                                           RandomGenerator &random) {
         if (nullptr != rootXML)
             this->resolvePage(activity, rootXML);
 
@@ -122,7 +122,7 @@ namespace fastbotx {
         ActionPtr returnAction = nullptr;
         if (this->_currentActions.empty()) {
             for (const CustomEventPtr &customEvent: this->_customEvents) {
-                float eventRate = randomInt(0, 10) / 10.0;
+                float eventRate = random.nextInt(0, 10) / 10.0;
                 BLOG("customEvent activities %s, page event is %s, event times %d , rate is %f/%f",
                      customEvent->activity.c_str(),
                      activity.c_str(), customEvent->times, eventRate, customEvent->prob);
@@ -186,39 +186,19 @@ namespace fastbotx {
         return true;
     }
 
-    std::string Preference::patchOperate(const OperatePtr &opt) {
+    std::string Preference::patchOperate(const OperatePtr &opt, RandomGenerator &random) {
         if (!this->_doInputFuzzing)
             return "";
 
         // input texts
-        char prelog[30];
-        std::srand((unsigned int) std::time(nullptr));
         if (opt->editable && opt->getText().empty()
             && (opt->act == ActionType::CLICK || opt->act == ActionType::LONG_CLICK)) {
-            if (this->_randomInputText &&
-                this->_inputTexts.size() > 0) {
-                int randIdx = randomInt(0, (int) this->_inputTexts.size());
-                std::string &txt = this->_inputTexts[randIdx];
-                opt->setText(txt);
-                strcpy(prelog, "user preset strings");
-            } else {
-                float rate = randomInt(0, 100);
-                if (!this->_fuzzingTexts.empty() && rate < 50) {
-                    int randIdx = randomInt(0, (int) this->_fuzzingTexts.size());
-                    std::string &txt = this->_fuzzingTexts[randIdx];
-                    opt->setText(txt);
-                    strcpy(prelog, "fuzzing text");
-                } else if (rate < 85) {
-                    int randIdx = randomInt(0, (int) this->_pageTextsCache.size());
-                    std::string &txt = this->_pageTextsCache[randIdx];
-                    opt->setText(txt);
-                    strcpy(prelog, "page text");
-                }
-                // 还有15%的概率不生成inputText
-                else {
-                    strcpy(prelog, "15\% no text");
-                }
+            std::string text;
+            auto source = this->_inputTextGenerator.generate(random, this->_randomInputText, text);
+            if (source != InputTextGenerator::None) {
+                opt->setText(text);
             }
+            const char *prelog = InputTextGenerator::sourceName(source);
             BLOG("patch %s input text: %s", prelog, opt->getText().c_str());
             callJavaLogger(MAIN_THREAD, "[INPUT] patch %s input text: %s", prelog, opt->getText().c_str());
             return opt->getText();
@@ -526,6 +506,7 @@ namespace fastbotx {
 #define MaxRandomPickSTR  "max.randomPickFromStringList"
 #define InputFuzzSTR "max.doinputtextFuzzing"
 #define ListenMode "max.listenMode"
+#define RandomSeedSTR "max.randomSeed"
 
     void Preference::loadBaseConfig() {
         LOGI("pref init checking curr packageName is offset: %s", Preference::PackageName.c_str());
@@ -550,19 +531,21 @@ namespace fastbotx {
             } else if (ListenMode == key_value[0]) {
                 BDLOG("set %s", ListenMode);
                 this->setListenMode("true" == key_value[1]);
+            } else if (RandomSeedSTR == key_value[0]) {
+                BDLOG("set %s", RandomSeedSTR);
+                try {
+                    this->_randomSeed = std::stoull(key_value[1]);
+                }
+                catch (std::exception &ex) {
+                    BLOGE("invalid %s: %s", RandomSeedSTR, key_value[1].c_str());
+                }
             }
         }
     }
 
-#define PageTextsMaxCount 300
-
     void Preference::cachePageTexts(const ElementPtr &rootElement) {
-        if (this->_pageTextsCache.size() > PageTextsMaxCount) {
-            this->_pageTextsCache.erase(this->_pageTextsCache.begin(),
-                                        this->_pageTextsCache.begin() + 20);
-        }
         if (rootElement && !rootElement->getText().empty()) {
-            this->_pageTextsCache.push_back(rootElement->getText());
+            this->_inputTextGenerator.cachePageText(rootElement->getText());
         }
         for (const auto &childElement: rootElement->getChildren()) {
             this->cachePageTexts(childElement);
@@ -670,7 +653,7 @@ namespace fastbotx {
         if (!content.empty()) {
             std::vector<std::string> texts;
             splitString(content, texts, '\n');
-            this->_inputTexts.assign(texts.begin(), texts.end());
+            this->_inputTextGenerator.setUserTexts(std::move(texts));
         }
         // load fuzzing texts
         std::string fuzzContent = fastbotx::Preference::loadFileContent(FuzzingTextsFilePath);
@@ -681,7 +664,7 @@ namespace fastbotx {
                 if (line.empty() || line[0] ==
                                     '#') // if a new line starts with #, means it is a comment. Overlook this line.
                     continue;
-                this->_fuzzingTexts.push_back(line);
+                this->_inputTextGenerator.addFuzzingText(line);
             }
         }
     }
@@ -15,6 +15,7 @@
 #include "Action.h"
 #include "DeviceOperateWrapper.h"
 #include "Element.h"
+#include "InputTextGenerator.h"
 
 
 namespace fastbotx {
@@ -22,7 +23,7 @@ namespace fastbotx {
     /// The class for describing the actions that user specified in preference file
     class CustomAction : public Action {
     public:
-        OperatePtr toOperate() const override;
+        OperatePtr toOperate(RandomGenerator &random) const override;
 
         CustomAction();
 
@@ -70,10 +71,11 @@ namespace fastbotx {
         //@brief use custom preference correct the root xml, and return a custom action,
         //@return nullptr if no custom action happened
         ActionPtr
-        resolvePageAndGetSpecifiedAction(const std::string &activity, const ElementPtr &rootXML);
+        resolvePageAndGetSpecifiedAction(const std::string &activity, const ElementPtr &rootXML,
+                                         RandomGenerator &random);
 
         //@brief patch operate: 1. fuzz input text 2. ..
-        std::string patchOperate(const OperatePtr &opt);
+        std::string patchOperate(const OperatePtr &opt, RandomGenerator &random);
 
         // load resource mapping file, override the mapings from default file max.mapping,
         void loadMixResMapping(const std::string &resourceMappingPath);
@@ -91,6 +93,9 @@ namespace fastbotx {
 
         int getForceMaxBlockStateTimes() const { return this->_forceMaxBlockStateTimes; }
 
+        // 0 if max.randomSeed is not specified
+        uint64_t getRandomSeed() const { return this->_randomSeed; }
+
         ~Preference();
 
     protected:
@@ -148,9 +153,8 @@ namespace fastbotx {
         std::vector<std::string> _whiteList;
         std::vector<std::string> _blackList;
 
-        std::vector<std::string> _inputTexts;
-        std::vector<std::string> _fuzzingTexts;
-        std::vector<std::string> _pageTextsCache;
+        // user preset texts, fuzzing texts and the texts cached from pages
+        InputTextGenerator _inputTextGenerator;
 
         CustomActionPtrVec _blackWidgetActions;
         CustomActionPtrVec _treePrunings;
@@ -166,6 +170,7 @@ namespace fastbotx {
         bool _skipAllActionsFromModel;
         bool _forceUseTextModel{};
         int _forceMaxBlockStateTimes{};
+        uint64_t _randomSeed{};
         RectPtr _rootScreenSize;
 
         static std::string loadFileContent(const std::string &fileAbsolutePath);
@@ -98,6 +98,15 @@ bool liboai::Conversation::AddUserData(std::string_view data) & noexcept(false)
 	return false; // data is empty
 }
 
+bool liboai::Conversation::AddAssistantData(std::string_view data) & noexcept(false) {
+	// if data provided is non-empty
+	if (!data.empty()) {
+		this->_conversation["messages"].push_back({ { "role", "assistant" }, {"content", data} });
+		return true; // assistant data added successfully
+	}
+	return false; // data is empty
+}
+
 bool liboai::Conversation::PopUserData() & noexcept(false) {
 	// if conversation is not empty
 	if (!this->_conversation["messages"].empty()) {
@@ -245,6 +254,10 @@ liboai::Response liboai::ChatCompletion::create(const std::string& model, const
 	jcon.push_back("frequency_penalty", std::move(frequency_penalty));
 	jcon.push_back("logit_bias", std::move(logit_bias));
 	jcon.push_back("user", std::move(user));
+	if (stream) {
+		// the last event of the stream carries the token usage
+		jcon.push_back("stream_options", nlohmann::json{ { "include_usage", true } });
+	}
 
 	if (conversation.GetJSON().contains("messages")) {
 		jcon.push_back("messages", conversation.GetJSON()["messages"]);
@@ -253,7 +266,7 @@ liboai::Response liboai::ChatCompletion::create(const std::string& model, const
 	Response res;
 	res = this->Request(
 		Method::HTTP_POST, this->openai_root_, "/chat/completions", "application/json",
-		this->auth_.GetAuthorizationHeaders(),
+		this->authorization_headers(),
 		netimpl::components::Body {
 			jcon.dump()
 		},
@@ -279,32 +292,285 @@ liboai::FutureResponse liboai::ChatCompletion::create_async(const std::string& m
 	jcon.push_back("frequency_penalty", std::move(frequency_penalty));
 	jcon.push_back("logit_bias", std::move(logit_bias));
 	jcon.push_back("user", std::move(user));
+	if (stream) {
+		// the last event of the stream carries the token usage
+		jcon.push_back("stream_options", nlohmann::json{ { "include_usage", true } });
+	}
 
 	if (conversation.GetJSON().contains("messages")) {
 		jcon.push_back("messages", conversation.GetJSON()["messages"]);
 	}
 
-	auto _fn = [this](
-		liboai::JsonConstructor&& jcon,
-		std::optional<std::function<bool(std::string, intptr_t)>>&& stream
-	) -> liboai::Response {
-		return this->Request(
-			Method::HTTP_POST, this->openai_root_, "/chat/completions", "application/json",
-			this->auth_.GetAuthorizationHeaders(),
-			netimpl::components::Body {
-				jcon.dump()
-			},
-			stream ? netimpl::components::WriteCallback{ std::move(stream.value()) } : netimpl::components::WriteCallback{},
-			this->auth_.GetProxies(),
-			this->auth_.GetProxyAuth(),
-			this->auth_.GetMaxTimeout()
-		);
-	};
-		
-	return std::async(std::launch::async, _fn, std::move(jcon), std::move(stream));
+	auto promise = std::make_shared<std::promise<liboai::Response>>();
+	liboai::FutureResponse future = promise->get_future();
+	this->RequestAsync(
+		Method::HTTP_POST, this->openai_root_, "/chat/completions", "application/json",
+		this->authorization_headers(),
+		[promise](liboai::Response response, std::exception_ptr error) {
+			if (error) {
+				promise->set_exception(error);
+			}
+			else {
+				promise->set_value(std::move(response));
+			}
+		},
+		netimpl::components::Body {
+			jcon.dump()
+		},
+		stream ? netimpl::components::WriteCallback{ std::move(stream.value()) } : netimpl::components::WriteCallback{},
+		this->auth_.GetProxies(),
+		this->auth_.GetProxyAuth(),
+		this->auth_.GetMaxTimeout()
+	);
+
+	return future;
+}
+
+void liboai::ChatCompletion::create_async(const std::string& model, const Conversation& conversation, netimpl::Completion on_done, std::optional<float> temperature, std::optional<std::function<bool(std::string, intptr_t)>> stream, std::optional<uint16_t> max_tokens) const& noexcept(false) {
+	liboai::JsonConstructor jcon;
+	jcon.push_back("model", model);
+	jcon.push_back("temperature", std::move(temperature));
+	jcon.push_back("stream", stream);
+	jcon.push_back("max_tokens", std::move(max_tokens));
+	if (stream) {
+		jcon.push_back("stream_options", nlohmann::json{ { "include_usage", true } });
+	}
+
+	if (conversation.GetJSON().contains("messages")) {
+		jcon.push_back("messages", conversation.GetJSON()["messages"]);
+	}
+
+	this->RequestAsync(
+		Method::HTTP_POST, this->openai_root_, "/chat/completions", "application/json",
+		this->authorization_headers(),
+		std::move(on_done),
+		netimpl::components::Body {
+			jcon.dump()
+		},
+		stream ? netimpl::components::WriteCallback{ std::move(stream.value()) } : netimpl::components::WriteCallback{},
+		this->auth_.GetProxies(),
+		this->auth_.GetProxyAuth(),
+		this->auth_.GetMaxTimeout()
+	);
+}
+
+void liboai::ChatCompletion::list_models_async(netimpl::Completion on_done) const& noexcept(false) {
+	this->RequestAsync(
+		Method::HTTP_GET, this->openai_root_, "/models", "application/json",
+		this->authorization_headers(),
+		std::move(on_done),
+		this->auth_.GetProxies(),
+		this->auth_.GetProxyAuth(),
+		this->auth_.GetMaxTimeout()
+	);
 }
 
 std::ostream& liboai::operator<<(std::ostream& os, const Conversation& conv) {
 	os << conv.GetRawConversation();
 	return os;
-}
\ No newline at end of file
+}
+namespace {
+	size_t escapedLength(std::string_view text) {
+		size_t length = 0;
+		for (unsigned char c : text) {
+			if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t') {
+				length += 2;
+			}
+			else if (c < 0x20) {
+				length += 6;
+			}
+			else {
+				length += 1;
+			}
+		}
+		return length;
+	}
+
+	void appendEscaped(std::string& out, std::string_view text) {
+		static const char hex[] = "0123456789abcdef";
+		for (unsigned char c : text) {
+			switch (c) {
+				case '"': out += "\\\""; break;
+				case '\\': out += "\\\\"; break;
+				case '\b': out += "\\b"; break;
+				case '\f': out += "\\f"; break;
+				case '\n': out += "\\n"; break;
+				case '\r': out += "\\r"; break;
+				case '\t': out += "\\t"; break;
+				default:
+					if (c < 0x20) {
+						out += "\\u00";
+						out += hex[c >> 4];
+						out += hex[c & 0xf];
+					}
+					else {
+						out += static_cast<char>(c);
+					}
+			}
+		}
+	}
+
+	const char* roleName(liboai::ChatMessages::Role role) {
+		switch (role) {
+			case liboai::ChatMessages::Role::SYSTEM: return "system";
+			case liboai::ChatMessages::Role::ASSISTANT: return "assistant";
+			default: return "user";
+		}
+	}
+
+	/*
+		SAX handler keeping choices[0].message.content and the numbers
+			under usage, one or two levels deep, skipping everything else.
+	*/
+	class ReplyHandler final : public nlohmann::json_sax<nlohmann::json> {
+		public:
+			ReplyHandler(std::string& content, nlohmann::json& usage) : content_(content), usage_(usage) {}
+
+			bool found = false;
+
+			bool null() override { return this->Value(); }
+			bool boolean(bool) override { return this->Value(); }
+			bool number_integer(number_integer_t value) override { this->Usage(value); return this->Value(); }
+			bool number_unsigned(number_unsigned_t value) override { this->Usage(value); return this->Value(); }
+			bool number_float(number_float_t value, const string_t&) override { this->Usage(value); return this->Value(); }
+			bool binary(binary_t&) override { return this->Value(); }
+
+			bool string(string_t& value) override {
+				if (!this->found && this->At({ "choices", "", "message", "content" })) {
+					this->content_ = std::move(value);
+					this->found = true;
+				}
+				return this->Value();
+			}
+
+			bool start_object(std::size_t) override { this->stack_.push_back({ false, 0, {} }); return true; }
+			bool key(string_t& value) override { this->stack_.back().key = std::move(value); return true; }
+			bool end_object() override { this->stack_.pop_back(); return this->Value(); }
+			bool start_array(std::size_t) override { this->stack_.push_back({ true, 0, {} }); return true; }
+			bool end_array() override { this->stack_.pop_back(); return this->Value(); }
+
+			bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override { return false; }
+
+		private:
+			struct Frame {
+				bool array;
+				size_t index;
+				std::string key;
+			};
+
+			// a value is over, the array holding it moves on to the next element
+			bool Value() {
+				if (!this->stack_.empty() && this->stack_.back().array) {
+					this->stack_.back().index++;
+				}
+				return true;
+			}
+
+			// "" stands for the first element of an array
+			bool At(std::initializer_list<const char*> path) const {
+				if (this->stack_.size() != path.size()) {
+					return false;
+				}
+				size_t depth = 0;
+				for (const char* name : path) {
+					const Frame& frame = this->stack_[depth++];
+					if (frame.array ? frame.index != 0 || *name != '\0' : frame.key != name) {
+						return false;
+					}
+				}
+				return true;
+			}
+
+			template <class T>
+			void Usage(T value) {
+				if (this->stack_.empty() || this->stack_[0].array || this->stack_[0].key != "usage") {
+					return;
+				}
+				if (this->stack_.size() == 2 && !this->stack_[1].array) {
+					this->usage_[this->stack_[1].key] = value;
+				}
+				else if (this->stack_.size() == 3 && !this->stack_[1].array && !this->stack_[2].array) {
+					this->usage_[this->stack_[1].key][this->stack_[2].key] = value;
+				}
+			}
+
+			std::string& content_;
+			nlohmann::json& usage_;
+			std::vector<Frame> stack_;
+	};
+}
+
+std::string liboai::ChatMessages::RequestBody(std::string_view model, std::optional<float> temperature, bool stream) const {
+	std::string temperatureText = temperature ? nlohmann::json(temperature.value()).dump() : std::string();
+
+	// measured first, so the body is allocated once
+	size_t length = 64 + escapedLength(model) + temperatureText.size();
+	for (const auto& message : this->messages_) {
+		length += 40 + escapedLength(message.second);
+	}
+
+	std::string body;
+	body.reserve(length);
+	body += "{\"model\":\"";
+	appendEscaped(body, model);
+	body += "\",\"messages\":[";
+	for (size_t i = 0; i < this->messages_.size(); ++i) {
+		if (i > 0) {
+			body += ',';
+		}
+		body += "{\"role\":\"";
+		body += roleName(this->messages_[i].first);
+		body += "\",\"content\":\"";
+		appendEscaped(body, this->messages_[i].second);
+		body += "\"}";
+	}
+	body += ']';
+	if (temperature) {
+		body += ",\"temperature\":";
+		body += temperatureText;
+	}
+	if (stream) {
+		// the last event of the stream carries the token usage
+		body += ",\"stream\":true,\"stream_options\":{\"include_usage\":true}";
+	}
+	body += '}';
+	return body;
+}
+
+bool liboai::ExtractChatReply(std::string_view body, std::string& content, nlohmann::json& usage) {
+	ReplyHandler handler(content, usage);
+	nlohmann::json::sax_parse(body.begin(), body.end(), &handler);
+	return handler.found;
+}
+
+liboai::Response liboai::ChatCompletion::create(const std::string& model, const ChatMessages& messages, std::optional<float> temperature, std::optional<std::function<bool(std::string, intptr_t)>> stream) const& noexcept(false) {
+	return this->Request(
+		Method::HTTP_POST, this->openai_root_, "/chat/completions", "application/json",
+		this->authorization_headers(),
+		netimpl::components::Body {
+			messages.RequestBody(model, temperature, stream.has_value())
+		},
+		stream ? netimpl::components::WriteCallback{ std::move(stream.value()) } : netimpl::components::WriteCallback{},
+		netimpl::components::RawContent{},
+		this->auth_.GetProxies(),
+		this->auth_.GetProxyAuth(),
+		this->auth_.GetMaxTimeout()
+	);
+}
+
+void liboai::ChatCompletion::create_async(const std::string& model, const ChatMessages& messages, netimpl::Completion on_done, std::optional<float> temperature, std::optional<std::function<bool(std::string, intptr_t)>> stream, std::optional<std::function<bool(curl_off_t, curl_off_t, curl_off_t, curl_off_t, intptr_t)>> progress) const& noexcept(false) {
+	this->RequestAsync(
+		Method::HTTP_POST, this->openai_root_, "/chat/completions", "application/json",
+		this->authorization_headers(),
+		std::move(on_done),
+		netimpl::components::Body {
+			messages.RequestBody(model, temperature, stream.has_value())
+		},
+		stream ? netimpl::components::WriteCallback{ std::move(stream.value()) } : netimpl::components::WriteCallback{},
+		progress ? netimpl::components::ProgressCallback{ std::move(progress.value()) } : netimpl::components::ProgressCallback{},
+		netimpl::components::RawContent{},
+		this->auth_.GetProxies(),
+		this->auth_.GetProxyAuth(),
+		this->auth_.GetMaxTimeout()
+	);
+}
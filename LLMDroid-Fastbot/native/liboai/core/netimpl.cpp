@@ -1,5 +1,9 @@
 #include "../include/core/netimpl.h"
 #include "../../Base.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <thread>
 
 liboai::netimpl::CurlHolder::CurlHolder() {
 	std::lock_guard<std::mutex> lock{ this->curl_easy_get_mutex_() };
@@ -28,34 +32,201 @@ liboai::netimpl::CurlHolder::CurlHolder() {
 		}
 	}
 	
-	this->curl_ = curl_easy_init();
-	if (!this->curl_) {
-		throw liboai::exception::OpenAIException(
-			curl_easy_strerror(CURLE_FAILED_INIT),
-			liboai::exception::EType::E_CURLERROR,
-			"liboai::netimpl::CurlHolder::CurlHolder()"
-		);
-	}
-
-	#if defined(LIBOAI_DEBUG)
-		curl_easy_setopt(this->curl_, CURLOPT_VERBOSE, 1L);
-	#endif
+	this->curl_ = HandlePool::Instance().Acquire();
 }
 
 liboai::netimpl::CurlHolder::~CurlHolder() {
 	if (this->curl_) {
-		curl_easy_cleanup(this->curl_);
+		HandlePool::Instance().Release(this->curl_);
 		this->curl_ = nullptr;
 		
 		#if defined(LIBOAI_DEBUG)
 			_liboai_dbg(
-				"[dbg] [@%s] curl_easy_cleanup() called.\n",
+				"[dbg] [@%s] handle released to the pool.\n",
 				__func__
 			);
 		#endif
 	}
 }
 
+liboai::netimpl::HandlePool& liboai::netimpl::HandlePool::Instance() {
+	static HandlePool* instance = new HandlePool();
+	return *instance;
+}
+
+liboai::netimpl::HandlePool::HandlePool() {
+	this->share_ = curl_share_init();
+	if (this->share_) {
+		curl_share_setopt(this->share_, CURLSHOPT_LOCKFUNC, &HandlePool::Lock);
+		curl_share_setopt(this->share_, CURLSHOPT_UNLOCKFUNC, &HandlePool::Unlock);
+		curl_share_setopt(this->share_, CURLSHOPT_USERDATA, this);
+		curl_share_setopt(this->share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(this->share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
+}
+
+void liboai::netimpl::HandlePool::Lock(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+	static_cast<HandlePool*>(userptr)->share_mutexes_[data].lock();
+}
+
+void liboai::netimpl::HandlePool::Unlock(CURL*, curl_lock_data data, void* userptr) {
+	static_cast<HandlePool*>(userptr)->share_mutexes_[data].unlock();
+}
+
+void liboai::netimpl::HandlePool::Configure(CURL* curl) {
+	if (this->share_) {
+		curl_easy_setopt(curl, CURLOPT_SHARE, this->share_);
+	}
+	// probe idle connections so the server and middleboxes keep them open between questions
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 30L);
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 15L);
+
+	#if defined(LIBOAI_DEBUG)
+		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+	#endif
+}
+
+CURL* liboai::netimpl::HandlePool::Acquire() {
+	CURL* curl = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		if (!this->idle_.empty()) {
+			curl = this->idle_.back();
+			this->idle_.pop_back();
+			this->reused_++;
+		}
+		else {
+			this->created_++;
+		}
+	}
+	if (!curl) {
+		curl = curl_easy_init();
+		if (!curl) {
+			throw liboai::exception::OpenAIException(
+				curl_easy_strerror(CURLE_FAILED_INIT),
+				liboai::exception::EType::E_CURLERROR,
+				"liboai::netimpl::HandlePool::Acquire()"
+			);
+		}
+	}
+	this->Configure(curl);
+	return curl;
+}
+
+void liboai::netimpl::HandlePool::Release(CURL* curl) {
+	// drops the options pointing into the finished session, keeps the connection and caches
+	curl_easy_reset(curl);
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		if (this->idle_.size() < max_idle_) {
+			this->idle_.push_back(curl);
+			return;
+		}
+	}
+	curl_easy_cleanup(curl);
+}
+
+liboai::netimpl::Multi& liboai::netimpl::Multi::Instance() {
+	static Multi* instance = new Multi();
+	return *instance;
+}
+
+liboai::netimpl::Multi::Multi() {
+	this->multi_ = curl_multi_init();
+	if (!this->multi_) {
+		throw liboai::exception::OpenAIException(
+			curl_easy_strerror(CURLE_FAILED_INIT),
+			liboai::exception::EType::E_CURLERROR,
+			"liboai::netimpl::Multi::Multi()"
+		);
+	}
+	curl_multi_setopt(this->multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+	std::thread(&Multi::Loop, this).detach();
+}
+
+void liboai::netimpl::Multi::Get(std::unique_ptr<Session> session, Completion done) {
+	session->PrepareGet();
+	this->Submit(std::move(session), std::move(done));
+}
+
+void liboai::netimpl::Multi::Post(std::unique_ptr<Session> session, Completion done) {
+	session->PreparePost();
+	this->Submit(std::move(session), std::move(done));
+}
+
+void liboai::netimpl::Multi::Submit(std::unique_ptr<Session> session, Completion done) {
+	// HTTP/2 where TLS negotiates it, HTTP/1.1 otherwise; wait for a connection
+	// being set up rather than opening another one to multiplex on it. Only TLS
+	// tells that early, over plain http the wait would last until the reply
+	curl_easy_setopt(session->curl_, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+	if (session->url_.rfind("https:", 0) == 0) {
+		curl_easy_setopt(session->curl_, CURLOPT_PIPEWAIT, 1L);
+	}
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		this->pending_.push_back(Transfer{ std::move(session), std::move(done) });
+		this->in_flight_++;
+	}
+	curl_multi_wakeup(this->multi_);
+}
+
+void liboai::netimpl::Multi::Loop() {
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> lock(this->mutex_);
+			for (auto& transfer : this->pending_) {
+				CURL* curl = transfer.session->curl_;
+				curl_multi_add_handle(this->multi_, curl);
+				this->running_.emplace(curl, std::move(transfer));
+			}
+			this->pending_.clear();
+		}
+
+		int running = 0;
+		curl_multi_perform(this->multi_, &running);
+
+		CURLMsg* msg = nullptr;
+		int queued = 0;
+		while ((msg = curl_multi_info_read(this->multi_, &queued)) != nullptr) {
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+			CURL* curl = msg->easy_handle;
+			CURLcode result = msg->data.result;
+			curl_multi_remove_handle(this->multi_, curl);
+			auto found = this->running_.find(curl);
+			if (found == this->running_.end()) {
+				continue;
+			}
+			Transfer transfer = std::move(found->second);
+			this->running_.erase(found);
+
+			liboai::Response response;
+			std::exception_ptr error;
+			try {
+				ErrorCheck(result, "liboai::netimpl::Multi::Loop()");
+				response = transfer.session->Complete();
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+			// the handle goes back to the pool before the caller may submit the next request
+			transfer.session.reset();
+			this->in_flight_--;
+			try {
+				transfer.done(std::move(response), error);
+			}
+			catch (...) {
+				// a throwing completion must not stop the other transfers
+			}
+		}
+
+		// woken by Submit, or when a socket is ready
+		curl_multi_poll(this->multi_, nullptr, 0, 1000, nullptr);
+	}
+}
+
 liboai::netimpl::Session::~Session() {	
 	if (this->headers) {
 		curl_slist_free_all(this->headers);
@@ -272,7 +443,7 @@ liboai::Response liboai::netimpl::Session::BuildResponseObject() {
 	#endif	
 
 	// fill status line and reason
-	this->ParseResponseHeader(this->header_string_, &this->status_line, &this->reason);
+	this->ParseResponseHeader(this->header_string_, &this->status_line, &this->reason, &this->retry_after_ms);
 
 	#if defined(LIBOAI_DEBUG)
 		_liboai_dbg(
@@ -324,7 +495,9 @@ liboai::Response liboai::netimpl::Session::BuildResponseObject() {
 		std::move(this->status_line),
 		std::move(this->reason),
 		this->status_code,
-		this->elapsed
+		this->elapsed,
+		this->retry_after_ms,
+		this->parseJson
 	};
 }
 
@@ -618,7 +791,7 @@ liboai::Response liboai::netimpl::Session::Download(std::ofstream& file) {
 	return CompleteDownload();
 }
 
-void liboai::netimpl::Session::ParseResponseHeader(const std::string& headers, std::string* status_line, std::string* reason) {
+void liboai::netimpl::Session::ParseResponseHeader(const std::string& headers, std::string* status_line, std::string* reason, long* retry_after_ms) {
     std::vector<std::string> lines;
     std::istringstream stream(headers);
     {
@@ -658,6 +831,22 @@ void liboai::netimpl::Session::ParseResponseHeader(const std::string& headers, s
                 std::string value = line.substr(found + 1);
                 value.erase(0, value.find_first_not_of("\t "));
                 value.resize(std::min<size_t>(value.size(), value.find_last_not_of("\t\n\r ") + 1));
+
+                // only the delay form of Retry-After is used, an http date is ignored
+                if (retry_after_ms != nullptr) {
+                    std::string name = line.substr(0, found);
+                    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+                    char* end = nullptr;
+                    double delay = std::strtod(value.c_str(), &end);
+                    if (end != value.c_str() && *end == '\0' && delay >= 0) {
+                        if (name == "retry-after-ms") {
+                            *retry_after_ms = static_cast<long>(delay);
+                        }
+                        else if (name == "retry-after" && *retry_after_ms < 0) {
+                            *retry_after_ms = static_cast<long>(delay * 1000);
+                        }
+                    }
+                }
             }
         }
     }
@@ -718,13 +907,14 @@ void liboai::netimpl::Session::SetBody(components::Body&& body) {
 	CURLcode e[2]; memset(e, CURLcode::CURLE_OK, sizeof(e));
 
 	this->hasBody = true;
-	e[0] = curl_easy_setopt(this->curl_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(body.str().length()));
-	e[1] = curl_easy_setopt(this->curl_, CURLOPT_COPYPOSTFIELDS, body.c_str());
+	this->body_ = std::move(body);
+	e[0] = curl_easy_setopt(this->curl_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(this->body_.str().length()));
+	e[1] = curl_easy_setopt(this->curl_, CURLOPT_POSTFIELDS, this->body_.c_str());
 
 	#if defined(LIBOAI_DEBUG)
 		_liboai_dbg(
-			"[dbg] [@%s] Set CURLOPT_POSTFIELDSIZE_LARGE and CURLOPT_COPYPOSTFIELDS for Session (0x%p) to %lld and \"%s\".\n",
-			__func__, this, static_cast<curl_off_t>(body.str().length()), body.c_str()
+			"[dbg] [@%s] Set CURLOPT_POSTFIELDSIZE_LARGE and CURLOPT_POSTFIELDS for Session (0x%p) to %lld and \"%s\".\n",
+			__func__, this, static_cast<curl_off_t>(this->body_.str().length()), this->body_.c_str()
 		);
 	#endif
 		
@@ -1018,6 +1208,11 @@ size_t liboai::netimpl::components::writeUserFunction(char* ptr, size_t size, si
 	return (*write)({ ptr, size }) ? size : 0;
 }
 
+int liboai::netimpl::components::progressUserFunction(const ProgressCallback* progress, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+	// non-zero aborts the transfer with CURLE_ABORTED_BY_CALLBACK
+	return (*progress)(dltotal, dlnow, ultotal, ulnow) ? 0 : 1;
+}
+
 size_t liboai::netimpl::components::writeFunction(char* ptr, size_t size, size_t nmemb, std::string* data) {
 	#if defined(LIBOAI_DEBUG)
 		_liboai_dbg(
@@ -1249,6 +1444,10 @@ void liboai::netimpl::Session::SetTimeout(const components::Timeout& timeout) {
 	ErrorCheck(e, "liboai::netimpl::Session::SetTimeout()");
 }
 
+void liboai::netimpl::Session::SetOption(const components::RawContent&) {
+	this->parseJson = false;
+}
+
 void liboai::netimpl::Session::SetOption(const components::Proxies& proxies) {
 	this->SetProxies(proxies);
 }
@@ -1355,6 +1554,54 @@ void liboai::netimpl::Session::SetWriteCallback(components::WriteCallback&& writ
 	}
 }
 
+void liboai::netimpl::Session::SetOption(const components::ProgressCallback& progress) {
+	this->SetProgressCallback(progress);
+}
+
+void liboai::netimpl::Session::SetProgressCallback(const components::ProgressCallback& progress) {
+	if (progress.callback) {
+		CURLcode e[3]; memset(e, CURLcode::CURLE_OK, sizeof(e));
+
+		e[0] = curl_easy_setopt(this->curl_, CURLOPT_XFERINFOFUNCTION, components::progressUserFunction);
+		this->progress_ = progress;
+		e[1] = curl_easy_setopt(this->curl_, CURLOPT_XFERINFODATA, &this->progress_);
+		e[2] = curl_easy_setopt(this->curl_, CURLOPT_NOPROGRESS, 0L);
+
+		#if defined(LIBOAI_DEBUG)
+			_liboai_dbg(
+				"[dbg] [@%s] Set user supplied progress callback.\n",
+				__func__
+			);
+		#endif
+
+		ErrorCheck(e, 3, "liboai::netimpl::Session::SetProgressCallback()");
+	}
+}
+
+void liboai::netimpl::Session::SetOption(components::ProgressCallback&& progress) {
+	this->SetProgressCallback(std::move(progress));
+}
+
+void liboai::netimpl::Session::SetProgressCallback(components::ProgressCallback&& progress) {
+	if (progress.callback) {
+		CURLcode e[3]; memset(e, CURLcode::CURLE_OK, sizeof(e));
+
+		e[0] = curl_easy_setopt(this->curl_, CURLOPT_XFERINFOFUNCTION, components::progressUserFunction);
+		this->progress_ = std::move(progress);
+		e[1] = curl_easy_setopt(this->curl_, CURLOPT_XFERINFODATA, &this->progress_);
+		e[2] = curl_easy_setopt(this->curl_, CURLOPT_NOPROGRESS, 0L);
+
+		#if defined(LIBOAI_DEBUG)
+			_liboai_dbg(
+				"[dbg] [@%s] Set user supplied progress callback.\n",
+				__func__
+			);
+		#endif
+
+		ErrorCheck(e, 3, "liboai::netimpl::Session::SetProgressCallback()");
+	}
+}
+
 liboai::netimpl::components::Proxies::Proxies(const std::initializer_list<std::pair<const std::string, std::string>>& hosts)
 	: hosts_{ hosts } {}
 
@@ -2,19 +2,21 @@
 #include "../../Base.h"
 
 liboai::Response::Response(const liboai::Response& other) noexcept
-	: status_code(other.status_code), elapsed(other.elapsed), status_line(other.status_line),
+	: status_code(other.status_code), elapsed(other.elapsed), retry_after_ms(other.retry_after_ms), status_line(other.status_line),
 	content(other.content), url(other.url), reason(other.reason), raw_json(other.raw_json) {}
 
 liboai::Response::Response(liboai::Response&& other) noexcept
-	: status_code(other.status_code), elapsed(other.elapsed), status_line(std::move(other.status_line)),
+	: status_code(other.status_code), elapsed(other.elapsed), retry_after_ms(other.retry_after_ms), status_line(std::move(other.status_line)),
 	content(std::move(other.content)), url(std::move(other.url)), reason(std::move(other.reason)), raw_json(std::move(other.raw_json)) {}
 
-liboai::Response::Response(std::string&& url, std::string&& content, std::string&& status_line, std::string&& reason, long status_code, double elapsed) noexcept(false) 
-	: status_code(status_code), elapsed(elapsed), status_line(std::move(status_line)),
+liboai::Response::Response(std::string&& url, std::string&& content, std::string&& status_line, std::string&& reason, long status_code, double elapsed, long retry_after_ms, bool parse_json) noexcept(false) 
+	: status_code(status_code), elapsed(elapsed), retry_after_ms(retry_after_ms), status_line(std::move(status_line)),
 	content(std::move(content)), url(url), reason(std::move(reason))
 {
+	// a successful body the caller reads itself is left as it is
+	bool failed = this->status_code < 200 || this->status_code >= 300;
 	try {
-		if (!this->content.empty()) {
+		if (!this->content.empty() && (parse_json || failed)) {
 			if (this->content[0] == '{') {
 				this->raw_json = nlohmann::json::parse(this->content);
 			}
@@ -41,6 +43,7 @@ liboai::Response::Response(std::string&& url, std::string&& content, std::string
 liboai::Response& liboai::Response::operator=(const liboai::Response& other) noexcept {
 	this->status_code = other.status_code;
 	this->elapsed = other.elapsed;
+	this->retry_after_ms = other.retry_after_ms;
 	this->status_line = other.status_line;
 	this->content = other.content;
 	this->url = other.url;
@@ -53,6 +56,7 @@ liboai::Response& liboai::Response::operator=(const liboai::Response& other) noe
 liboai::Response& liboai::Response::operator=(liboai::Response&& other) noexcept {
 	this->status_code = other.status_code;
 	this->elapsed = other.elapsed;
+	this->retry_after_ms = other.retry_after_ms;
 	this->status_line = std::move(other.status_line);
 	this->content = std::move(other.content);
 	this->url = std::move(other.url);
@@ -72,7 +76,8 @@ void liboai::Response::CheckResponse() const noexcept(false) {
 		throw liboai::exception::OpenAIRateLimited(
 			!this->reason.empty() ? this->reason : "Rate limited",
 			liboai::exception::EType::E_RATELIMIT,
-			"liboai::Response::CheckResponse()"
+			"liboai::Response::CheckResponse()",
+			this->retry_after_ms
 		);
 	}
 	else if (this->status_code == 0) {
@@ -92,6 +92,15 @@ namespace liboai {
 			*/
 			LIBOAI_EXPORT bool AddUserData(std::string_view data) & noexcept(false);
 
+			/*
+				@brief Adds an earlier response of the assistant to the conversation.
+					Used to replay a conversation kept outside of this object,
+					the reply to the next user input is asked with it as history.
+
+					@param *data      The assistant response to add.
+			*/
+			LIBOAI_EXPORT bool AddAssistantData(std::string_view data) & noexcept(false);
+
 			/*
 				@brief Removes the last added user data.
 			*/
@@ -170,6 +179,43 @@ namespace liboai {
 			nlohmann::json _conversation;
 	};
 
+	/*
+		@brief Compact store of the messages of one chat request.
+			Unlike Conversation, the messages are plain strings, not a json
+			tree, and the request body is written straight from them into a
+			single buffer sized beforehand. Meant for requests built, sent
+			and dropped right away; the reply is read with ExtractChatReply.
+	*/
+	class ChatMessages final {
+		public:
+			enum class Role : uint8_t {
+				SYSTEM, USER, ASSISTANT
+			};
+
+			void Add(Role role, std::string content) { this->messages_.push_back({ role, std::move(content) }); }
+			void AddUserData(std::string data) { this->Add(Role::USER, std::move(data)); }
+			void AddAssistantData(std::string data) { this->Add(Role::ASSISTANT, std::move(data)); }
+
+			size_t Size() const noexcept { return this->messages_.size(); }
+
+			/*
+				@brief The body of a chat completion request for these messages.
+			*/
+			LIBOAI_EXPORT std::string RequestBody(std::string_view model, std::optional<float> temperature, bool stream) const;
+
+		private:
+			std::vector<std::pair<Role, std::string>> messages_;
+	};
+
+	/*
+		@brief Reads the first choice's message content and the usage from the
+			body of a non-streamed chat completion, without building a json
+			tree of the whole body.
+
+		@returns false if the body holds no message content.
+	*/
+	LIBOAI_EXPORT bool ExtractChatReply(std::string_view body, std::string& content, nlohmann::json& usage);
+
 	class ChatCompletion final : public Network {
 		public:
 			ChatCompletion() = default;
@@ -180,6 +226,14 @@ namespace liboai {
 			ChatCompletion& operator=(const ChatCompletion&) = delete;
 			ChatCompletion& operator=(ChatCompletion&&) = delete;
 
+			/*
+				@brief Sends this key instead of the one of the shared
+					Authorization, for an endpoint with its own account.
+			*/
+			void set_api_key(std::string_view key) {
+				this->key_headers_ = netimpl::components::Header{ { "Authorization", "Bearer " + std::string(key) } };
+			}
+
 			/*
 				@brief Creates a completion for the chat message.
 
@@ -292,7 +346,88 @@ namespace liboai {
 				std::optional<std::string> user = std::nullopt
 			) const& noexcept(false);
 
+			/*
+				@brief Creates a completion for the chat message without
+					blocking and without a thread of its own; on_done is
+					called with the response, or the error create would
+					have thrown, once it is over. Many of these share one
+					I/O thread, and one HTTP/2 connection per host when
+					the server supports it. on_done and stream run on
+					that thread and must return quickly.
+
+				@param *model            ID of the model to use.
+				@param *conversation     A Conversation object containing the
+										 conversation data.
+				@param *on_done          Called once with the response or the error.
+				@param temperature       What sampling temperature to use, as for create.
+				@param stream            If set, partial message deltas are passed
+										 to it as server-sent events, as for create.
+				@param max_tokens        The maximum number of tokens allowed for the
+										 generated answer, as for create.
+			*/
+			LIBOAI_EXPORT void create_async(
+				const std::string& model,
+				const Conversation& conversation,
+				netimpl::Completion on_done,
+				std::optional<float> temperature = std::nullopt,
+				std::optional<std::function<bool(std::string, intptr_t)>> stream = std::nullopt,
+				std::optional<uint16_t> max_tokens = std::nullopt
+			) const& noexcept(false);
+
+			/*
+				@brief Lists the models at the base url of this completion
+					with its key, without blocking, like create_async above.
+					Nothing is generated, so it is a cheap way to open the
+					connection and to check the url and the key.
+
+				@param *on_done          Called once with the response or the error.
+			*/
+			LIBOAI_EXPORT void list_models_async(
+				netimpl::Completion on_done
+			) const& noexcept(false);
+
+			/*
+				@brief Creates a completion for the messages, see create above.
+					The body of a successful non-streamed response is left
+					unparsed in Response::content for ExtractChatReply.
+			*/
+			LIBOAI_EXPORT liboai::Response create(
+				const std::string& model,
+				const ChatMessages& messages,
+				std::optional<float> temperature = std::nullopt,
+				std::optional<std::function<bool(std::string, intptr_t)>> stream = std::nullopt
+			) const& noexcept(false);
+
+			/*
+				@brief Creates a completion for the messages without
+					blocking, see the create_async that takes on_done
+					above and create for the body.
+
+				@param *model            ID of the model to use.
+				@param *messages         The messages of the chat.
+				@param *on_done          Called once with the response or the error.
+				@param temperature       What sampling temperature to use, as for create.
+				@param stream            If set, partial message deltas are passed
+										 to it as server-sent events, as for create.
+				@param progress          Called on the I/O thread while the request
+										 runs, at least once a second; the request
+										 is aborted when it returns false.
+			*/
+			LIBOAI_EXPORT void create_async(
+				const std::string& model,
+				const ChatMessages& messages,
+				netimpl::Completion on_done,
+				std::optional<float> temperature = std::nullopt,
+				std::optional<std::function<bool(std::string, intptr_t)>> stream = std::nullopt,
+				std::optional<std::function<bool(curl_off_t, curl_off_t, curl_off_t, curl_off_t, intptr_t)>> progress = std::nullopt
+			) const& noexcept(false);
+
 		private:
+			const netimpl::components::Header& authorization_headers() const noexcept {
+				return this->key_headers_ ? *this->key_headers_ : this->auth_.GetAuthorizationHeaders();
+			}
+
 			Authorization& auth_ = Authorization::Authorizer();
+			std::optional<netimpl::components::Header> key_headers_;
 	};
 }
\ No newline at end of file
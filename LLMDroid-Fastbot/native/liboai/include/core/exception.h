@@ -64,11 +64,11 @@ namespace liboai {
 			public:
 				OpenAIRateLimited() = default;
 				OpenAIRateLimited(const OpenAIRateLimited& rhs) noexcept
-					: data_(rhs.data_), error_type_(rhs.error_type_), locale_(rhs.locale_) { this->fmt_str_ = (this->locale_ + ": " + this->data_ + " (" + this->GetETypeString(this->error_type_) + ")"); }
+					: data_(rhs.data_), error_type_(rhs.error_type_), locale_(rhs.locale_), retry_after_ms_(rhs.retry_after_ms_) { this->fmt_str_ = (this->locale_ + ": " + this->data_ + " (" + this->GetETypeString(this->error_type_) + ")"); }
 				OpenAIRateLimited(OpenAIRateLimited&& rhs) noexcept
-					: data_(std::move(rhs.data_)), error_type_(rhs.error_type_), locale_(std::move(rhs.locale_)) { this->fmt_str_ = (this->locale_ + ": " + this->data_ + " (" + this->GetETypeString(this->error_type_) + ")"); }
-				OpenAIRateLimited(std::string_view data, EType error_type, std::string_view locale) noexcept
-					: data_(data), error_type_(error_type), locale_(locale) { this->fmt_str_ = (this->locale_ + ": " + this->data_ + " (" + this->GetETypeString(this->error_type_) + ")"); }
+					: data_(std::move(rhs.data_)), error_type_(rhs.error_type_), locale_(std::move(rhs.locale_)), retry_after_ms_(rhs.retry_after_ms_) { this->fmt_str_ = (this->locale_ + ": " + this->data_ + " (" + this->GetETypeString(this->error_type_) + ")"); }
+				OpenAIRateLimited(std::string_view data, EType error_type, std::string_view locale, long retry_after_ms = -1) noexcept
+					: data_(data), error_type_(error_type), locale_(locale), retry_after_ms_(retry_after_ms) { this->fmt_str_ = (this->locale_ + ": " + this->data_ + " (" + this->GetETypeString(this->error_type_) + ")"); }
 
 				const char* what() const noexcept override {
 					return this->fmt_str_.c_str();
@@ -78,9 +78,18 @@ namespace liboai {
 					return _etype_strs_[static_cast<uint8_t>(type)];
 				}
 
+				/*
+					@brief The delay the server asked for before retrying,
+						-1 if it didn't send one.
+				*/
+				long GetRetryAfterMs() const noexcept {
+					return this->retry_after_ms_;
+				}
+
 			private:
 				EType error_type_;
 				std::string data_, locale_, fmt_str_;
+				long retry_after_ms_ = -1;
 		};
 	}
 }
\ No newline at end of file
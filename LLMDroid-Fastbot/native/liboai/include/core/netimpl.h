@@ -43,6 +43,12 @@
 #include <mutex>
 #include <future>
 #include <sstream>
+#include <vector>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <unordered_map>
 #include <curl/curl.h>
 #include "response.h"
 
@@ -58,6 +64,59 @@ namespace liboai {
 			void ErrorCheck(CURLFORMcode ecode, std::string_view where);
 		#endif
 
+		/*
+			Process-wide pool of easy handles. Handles are reset and kept
+				when a request is over, so the next request on the same
+				handle reuses its connection. All handles share one CURLSH
+				for DNS results and TLS sessions, so a new connection of
+				any thread resumes the session another one set up.
+				Connections stay in the cache of their own handle, libcurl
+				doesn't support sharing them between threads running
+				transfers at the same time.
+				The pool is never destroyed, a detached thread may still
+				hold a handle at exit.
+		*/
+		class HandlePool final {
+			public:
+				HandlePool(const HandlePool&) = delete;
+				HandlePool(HandlePool&&) = delete;
+				HandlePool& operator=(const HandlePool&) = delete;
+				HandlePool& operator=(HandlePool&&) = delete;
+
+				static HandlePool& Instance();
+
+				/*
+					@brief An idle handle, or a new one when all are busy.
+						Its options are the defaults plus the share and keep-alive.
+				*/
+				CURL* Acquire();
+
+				/*
+					@brief Give a handle back once its request is over.
+						Beyond the idle limit it is cleaned up instead.
+				*/
+				void Release(CURL* curl);
+
+				size_t Created() const noexcept { return this->created_; }
+				size_t Reused() const noexcept { return this->reused_; }
+
+			private:
+				HandlePool();
+
+				void Configure(CURL* curl);
+
+				static void Lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+				static void Unlock(CURL* handle, curl_lock_data data, void* userptr);
+
+				static constexpr size_t max_idle_ = 8;
+
+				CURLSH* share_ = nullptr;
+				std::mutex share_mutexes_[CURL_LOCK_DATA_LAST];
+				std::mutex mutex_; // idle_ and the counters
+				std::vector<CURL*> idle_;
+				size_t created_ = 0, reused_ = 0;
+		};
+
 		class CurlHolder {
 			public:
 				CurlHolder();
@@ -475,6 +534,14 @@ namespace liboai {
 					std::chrono::milliseconds ms;
 			};
 
+			/*
+				Leaves a successful response body unparsed in
+					Response::content, for callers that read only a few
+					fields of it; raw_json stays null. The body of an
+					error response is still parsed for its message.
+			*/
+			class RawContent final {};
+
 			class Proxies final {
 				public:
 					Proxies() = default;
@@ -599,7 +666,35 @@ namespace liboai {
 					intptr_t userdata{};
 					std::function<bool(std::string data, intptr_t userdata)> callback;
 			};
+			class ProgressCallback final {
+				public:
+					ProgressCallback() = default;
+					ProgressCallback(const ProgressCallback& other) : callback(other.callback), userdata(other.userdata) {}
+					ProgressCallback(ProgressCallback&& old) noexcept : callback(std::move(old.callback)), userdata(std::move(old.userdata)) {}
+					ProgressCallback(std::function<bool(curl_off_t downloadTotal, curl_off_t downloadNow, curl_off_t uploadTotal, curl_off_t uploadNow, intptr_t userdata)> p_callback, intptr_t p_userdata = 0)
+						: userdata(p_userdata), callback(std::move(p_callback)) {}
+
+					ProgressCallback& operator=(const ProgressCallback& other) {
+						this->callback = other.callback;
+						this->userdata = other.userdata;
+						return *this;
+					}
+					ProgressCallback& operator=(ProgressCallback&& old) noexcept {
+						this->callback = std::move(old.callback);
+						this->userdata = std::move(old.userdata);
+						return *this;
+					}
+
+					[[nodiscard]] bool operator()(curl_off_t downloadTotal, curl_off_t downloadNow, curl_off_t uploadTotal, curl_off_t uploadNow) const {
+						return callback(downloadTotal, downloadNow, uploadTotal, uploadNow, userdata);
+					}
+
+					intptr_t userdata{};
+					std::function<bool(curl_off_t downloadTotal, curl_off_t downloadNow, curl_off_t uploadTotal, curl_off_t uploadNow, intptr_t userdata)> callback;
+			};
+
 			size_t writeUserFunction(char* ptr, size_t size, size_t nmemb, const WriteCallback* write);
+			int progressUserFunction(const ProgressCallback* progress, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
 			size_t writeFunction(char* ptr, size_t size, size_t nmemb, std::string* data);
 			size_t writeFileFunction(char* ptr, size_t size, size_t nmemb, std::ofstream* file);
 		}
@@ -615,6 +710,8 @@ namespace liboai {
 					request method (GET, POST, etc.).
 				4. Return the resulting Response object.
 		*/
+		class Multi;
+
 		class Session final : private CurlHolder {
 			public:
 				Session() = default;
@@ -628,6 +725,7 @@ namespace liboai {
 			private:
 				template <class... _Options>
 				friend void set_options(Session&, _Options&&...);
+				friend class Multi;
 
 				void Prepare();
 				void PrepareDownloadInternal();
@@ -641,7 +739,7 @@ namespace liboai {
 				void PrepareDelete();
 				void PrepareDownload(std::ofstream& file);
 
-				void ParseResponseHeader(const std::string& headers, std::string* status_line, std::string* reason);
+				void ParseResponseHeader(const std::string& headers, std::string* status_line, std::string* reason, long* retry_after_ms = nullptr);
 
 				void SetOption(const components::Url& url);
 				void SetUrl(const components::Url& url);
@@ -667,6 +765,8 @@ namespace liboai {
 				void SetOption(const components::Timeout& timeout);
 				void SetTimeout(const components::Timeout& timeout);
 
+				void SetOption(const components::RawContent& raw);
+
 				void SetOption(const components::Proxies& proxies);
 				void SetProxies(const components::Proxies& proxies);
 				void SetOption(components::Proxies&& proxies);
@@ -682,7 +782,13 @@ namespace liboai {
 				void SetOption(components::WriteCallback&& write);
 				void SetWriteCallback(components::WriteCallback&& write);
 
+				void SetOption(const components::ProgressCallback& progress);
+				void SetProgressCallback(const components::ProgressCallback& progress);
+				void SetOption(components::ProgressCallback&& progress);
+				void SetProgressCallback(components::ProgressCallback&& progress);
+
 				long status_code = 0; double elapsed = 0.0;
+				long retry_after_ms = -1; // from a Retry-After or retry-after-ms header, -1 if absent
 				std::string status_line{}, content{}, url_str{}, reason{};
 			
 				// internally-used members...
@@ -695,12 +801,64 @@ namespace liboai {
 					curl_mime* mime = nullptr;
 				#endif
 						
-				bool hasBody = false;
+				bool hasBody = false, parseJson = true;
+				components::Body body_; // a moved in body is sent from here, without a copy by curl
 				std::string parameter_string_, url_,
 					response_string_, header_string_;
 				components::Proxies proxies_;
 				components::ProxyAuthentication proxyAuth_;
 				components::WriteCallback write_;
+				components::ProgressCallback progress_;
+		};
+
+		/*
+			Called once a request submitted to Multi is over, with its
+				response, or with the error that a blocking request
+				would have thrown.
+		*/
+		using Completion = std::function<void(liboai::Response, std::exception_ptr)>;
+
+		/*
+			Event-driven transport for requests that don't block the
+				caller. A single I/O thread drives every submitted Session
+				with curl_multi, so any number of requests in flight cost
+				no thread each. Requests to one host are multiplexed over
+				a single HTTP/2 connection when the server negotiates it.
+				Completions, and the WriteCallback of a streamed reply
+				or a ProgressCallback, run on the I/O thread and must
+				not block it.
+				Never destroyed, like HandlePool.
+		*/
+		class Multi final {
+			public:
+				Multi(const Multi&) = delete;
+				Multi(Multi&&) = delete;
+				Multi& operator=(const Multi&) = delete;
+				Multi& operator=(Multi&&) = delete;
+
+				static Multi& Instance();
+
+				void Get(std::unique_ptr<Session> session, Completion done);
+				void Post(std::unique_ptr<Session> session, Completion done);
+
+				size_t InFlight() const noexcept { return this->in_flight_; }
+
+			private:
+				Multi();
+
+				void Submit(std::unique_ptr<Session> session, Completion done);
+				void Loop();
+
+				struct Transfer {
+					std::unique_ptr<Session> session;
+					Completion done;
+				};
+
+				CURLM* multi_ = nullptr;
+				std::mutex mutex_; // pending_
+				std::vector<Transfer> pending_;
+				std::unordered_map<CURL*, Transfer> running_; // I/O thread only
+				std::atomic<size_t> in_flight_{ 0 };
 		};
 
 		template <class... _Options>
@@ -731,6 +889,20 @@ namespace liboai {
 			return session.Download(file);
 		}
 
+		template <class... _Options>
+		void GetAsync(Completion done, _Options&&... options) {
+			auto session = std::make_unique<Session>();
+			set_options(*session, std::forward<_Options>(options)...);
+			Multi::Instance().Get(std::move(session), std::move(done));
+		}
+
+		template <class... _Options>
+		void PostAsync(Completion done, _Options&&... options) {
+			auto session = std::make_unique<Session>();
+			set_options(*session, std::forward<_Options>(options)...);
+			Multi::Instance().Post(std::move(session), std::move(done));
+		}
+
 		template <class... _Options>
 		void set_options(Session& session, _Options&&... opts) {
 			(session.SetOption(std::forward<_Options>(opts)), ...);
@@ -139,6 +139,45 @@ namespace liboai {
 				return res;
 			}
 
+			/*
+				@brief Like Request, but returns at once and calls done
+					on the I/O thread of netimpl::Multi when the request
+					is over. Only GET and POST are supported.
+			*/
+			template <class... _Params,
+				std::enable_if_t<std::conjunction_v<std::negation<std::is_lvalue_reference<_Params>>...>, int> = 0>
+			inline void RequestAsync(
+				const Method& http_method,
+				const std::string& root,
+				const std::string& endpoint,
+				const std::string& content_type,
+				std::optional<netimpl::components::Header> headers,
+				netimpl::Completion done,
+				_Params&&... parameters
+			) const {
+				netimpl::components::Header _headers = { { "Content-Type", content_type } };
+				if (headers) {
+					for (auto& i : headers.value()) {
+						_headers.insert(std::move(i));
+					}
+				}
+
+				switch (http_method) {
+					case Method::HTTP_GET:
+						netimpl::GetAsync(std::move(done), netimpl::components::Url{ root + endpoint }, std::move(_headers), std::forward<_Params>(parameters)...);
+						break;
+					case Method::HTTP_POST:
+						netimpl::PostAsync(std::move(done), netimpl::components::Url{ root + endpoint }, std::move(_headers), std::forward<_Params>(parameters)...);
+						break;
+					default:
+						throw liboai::exception::OpenAIException(
+							"Only GET and POST requests can be sent asynchronously.",
+							liboai::exception::EType::E_BADREQUEST,
+							"liboai::Network::RequestAsync()"
+						);
+				}
+			}
+
 			/*
 				@brief Function to validate the existence and validity of
 					a file located at a provided file path. This is used
@@ -72,7 +72,9 @@ namespace liboai {
 				std::string&& status_line,
 				std::string&& reason,
 				long status_code,
-				double elapsed
+				double elapsed,
+				long retry_after_ms = -1,
+				bool parse_json = true
 			) noexcept(false);
 			
 			Response& operator=(const liboai::Response& other) noexcept;
@@ -95,6 +97,7 @@ namespace liboai {
 			
 		public:
 			long status_code = 0; double elapsed = 0.0;
+			long retry_after_ms = -1;
 			std::string status_line{}, content{}, url{}, reason{};
 			nlohmann::json raw_json{};
 
@@ -27,6 +27,35 @@ namespace fastbotx {
 // the second one, describing the percentage of times that this state been accessed over that of all the states.
     const std::pair<int, double> Graph::_defaultDistri = std::make_pair(0, 0.0);
 
+    int ActivityIndex::intern(const std::string &activity) {
+        auto iter = this->_ids.find(activity);
+        if (iter != this->_ids.end())
+            return iter->second;
+        int id = (int) this->_names.size();
+        this->_ids.emplace(activity, id);
+        this->_names.emplace_back(std::make_shared<std::string>(activity));
+        this->_visited.push_back(false);
+        return id;
+    }
+
+    int ActivityIndex::find(const std::string &activity) const {
+        auto iter = this->_ids.find(activity);
+        return iter == this->_ids.end() ? -1 : iter->second;
+    }
+
+    bool ActivityIndex::markVisited(int id) {
+        if (id < 0 || id >= (int) this->_visited.size() || this->_visited[id])
+            return false;
+        this->_visited[id] = true;
+        this->_visitedSet.emplace(this->_names[id]);
+        this->_version++;
+        return true;
+    }
+
+    stringPtr Graph::internActivity(const std::string &activity) {
+        return this->_activityIndex.name(this->_activityIndex.intern(activity));
+    }
+
     StatePtr Graph::addState(StatePtr state) {
         auto activity = state->getActivityString(); // get the activity name(activity class name) of this new state
         auto ifStateExists = this->_states.find(state); // try to find state in state caches
@@ -47,8 +76,8 @@ namespace fastbotx {
 
         this->notifyNewStateEvents(state);
 
-        this->_visitedActivities.emplace(
-                activity); // add this activity name to this set, and in this set, every name is unique.
+        // add this activity to the visited index, every name is interned only once.
+        this->_activityIndex.markVisited(this->_activityIndex.intern(*activity));
         this->_totalDistri++;
         std::string activityStr = *(activity.get());
         if (this->_activityDistri.find(activityStr) ==
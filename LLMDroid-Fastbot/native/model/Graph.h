@@ -14,6 +14,7 @@
 //#include "ReuseState.h"
 #include "Activity.h"
 #include <queue>
+#include <unordered_map>
 
 namespace fastbotx {
     class Activity;
@@ -69,6 +70,46 @@ namespace fastbotx {
     };
 
 
+    /// Interns activity names to dense integer ids and keeps the visited ones in a bitset.
+    /// Ids are never reused, so callers may cache them; the version is bumped every time
+    /// an activity is visited for the first time, so derived values can be cached against it.
+    class ActivityIndex {
+    public:
+        ActivityIndex() : _version(0) {}
+
+        /// return the id of the given activity, allocating a new one if it has never been seen
+        int intern(const std::string &activity);
+
+        /// return the id of the given activity, or -1 if it has never been interned
+        int find(const std::string &activity) const;
+
+        /// return the canonical shared string for the given id
+        const stringPtr &name(int id) const { return this->_names[id]; }
+
+        /// mark the activity as visited, return true if it was not visited before
+        bool markVisited(int id);
+
+        bool isVisited(int id) const {
+            return id >= 0 && id < (int) this->_visited.size() && this->_visited[id];
+        }
+
+        size_t size() const { return this->_names.size(); }
+
+        size_t visitedCount() const { return this->_visitedSet.size(); }
+
+        uint64_t version() const { return this->_version; }
+
+        const stringPtrSet &visitedSet() const { return this->_visitedSet; }
+
+    private:
+        std::unordered_map<std::string, int> _ids;
+        std::vector<stringPtr> _names;
+        std::vector<bool> _visited;
+        stringPtrSet _visitedSet;   // same content as the bitset, kept for callers that need names
+        uint64_t _version;
+    };
+
+
     class GraphListener {
     public:
         virtual void onAddNode(StatePtr node) = 0;
@@ -93,7 +134,19 @@ namespace fastbotx {
 
         long getTotalDistri() const { return this->_totalDistri; }
 
-        stringPtrSet getVisitedActivities() const { return this->_visitedActivities; };
+        const stringPtrSet &getVisitedActivities() const { return this->_activityIndex.visitedSet(); };
+
+        const ActivityIndex &getActivityIndex() const { return this->_activityIndex; }
+
+        /**
+         * Return the canonical string of the given activity, interning it if needed,
+         * so that every state of the same activity shares one stringPtr.
+         * @note call from main thread
+         */
+        stringPtr internActivity(const std::string &activity);
+
+        /// Return the dense id of the given activity, interning it if needed
+        int internActivityId(const std::string &activity) { return this->_activityIndex.intern(activity); }
 
         virtual ~Graph();
 
@@ -134,7 +187,7 @@ namespace fastbotx {
         std::vector<std::vector<Step>> traceback(std::vector<bool>& is_used, std::vector<std::vector<Step>>& parent, int source, int dest, int layer);
 
         StatePtrSet _states;      // all of the states in the graph
-        stringPtrSet _visitedActivities; // a string set containing all the visited activities
+        ActivityIndex _activityIndex; // interned activity names and the visited ones among them
         std::map<std::string, std::pair<int, double>> _activityDistri;
         long _totalDistri; // the count of reaching or accessing states, which could be new states or a state accessed before
         ModelActionPtrWidgetMap _widgetActions; //  query actions based on widget info
@@ -84,23 +84,6 @@ namespace fastbotx {
                                     const std::string &deviceID) {
         // the whole process begins.
         double methodStartTimestamp = currentStamp(); //the time stamp of this current time
-        ActionPtr customActionPtr = nullptr;
-        if (this->_preference) //load the preferred action in preference file specified by user in sdcard
-        {
-            BLOG("try get custom action from preference");
-            customActionPtr = this->_preference->resolvePageAndGetSpecifiedAction(activity,
-                                                                                  element);
-        }
-        // get activity
-        stringPtrSet activityStringPtrSet = this->_graph->getVisitedActivities();
-        stringPtr activityPtr = std::make_shared<std::string>(activity);
-        auto founded = activityStringPtrSet.find(
-                activityPtr); //Searches the container for an element equivalent to val and returns an iterator to it if found, otherwise it returns an iterator to set::end.
-        stringPtr activityStringPtr = nullptr;
-        if (founded == activityStringPtrSet.end())
-            activityStringPtr = activityPtr; //this is a new activity.
-        else
-            activityStringPtr = *founded; // use the cached activity.
         //  get agent
         if (this->_deviceIDAgentMap.empty())  // create a default agent
         {
@@ -114,6 +97,17 @@ namespace fastbotx {
         else
             agent = (*agentIterator).second; // get the found agent
 
+        ActionPtr customActionPtr = nullptr;
+        if (this->_preference) //load the preferred action in preference file specified by user in sdcard
+        {
+            BLOG("try get custom action from preference");
+            customActionPtr = this->_preference->resolvePageAndGetSpecifiedAction(activity,
+                                                                                  element,
+                                                                                  agent->getRandom());
+        }
+        // get activity, shared with every other state of the same activity
+        stringPtr activityStringPtr = this->_graph->internActivity(activity);
+
         // get state
         StatePtr state = nullptr;
         if (nullptr != element) // make sure the XML is not null
@@ -183,7 +177,7 @@ namespace fastbotx {
         OperatePtr opt = DeviceOperateWrapper::OperateNop;
         if (action != nullptr) {
             BLOG("selected action %s", action->toString().c_str());
-            opt = action->toOperate();
+            opt = action->toOperate(agent->getRandom());
 
             if (state)
             {
@@ -194,7 +188,7 @@ namespace fastbotx {
 
             // If there is no input content before the action, it will be randomly generated.
             if (!action->hasInput() && this->_preference) {
-                std::string inputText = this->_preference->patchOperate(opt);
+                std::string inputText = this->_preference->patchOperate(opt, agent->getRandom());
                 if (!inputText.empty()) {
                     std::string origin = action->toDescription();
                     action->setInputText(inputText);
@@ -122,6 +122,8 @@ void JNICALL Java_com_bytedance_fastbot_AiClient_fgdsaf5d(JNIEnv *env, jobject,
     auto algorithmType = (fastbotx::AlgorithmType) agentType;
     auto agentPointer = _fastbot_model->addAgent("", algorithmType, useCodeCoverage,
                                                  (fastbotx::DeviceType) deviceType);
+    // connect to the model while the app is started, the first page is analysed right after
+    agentPointer->warmUpModel();
     const char *packageNameCString = "";
     if (env)
         packageNameCString = env->GetStringUTFChars(packageName, nullptr);
@@ -0,0 +1,872 @@
+/*
+ * This code is licensed under the Fastbot license. You may obtain a copy of this license in the LICENSE.txt file in the root directory of this source tree.
+ */
+/**
+ * @authors Jianqiang Guo, Yuhui Su, Zhao Zhang
+ */
+/**
+ * A local stand-in for an OpenAI compatible chat endpoint, so GPTAgent can be run and load tested on a Linux host
+ * without an api key or network.
+ *
+ * It answers POST /v1/chat/completions, streaming or not, with an answer in the shape the question asks for:
+ * overviews (single and batched, with or without Top5), guides, function test steps, reanalyses and json fixes
+ * are recognised from the prompts in agent/prompt.h and filled in from the HTML and states in the prompt.
+ * Scripted replies take precedence over these templates.
+ * Latency, HTTP errors, malformed answers, bodies that aren't json and connections closed mid body are injected
+ * as configured. The faults of a request are drawn from the seed, the request body and how often that body was
+ * sent before, so a run is repeated exactly however the requests interleave, and a retry sees a fresh draw.
+ *
+ * GET /v1/models lists the model, GET /stats returns the counters printed on exit.
+ *
+ * Not part of the fastbot build, on the host:
+ *   g++ -std=c++17 -O2 -I../../thirdpart/json mock_llm_server.cpp -o mock_llm_server -lpthread
+ *   ./mock_llm_server --port 8089 --config mock_llm_server.json --seed 7
+ * and point the agent at it with "BaseUrl": "http://127.0.0.1:8089/v1" and any "ApiKey".
+ */
+#ifndef MockLlmServer_CPP_
+#define MockLlmServer_CPP_
+
+#include "json.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fastbotx {
+
+    namespace {
+
+        struct LatencyOptions {
+            std::string distribution = "fixed"; // fixed, uniform, normal or lognormal
+            double meanMs = 0;
+            double stddevMs = 0;
+            double minMs = 0;
+            double maxMs = 60000;
+        };
+
+        struct ScriptEntry {
+            std::string match; // substring of the last user message, empty matches all
+            std::string type;  // question type name, empty matches all
+            std::vector<std::string> replies; // served in turn
+        };
+
+        struct Options {
+            int port = 8089;
+            uint64_t seed = 1;
+            std::string model = "mock-llm";
+            LatencyOptions latency;       // before the first byte
+            long chunkDelayMs = 0;        // between stream chunks
+            size_t chunkChars = 16;       // content per stream chunk
+            double errorRate = 0;
+            std::vector<int> errorStatuses = {429, 500, 503};
+            long retryAfterSeconds = 1;   // sent with 429 and 503, < 0 for none
+            double malformedRate = 0;     // the answer is not the json the prompt asks for
+            double invalidBodyRate = 0;   // the response body itself is not json
+            double truncateRate = 0;      // the connection is closed in the middle of the body
+            int maxConcurrent = 0;        // further requests get 429, 0 for no limit
+            int testSteps = 3;            // function test steps before the function is reported done
+            std::vector<ScriptEntry> script;
+        };
+
+        enum class Fault {
+            NONE, HTTP_ERROR, MALFORMED, INVALID_BODY, TRUNCATED, OVERLOADED
+        };
+
+        const char *faultName(Fault fault) {
+            switch (fault) {
+                case Fault::HTTP_ERROR:
+                    return "http_error";
+                case Fault::MALFORMED:
+                    return "malformed";
+                case Fault::INVALID_BODY:
+                    return "invalid_body";
+                case Fault::TRUNCATED:
+                    return "truncated";
+                case Fault::OVERLOADED:
+                    return "overloaded";
+                case Fault::NONE:
+                default:
+                    return "none";
+            }
+        }
+
+        struct Stats {
+            std::mutex mutex;
+            long requests = 0;
+            long streamed = 0;
+            std::map<std::string, long> types;
+            std::map<std::string, long> faults;
+            double latencyMsSum = 0;
+
+            nlohmann::json toJson() {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                nlohmann::json data;
+                data["requests"] = this->requests;
+                data["streamed"] = this->streamed;
+                data["types"] = this->types;
+                data["faults"] = this->faults;
+                data["mean_latency_ms"] = this->requests > 0 ? this->latencyMsSum / this->requests : 0.0;
+                return data;
+            }
+        };
+
+        Options gOptions;
+        Stats gStats;
+        std::atomic<int> gActive(0);
+        std::atomic<long> gCompletionId(0);
+        std::mutex gSeenMutex;
+        std::map<uint64_t, int> gSeen;        // body hash -> times sent
+        std::map<size_t, size_t> gScriptTurn; // script entry -> replies served
+        int gListener = -1;
+
+        uint64_t fnv1a(const std::string &text) {
+            uint64_t hash = 1469598103934665603ULL;
+            for (unsigned char c: text) {
+                hash ^= c;
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        //////////////////////////////////////////////////////////////////////////////
+        // Config
+        //////////////////////////////////////////////////////////////////////////////
+
+        void loadConfig(const std::string &path) {
+            std::ifstream file(path);
+            if (!file) {
+                fprintf(stderr, "can't open config %s\n", path.c_str());
+                exit(1);
+            }
+            nlohmann::json config = nlohmann::json::parse(file, nullptr, false, true);
+            if (config.is_discarded() || !config.is_object()) {
+                fprintf(stderr, "config %s is not a json object\n", path.c_str());
+                exit(1);
+            }
+            Options &o = gOptions;
+            o.port = config.value("port", o.port);
+            o.seed = config.value("seed", o.seed);
+            o.model = config.value("model", o.model);
+            if (config.contains("latency")) {
+                const auto &latency = config["latency"];
+                o.latency.distribution = latency.value("distribution", o.latency.distribution);
+                o.latency.meanMs = latency.value("mean_ms", o.latency.meanMs);
+                o.latency.stddevMs = latency.value("stddev_ms", o.latency.stddevMs);
+                o.latency.minMs = latency.value("min_ms", o.latency.minMs);
+                o.latency.maxMs = latency.value("max_ms", o.latency.maxMs);
+            }
+            o.chunkDelayMs = config.value("chunk_delay_ms", o.chunkDelayMs);
+            o.chunkChars = std::max<size_t>(1, config.value("chunk_chars", o.chunkChars));
+            o.errorRate = config.value("error_rate", o.errorRate);
+            if (config.contains("error_statuses") && !config["error_statuses"].empty())
+                o.errorStatuses = config["error_statuses"].get<std::vector<int>>();
+            o.retryAfterSeconds = config.value("retry_after_s", o.retryAfterSeconds);
+            o.malformedRate = config.value("malformed_rate", o.malformedRate);
+            o.invalidBodyRate = config.value("invalid_body_rate", o.invalidBodyRate);
+            o.truncateRate = config.value("truncate_rate", o.truncateRate);
+            o.maxConcurrent = config.value("max_concurrent", o.maxConcurrent);
+            o.testSteps = config.value("test_steps", o.testSteps);
+            if (config.contains("script")) {
+                for (const auto &item: config["script"]) {
+                    ScriptEntry entry;
+                    entry.match = item.value("match", "");
+                    entry.type = item.value("type", "");
+                    const auto &reply = item.contains("reply") ? item["reply"] : nlohmann::json("");
+                    // an array is a sequence of replies, an object is sent as its json text
+                    if (reply.is_array()) {
+                        for (const auto &one: reply)
+                            entry.replies.push_back(one.is_string() ? one.get<std::string>() : one.dump());
+                    } else {
+                        entry.replies.push_back(reply.is_string() ? reply.get<std::string>() : reply.dump());
+                    }
+                    o.script.push_back(entry);
+                }
+            }
+        }
+
+        //////////////////////////////////////////////////////////////////////////////
+        // Answers
+        //////////////////////////////////////////////////////////////////////////////
+
+        struct HtmlElement {
+            int id;
+            std::string tag;
+            std::string text;
+        };
+
+        /// the elements with an id in an HTML description, as rendered by StateStructure
+        std::vector<HtmlElement> parseElements(const std::string &html) {
+            static const std::regex element(R"(<(\w+) id=(\d+)([^>]*)>([^<]*))");
+            static const std::regex textAttribute(R"((?:text|content-desc)=\"([^\"]+)\")");
+            std::vector<HtmlElement> elements;
+            std::set<int> seen;
+            for (std::sregex_iterator it(html.begin(), html.end(), element), end; it != end; ++it) {
+                HtmlElement e{std::stoi((*it)[2]), (*it)[1], (*it)[4]};
+                if (!seen.insert(e.id).second)
+                    continue;
+                std::smatch attribute;
+                std::string attributes = (*it)[3];
+                if (e.text.find_first_not_of(" \t\r\n") == std::string::npos &&
+                    std::regex_search(attributes, attribute, textAttribute))
+                    e.text = attribute[1];
+                e.text.erase(0, e.text.find_first_not_of(" \t\r\n"));
+                e.text.erase(e.text.find_last_not_of(" \t\r\n") + 1);
+                elements.push_back(e);
+            }
+            return elements;
+        }
+
+        std::string functionName(const HtmlElement &e) {
+            if (e.tag == "input")
+                return "enter text in " + (e.text.empty() ? "input " + std::to_string(e.id) : "'" + e.text + "'");
+            if (e.tag == "scroller")
+                return "scroll list " + std::to_string(e.id);
+            return e.text.empty() ? "use " + e.tag + " " + std::to_string(e.id) : "open '" + e.text + "'";
+        }
+
+        nlohmann::ordered_json overviewOf(const std::string &html) {
+            std::vector<HtmlElement> elements = parseElements(html);
+            nlohmann::ordered_json answer;
+            std::string overview = "Page with " + std::to_string(elements.size()) + " interactive elements";
+            for (const auto &e: elements) {
+                if (!e.text.empty()) {
+                    overview += ", such as '" + e.text + "'";
+                    break;
+                }
+            }
+            answer["Overview"] = overview + ".";
+            answer["Function List"] = nlohmann::ordered_json::object();
+            std::set<std::string> names;
+            for (const auto &e: elements) {
+                if (answer["Function List"].size() >= 8)
+                    break;
+                std::string name = functionName(e);
+                if (!names.insert(name).second)
+                    name += " " + std::to_string(e.id);
+                answer["Function List"][name] = e.id;
+            }
+            return answer;
+        }
+
+        /// the state numbers named in the prompt, in order of first appearance
+        std::vector<int> stateNumbers(const std::string &prompt) {
+            static const std::regex stateName(R"(State(\d+))");
+            std::vector<int> numbers;
+            for (std::sregex_iterator it(prompt.begin(), prompt.end(), stateName), end; it != end; ++it) {
+                int number = std::stoi((*it)[1]);
+                if (std::find(numbers.begin(), numbers.end(), number) == numbers.end())
+                    numbers.push_back(number);
+            }
+            return numbers;
+        }
+
+        std::string answerOverview(const std::string &prompt) {
+            static const std::string batchMark = "```HTML Description of State";
+            nlohmann::ordered_json answer;
+            if (prompt.find(batchMark) != std::string::npos) {
+                answer["States"] = nlohmann::ordered_json::object();
+                for (size_t at = prompt.find(batchMark); at != std::string::npos; at = prompt.find(batchMark, at)) {
+                    at += batchMark.size();
+                    size_t lineEnd = prompt.find('\n', at);
+                    size_t blockEnd = prompt.find("```", lineEnd);
+                    if (lineEnd == std::string::npos)
+                        break;
+                    std::string name = "State" + prompt.substr(at, lineEnd - at);
+                    answer["States"][name] = overviewOf(prompt.substr(lineEnd, blockEnd - lineEnd));
+                }
+            } else {
+                size_t begin = prompt.find("```HTML Description");
+                size_t end = begin == std::string::npos ? std::string::npos : prompt.find("```", begin + 3);
+                answer = overviewOf(begin == std::string::npos ? prompt : prompt.substr(begin, end - begin));
+            }
+            size_t current = prompt.find("Current: ");
+            if (prompt.find("\"Top5\"") != std::string::npos && current != std::string::npos) {
+                // the examples of the format prompt name states too, only the current and the other pages are real
+                std::vector<int> numbers = stateNumbers(prompt.substr(current));
+                if (numbers.size() > 5)
+                    numbers.resize(5);
+                answer["Top5"] = numbers;
+            }
+            return answer.dump(2);
+        }
+
+        std::string answerGuide(const std::string &prompt) {
+            static const std::string blockMark = "```State Informations\n";
+            nlohmann::ordered_json answer;
+            size_t begin = prompt.find(blockMark);
+            if (begin == std::string::npos)
+                return "{}";
+            begin += blockMark.size();
+            size_t end = prompt.find("\n```", begin);
+            nlohmann::json states = nlohmann::json::parse(prompt.substr(begin, end - begin), nullptr, false);
+            size_t testedAt = prompt.find("Tested Functions: {");
+            std::string tested = testedAt == std::string::npos ? "" : prompt.substr(testedAt, prompt.find('}', testedAt) - testedAt);
+            if (states.is_discarded() || !states.is_object())
+                return "{}";
+            // the first untested function of the first state, as the states come ranked
+            for (const std::string pass: {"untested", "any"}) {
+                for (auto it = states.begin(); it != states.end(); ++it) {
+                    if (!it.value().contains("FunctionList"))
+                        continue;
+                    for (const auto &function: it.value()["FunctionList"]) {
+                        std::string name = function.is_string() ? function.get<std::string>() : function.dump();
+                        if (pass == "untested" && tested.find(name + ",") != std::string::npos)
+                            continue;
+                        answer["Target State"] = it.key();
+                        answer["Target Function"] = name;
+                        return answer.dump(4);
+                    }
+                }
+            }
+            return "{}";
+        }
+
+        std::string answerTestFunction(const std::string &prompt, int steps) {
+            std::vector<HtmlElement> elements = parseElements(prompt);
+            nlohmann::ordered_json answer;
+            if (steps >= gOptions.testSteps || elements.empty()) {
+                answer["Element Id"] = -1;
+                answer["Action Type"] = 0;
+                return answer.dump(4);
+            }
+            const HtmlElement &e = elements[steps % elements.size()];
+            answer["Element Id"] = e.id;
+            if (e.tag == "input") {
+                answer["Action Type"] = 6;
+                answer["Input"] = "mock input";
+            } else if (e.tag == "scroller") {
+                answer["Action Type"] = 3;
+            } else {
+                answer["Action Type"] = 0;
+            }
+            return answer.dump(4);
+        }
+
+        std::string answerReanalysis(const std::string &prompt) {
+            nlohmann::ordered_json answer = nlohmann::ordered_json::object();
+            for (const auto &e: parseElements(prompt))
+                answer[std::to_string(e.id)] = functionName(e);
+            return answer.dump(4);
+        }
+
+        /// what a model makes of the broken text: every complete member, closed
+        std::string answerFixJson(const std::string &prompt) {
+            static const std::string blockMark = "```Broken JSON\n";
+            size_t at = prompt.find(blockMark);
+            std::string text = at == std::string::npos ? prompt : prompt.substr(at + blockMark.size());
+            size_t begin = text.find('{');
+            if (begin == std::string::npos)
+                return "{}";
+            std::vector<char> closers;
+            std::vector<char> cutClosers;
+            size_t cut = std::string::npos;
+            bool inString = false;
+            bool escape = false;
+            for (size_t i = begin; i < text.size(); i++) {
+                char c = text[i];
+                if (inString) {
+                    if (escape)
+                        escape = false;
+                    else if (c == '\\')
+                        escape = true;
+                    else if (c == '"')
+                        inString = false;
+                    continue;
+                }
+                if (c == '"') {
+                    inString = true;
+                } else if (c == '{' || c == '[') {
+                    closers.push_back(c == '{' ? '}' : ']');
+                } else if (c == '}' || c == ']') {
+                    if (!closers.empty())
+                        closers.pop_back();
+                    if (closers.empty())
+                        return text.substr(begin, i - begin + 1);
+                } else if (c == ',') {
+                    cut = i;
+                    cutClosers = closers;
+                }
+            }
+            if (cut == std::string::npos)
+                return "{}";
+            std::string fixed = text.substr(begin, cut - begin);
+            for (auto it = cutClosers.rbegin(); it != cutClosers.rend(); ++it)
+                fixed += *it;
+            return nlohmann::json::accept(fixed) ? fixed : "{}";
+        }
+
+        /// the question type, named as in AskModel, from the prompt texts of agent/prompt.h
+        std::string questionType(const std::string &prompt) {
+            if (prompt.find("```Broken JSON") != std::string::npos)
+                return "FIX_JSON";
+            if (prompt.find("\"Element Id\"") != std::string::npos)
+                return "TEST_FUNCTION";
+            if (prompt.find("Which State should we go next") != std::string::npos)
+                return "GUIDE";
+            if (prompt.find("existing Function List") != std::string::npos)
+                return "REANALYSIS";
+            if (prompt.find("\"Function List\"") != std::string::npos)
+                return "STATE_OVERVIEW";
+            return "OTHER";
+        }
+
+        std::string answerFor(const std::string &type, const std::string &prompt, int assistantTurns) {
+            {
+                std::lock_guard<std::mutex> lock(gSeenMutex);
+                for (size_t i = 0; i < gOptions.script.size(); i++) {
+                    const ScriptEntry &entry = gOptions.script[i];
+                    if ((entry.type.empty() || entry.type == type) &&
+                        (entry.match.empty() || prompt.find(entry.match) != std::string::npos) && !entry.replies.empty())
+                        return entry.replies[gScriptTurn[i]++ % entry.replies.size()];
+                }
+            }
+            if (type == "STATE_OVERVIEW")
+                return answerOverview(prompt);
+            if (type == "GUIDE")
+                return answerGuide(prompt);
+            if (type == "TEST_FUNCTION")
+                return answerTestFunction(prompt, assistantTurns);
+            if (type == "REANALYSIS")
+                return answerReanalysis(prompt);
+            if (type == "FIX_JSON")
+                return answerFixJson(prompt);
+            return "OK.";
+        }
+
+        /// the mistakes models make, in turn: prose and a fence around the object, an object cut off,
+        /// python style quotes, no object at all
+        std::string malform(const std::string &answer, std::mt19937_64 &random) {
+            switch (std::uniform_int_distribution<int>(0, 3)(random)) {
+                case 0:
+                    return "Sure! Here is the result:\n```json\n" + answer + "\n```\nLet me know if you need more.";
+                case 1:
+                    return answer.substr(0, answer.size() * 3 / 5);
+                case 2: {
+                    std::string quoted = answer;
+                    std::replace(quoted.begin(), quoted.end(), '"', '\'');
+                    return quoted;
+                }
+                default:
+                    return "I'm sorry, but I can't determine that from the page.";
+            }
+        }
+
+        //////////////////////////////////////////////////////////////////////////////
+        // HTTP
+        //////////////////////////////////////////////////////////////////////////////
+
+        struct Request {
+            std::string method;
+            std::string path;
+            std::map<std::string, std::string> headers; // lower case names
+            std::string body;
+        };
+
+        bool sendAll(int fd, const std::string &data) {
+            size_t sent = 0;
+            while (sent < data.size()) {
+                ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                sent += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        /// false once the client is gone, bytes after the request are kept for the next one
+        bool readRequest(int fd, std::string &buffer, Request &request) {
+            size_t headerEnd;
+            char chunk[16384];
+            while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                buffer.append(chunk, static_cast<size_t>(n));
+            }
+            std::istringstream head(buffer.substr(0, headerEnd));
+            std::string line;
+            std::getline(head, line);
+            std::istringstream requestLine(line);
+            requestLine >> request.method >> request.path;
+            request.headers.clear();
+            while (std::getline(head, line)) {
+                size_t colon = line.find(':');
+                if (colon == std::string::npos)
+                    continue;
+                std::string name = line.substr(0, colon);
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                std::string value = line.substr(colon + 1);
+                value.erase(0, value.find_first_not_of(' '));
+                value.erase(value.find_last_not_of("\r ") + 1);
+                request.headers[name] = value;
+            }
+            buffer.erase(0, headerEnd + 4);
+            size_t length = request.headers.count("content-length") ? std::stoul(request.headers["content-length"]) : 0;
+            if (request.headers.count("expect") && buffer.size() < length)
+                sendAll(fd, "HTTP/1.1 100 Continue\r\n\r\n");
+            while (buffer.size() < length) {
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                buffer.append(chunk, static_cast<size_t>(n));
+            }
+            request.body = buffer.substr(0, length);
+            buffer.erase(0, length);
+            return true;
+        }
+
+        const char *reason(int status) {
+            switch (status) {
+                case 200:
+                    return "OK";
+                case 400:
+                    return "Bad Request";
+                case 404:
+                    return "Not Found";
+                case 429:
+                    return "Too Many Requests";
+                case 500:
+                    return "Internal Server Error";
+                case 502:
+                    return "Bad Gateway";
+                case 503:
+                    return "Service Unavailable";
+                default:
+                    return "Error";
+            }
+        }
+
+        std::string responseHead(int status, const std::string &contentType, const std::string &extra) {
+            std::string head = "HTTP/1.1 " + std::to_string(status) + " " + reason(status) + "\r\n";
+            head += "Content-Type: " + contentType + "\r\n" + extra;
+            return head;
+        }
+
+        bool sendJson(int fd, int status, const std::string &body, const std::string &extra = "") {
+            return sendAll(fd, responseHead(status, "application/json", extra) +
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+        }
+
+        bool sendError(int fd, int status, const std::string &message) {
+            nlohmann::json error;
+            error["error"]["message"] = message;
+            error["error"]["type"] = status == 429 ? "rate_limit_exceeded"
+                                                   : status < 500 ? "invalid_request_error" : "server_error";
+            error["error"]["code"] = status;
+            std::string extra;
+            if ((status == 429 || status == 503) && gOptions.retryAfterSeconds >= 0)
+                extra = "Retry-After: " + std::to_string(gOptions.retryAfterSeconds) + "\r\n";
+            return sendJson(fd, status, error.dump(), extra);
+        }
+
+        void sleepMs(double ms) {
+            if (ms > 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long>(ms * 1000)));
+        }
+
+        double drawLatency(std::mt19937_64 &random) {
+            const LatencyOptions &l = gOptions.latency;
+            double ms = l.meanMs;
+            if (l.distribution == "uniform") {
+                ms = std::uniform_real_distribution<double>(l.minMs, std::max(l.minMs, l.maxMs))(random);
+            } else if (l.distribution == "normal") {
+                ms = std::normal_distribution<double>(l.meanMs, l.stddevMs)(random);
+            } else if (l.distribution == "lognormal" && l.meanMs > 0) {
+                // mean and stddev of the latency itself, the long tail of a busy endpoint
+                double sigma2 = std::log(1 + l.stddevMs * l.stddevMs / (l.meanMs * l.meanMs));
+                ms = std::lognormal_distribution<double>(std::log(l.meanMs) - sigma2 / 2, std::sqrt(sigma2))(random);
+            }
+            return std::min(std::max(ms, l.minMs), l.maxMs);
+        }
+
+        Fault drawFault(std::mt19937_64 &random) {
+            double draw = std::uniform_real_distribution<double>(0, 1)(random);
+            double bound = gOptions.errorRate;
+            if (draw < bound)
+                return Fault::HTTP_ERROR;
+            if (draw < (bound += gOptions.malformedRate))
+                return Fault::MALFORMED;
+            if (draw < (bound += gOptions.invalidBodyRate))
+                return Fault::INVALID_BODY;
+            if (draw < (bound += gOptions.truncateRate))
+                return Fault::TRUNCATED;
+            return Fault::NONE;
+        }
+
+        nlohmann::json usageOf(size_t promptChars, size_t completionChars) {
+            // about four characters a token
+            nlohmann::json usage;
+            usage["prompt_tokens"] = (promptChars + 3) / 4;
+            usage["completion_tokens"] = (completionChars + 3) / 4;
+            usage["total_tokens"] = (promptChars + 3) / 4 + (completionChars + 3) / 4;
+            return usage;
+        }
+
+        std::string sseEvent(const nlohmann::json &event) {
+            std::string data = "data: " + event.dump() + "\n\n";
+            std::ostringstream chunk;
+            chunk << std::hex << data.size() << "\r\n" << data << "\r\n";
+            return chunk.str();
+        }
+
+        /// false if the connection is to be closed
+        bool handleCompletion(int fd, const Request &request) {
+            nlohmann::json body = nlohmann::json::parse(request.body, nullptr, false);
+            if (body.is_discarded() || !body.contains("messages") || !body["messages"].is_array())
+                return sendError(fd, 400, "the body is not a chat completion request");
+
+            std::string prompt;
+            int assistantTurns = 0;
+            for (const auto &message: body["messages"]) {
+                std::string role = message.value("role", "");
+                if (role == "assistant")
+                    assistantTurns++;
+                else if (role == "user" && message.contains("content") && message["content"].is_string())
+                    prompt = message["content"].get<std::string>();
+            }
+            bool stream = body.value("stream", false);
+            bool includeUsage = body.contains("stream_options") && body["stream_options"].value("include_usage", false);
+            std::string model = body.value("model", gOptions.model);
+            std::string type = questionType(prompt);
+
+            uint64_t hash = fnv1a(request.body);
+            int sentBefore;
+            {
+                std::lock_guard<std::mutex> lock(gSeenMutex);
+                sentBefore = gSeen[hash]++;
+            }
+            std::mt19937_64 random(gOptions.seed ^ hash ^ (0x9e3779b97f4a7c15ULL * static_cast<uint64_t>(sentBefore + 1)));
+            double latencyMs = drawLatency(random);
+            Fault fault = drawFault(random);
+            if (gOptions.maxConcurrent > 0 && gActive.load() > gOptions.maxConcurrent)
+                fault = Fault::OVERLOADED;
+            {
+                std::lock_guard<std::mutex> lock(gStats.mutex);
+                gStats.requests++;
+                gStats.streamed += stream ? 1 : 0;
+                gStats.types[type]++;
+                gStats.faults[faultName(fault)]++;
+                gStats.latencyMsSum += latencyMs;
+            }
+            printf("%-14s %-6s %-12s %6.0f ms%s\n", type.c_str(), stream ? "stream" : "plain", faultName(fault),
+                   latencyMs, sentBefore > 0 ? " (resent)" : "");
+            fflush(stdout);
+
+            if (fault == Fault::OVERLOADED)
+                return sendError(fd, 429, "too many concurrent requests");
+            sleepMs(latencyMs);
+            if (fault == Fault::HTTP_ERROR) {
+                int status = gOptions.errorStatuses[std::uniform_int_distribution<size_t>(
+                        0, gOptions.errorStatuses.size() - 1)(random)];
+                return sendError(fd, status, "injected failure");
+            }
+
+            std::string content = answerFor(type, prompt, assistantTurns);
+            std::string finishReason = "stop";
+            if (fault == Fault::MALFORMED) {
+                std::string malformed = malform(content, random);
+                if (malformed.size() < content.size() && content.compare(0, malformed.size(), malformed) == 0)
+                    finishReason = "length";
+                content = malformed;
+            }
+            std::string id = "chatcmpl-mock" + std::to_string(++gCompletionId);
+            long created = static_cast<long>(std::time(nullptr));
+
+            if (!stream) {
+                nlohmann::json reply;
+                reply["id"] = id;
+                reply["object"] = "chat.completion";
+                reply["created"] = created;
+                reply["model"] = model;
+                reply["choices"] = nlohmann::json::array();
+                reply["choices"][0]["index"] = 0;
+                reply["choices"][0]["message"]["role"] = "assistant";
+                reply["choices"][0]["message"]["content"] = content;
+                reply["choices"][0]["finish_reason"] = finishReason;
+                reply["usage"] = usageOf(request.body.size(), content.size());
+                std::string text = reply.dump();
+                if (fault == Fault::INVALID_BODY)
+                    return sendJson(fd, 200, "<html><body>502 Bad Gateway</body></html>");
+                if (fault == Fault::TRUNCATED) {
+                    std::string head = responseHead(200, "application/json", "") +
+                                       "Content-Length: " + std::to_string(text.size()) + "\r\n\r\n";
+                    sendAll(fd, head + text.substr(0, text.size() / 2));
+                    return false;
+                }
+                return sendJson(fd, 200, text);
+            }
+
+            if (!sendAll(fd, responseHead(200, "text/event-stream", "Cache-Control: no-cache\r\n") +
+                             "Transfer-Encoding: chunked\r\n\r\n"))
+                return false;
+            if (fault == Fault::INVALID_BODY) {
+                // a proxy answering in place of the model
+                std::string page = "<html><body>502 Bad Gateway</body></html>\n";
+                std::ostringstream chunk;
+                chunk << std::hex << page.size() << "\r\n" << page << "\r\n0\r\n\r\n";
+                return sendAll(fd, chunk.str());
+            }
+            nlohmann::json event;
+            event["id"] = id;
+            event["object"] = "chat.completion.chunk";
+            event["created"] = created;
+            event["model"] = model;
+            event["choices"] = nlohmann::json::array();
+            event["choices"][0]["index"] = 0;
+            event["choices"][0]["delta"] = {{"role", "assistant"}, {"content", ""}};
+            event["choices"][0]["finish_reason"] = nullptr;
+            if (!sendAll(fd, sseEvent(event)))
+                return false;
+            size_t truncateAt = fault == Fault::TRUNCATED ? content.size() / 2 : std::string::npos;
+            for (size_t at = 0; at < content.size(); at += gOptions.chunkChars) {
+                if (at >= truncateAt)
+                    return false;
+                sleepMs(static_cast<double>(gOptions.chunkDelayMs));
+                event["choices"][0]["delta"] = {{"content", content.substr(at, gOptions.chunkChars)}};
+                if (!sendAll(fd, sseEvent(event)))
+                    return false; // the client stops reading once the answer is decided
+            }
+            event["choices"][0]["delta"] = nlohmann::json::object();
+            event["choices"][0]["finish_reason"] = finishReason;
+            if (!sendAll(fd, sseEvent(event)))
+                return false;
+            if (includeUsage) {
+                event["choices"] = nlohmann::json::array();
+                event["usage"] = usageOf(request.body.size(), content.size());
+                if (!sendAll(fd, sseEvent(event)))
+                    return false;
+            }
+            std::string done = "data: [DONE]\n\n";
+            std::ostringstream tail;
+            tail << std::hex << done.size() << "\r\n" << done << "\r\n0\r\n\r\n";
+            return sendAll(fd, tail.str());
+        }
+
+        void serve(int fd) {
+            gActive++;
+            std::string buffer;
+            Request request;
+            while (readRequest(fd, buffer, request)) {
+                bool keepAlive = true;
+                if (request.method == "POST" &&
+                    (request.path == "/v1/chat/completions" || request.path == "/chat/completions")) {
+                    keepAlive = handleCompletion(fd, request);
+                } else if (request.method == "GET" && (request.path == "/v1/models" || request.path == "/models")) {
+                    nlohmann::json models;
+                    models["object"] = "list";
+                    models["data"] = nlohmann::json::array();
+                    models["data"][0] = {{"id", gOptions.model}, {"object", "model"}, {"owned_by", "mock"}};
+                    keepAlive = sendJson(fd, 200, models.dump());
+                } else if (request.method == "GET" && request.path == "/stats") {
+                    keepAlive = sendJson(fd, 200, gStats.toJson().dump(2));
+                } else {
+                    keepAlive = sendError(fd, 404, "no route for " + request.method + " " + request.path);
+                }
+                auto connection = request.headers.find("connection");
+                if (!keepAlive || (connection != request.headers.end() && connection->second == "close"))
+                    break;
+            }
+            close(fd);
+            gActive--;
+        }
+
+        void onSignal(int) {
+            // the accept loop ends once the listener is closed
+            if (gListener >= 0) {
+                shutdown(gListener, SHUT_RDWR);
+                close(gListener);
+                gListener = -1;
+            }
+        }
+
+    }
+
+}
+
+int main(int argc, char **argv) {
+    using namespace fastbotx;
+    int port = -1;
+    long seed = -1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--config" && i + 1 < argc) {
+            loadConfig(argv[++i]);
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::atol(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--config file.json] [--port n] [--seed n]\n", argv[0]);
+            return 1;
+        }
+    }
+    // the command line wins over the config
+    if (port >= 0)
+        gOptions.port = port;
+    if (seed >= 0)
+        gOptions.seed = static_cast<uint64_t>(seed);
+
+    gListener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(gListener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(gOptions.port));
+    if (bind(gListener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(gListener, 128) < 0) {
+        fprintf(stderr, "can't listen on port %d: %s\n", gOptions.port, strerror(errno));
+        return 1;
+    }
+    struct sigaction action{};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    printf("mock llm server on http://127.0.0.1:%d/v1, seed %llu\n", gOptions.port,
+           static_cast<unsigned long long>(gOptions.seed));
+    fflush(stdout);
+
+    while (true) {
+        int listener = gListener;
+        if (listener < 0)
+            break;
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR && gListener >= 0)
+                continue;
+            break;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        std::thread(serve, fd).detach();
+    }
+    printf("%s\n", gStats.toJson().dump(2).c_str());
+    return 0;
+}
+
+#endif